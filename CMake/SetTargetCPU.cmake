@@ -21,7 +21,8 @@ if(PORTABLE)
   endif()
   message(
     WARNING
-      "Building portable binaries, which will have slightly decreased performance."
+      "Building portable binaries, which will have slightly decreased performance. "
+      "The SIMD kernels are selected at run time."
   )
 else()
   if(NOT TARGET_CPU)
@@ -1,15 +1,8 @@
 #include "aftimeblockencoder.h"
 
-#include <random>
+#include "bytepacker.h"
 
-namespace {
-void changeChannelFactor(std::vector<AFTimeBlockEncoder::DBufferRow> &data,
-                                            float *metaBuffer, size_t visIndex,
-                                            double factor) {
-  metaBuffer[visIndex] /= factor;
-  for (AFTimeBlockEncoder::DBufferRow &row : data) row.visibilities[visIndex] *= factor;
-}
-}
+#include <random>
 
 AFTimeBlockEncoder::AFTimeBlockEncoder(size_t nPol, size_t nChannels,
                                        bool fitToMaximum)
@@ -17,8 +10,8 @@ AFTimeBlockEncoder::AFTimeBlockEncoder(size_t nPol, size_t nChannels,
       _nChannels(nChannels),
       _fitToMaximum(fitToMaximum),
       _rmsPerChannel(_nChannels * nPol),
-      _ditherDist(
-          dyscostman::StochasticEncoder<double>::GetDitherDistribution()) {}
+      _antennaRMSIterationCount(0),
+      _fitIterationCount(0) {}
 
 AFTimeBlockEncoder::~AFTimeBlockEncoder() = default;
 
@@ -26,45 +19,38 @@ void AFTimeBlockEncoder::Normalize(
     const dyscostman::StochasticEncoder<float> &gausEncoder,
     TimeBlockBuffer<std::complex<float>> &buffer, size_t antennaCount) {
   if (_rmsPerAntenna.size() < antennaCount) _rmsPerAntenna.resize(antennaCount);
-  std::vector<DBufferRow> data;
-  buffer.ConvertVector<std::complex<double>>(data);
+  const FBuffer &data = buffer;
+  initializeEncodeFactors(data);
   const size_t visPerRow = _nPol * _nChannels;
 
   // Normalize the RMS of the channels
   std::vector<RMSMeasurement> channelRMSes(_nChannels * _nPol);
-  for (const DBufferRow &row : data) {
+  for (size_t rowIndex = 0; rowIndex != data.NRows(); ++rowIndex) {
+    const std::complex<float> *row = data.Row(rowIndex);
     for (size_t i = 0; i != visPerRow; ++i) {
-      channelRMSes[i].Include(row.visibilities[i]);
+      channelRMSes[i].Include(row[i]);
     }
   }
-  for (DBufferRow &row : data) {
-    for (size_t i = 0; i != visPerRow; ++i) {
-      double rms = channelRMSes[i].RMS();
-      row.visibilities[i] /= rms;
-    }
+  for (size_t i = 0; i != visPerRow; ++i) {
+    _encodeVisFactors[i] = 1.0 / channelRMSes[i].RMS();
   }
 
   for (size_t p = 0; p != _nPol; ++p) {
     // Normalize the RMS of the antennae
     calculateAntennaeRMS(data, p, antennaCount);
-    for (DBufferRow &row : data) {
-      double mul =
-          (_rmsPerAntenna[row.antenna1] * _rmsPerAntenna[row.antenna2]);
-      double fac = (mul == 0.0) ? 0.0 : 1.0 / mul;
-      for (size_t ch = 0; ch != _nChannels; ++ch) {
-        row.visibilities[ch * _nPol + p] *= fac;
-      }
-    }
+    setAntennaRowFactors(data, p);
   }
 
   if (_fitToMaximum) {
     for (size_t visIndex = 0; visIndex != visPerRow; ++visIndex) {
+      const size_t polIndex = visIndex % _nPol;
       double factor = 1.0;
-      for (const DBufferRow &row : data) {
-        if (row.antenna1 != row.antenna2) {
-          const std::complex<double> *ptr = &row.visibilities[visIndex];
-          double complMax = std::max(ptr->real(), ptr->imag());
-          double complMin = std::min(ptr->real(), ptr->imag());
+      for (size_t rowIndex = 0; rowIndex != data.NRows(); ++rowIndex) {
+        if (data.Antenna1(rowIndex) != data.Antenna2(rowIndex)) {
+          const std::complex<double> v =
+              normalizedValue(data, rowIndex, visIndex, polIndex);
+          double complMax = std::max(v.real(), v.imag());
+          double complMin = std::min(v.real(), v.imag());
 
           if (complMax * factor > gausEncoder.MaxQuantity()) {
             factor = complMax / gausEncoder.MaxQuantity();
@@ -73,12 +59,34 @@ void AFTimeBlockEncoder::Normalize(
           }
         }
       }
-      for (DBufferRow &row : data) row.visibilities[visIndex] *= factor;
+      _encodeVisFactors[visIndex] *= factor;
     }
   }
+
+  for (size_t rowIndex = 0; rowIndex != buffer.NRows(); ++rowIndex) {
+    std::complex<float> *row = buffer.Row(rowIndex);
+    for (size_t i = 0; i != visPerRow; ++i)
+      row[i] = normalizedValue(data, rowIndex, i, i % _nPol);
+  }
+}
+
+void AFTimeBlockEncoder::setAntennaRowFactors(const FBuffer &data,
+                                              size_t polIndex) {
+  for (size_t rowIndex = 0; rowIndex != data.NRows(); ++rowIndex) {
+    double mul = (_rmsPerAntenna[data.Antenna1(rowIndex)] *
+                  _rmsPerAntenna[data.Antenna2(rowIndex)]);
+    double fac = (mul == 0.0) ? 0.0 : 1.0 / mul;
+    _encodeRowFactors[rowIndex * _nPol + polIndex] = fac;
+  }
 }
 
-void AFTimeBlockEncoder::changeAntennaFactor(std::vector<DBufferRow> &data,
+void AFTimeBlockEncoder::changeChannelFactor(float *metaBuffer,
+                                             size_t visIndex, double factor) {
+  metaBuffer[visIndex] /= factor;
+  _encodeVisFactors[visIndex] *= factor;
+}
+
+void AFTimeBlockEncoder::changeAntennaFactor(const FBuffer &data,
                                              float *metaBuffer,
                                              size_t antennaIndex,
                                              size_t antennaCount,
@@ -86,14 +94,12 @@ void AFTimeBlockEncoder::changeAntennaFactor(std::vector<DBufferRow> &data,
   const size_t visPerRow = _nPol * _nChannels;
   size_t metaIndex = visPerRow + antennaCount * polIndex;
   metaBuffer[metaIndex + antennaIndex] /= factor;
-  for (DBufferRow &row : data) {
-    unsigned count = 0;
-    if (row.antenna1 == antennaIndex) ++count;
-    if (row.antenna2 == antennaIndex) ++count;
-    for (unsigned repeat = 0; repeat != count; ++repeat) {
-      for (size_t i = 0; i != _nChannels; ++i)
-        row.visibilities[i * _nPol + polIndex] *= factor;
-    }
+  for (size_t i = _antennaRowOffsets[antennaIndex];
+       i != _antennaRowOffsets[antennaIndex + 1]; ++i) {
+    const size_t rowIndex = _antennaRows[i];
+    double &rowFactor = _encodeRowFactors[rowIndex * _nPol + polIndex];
+    if (data.Antenna1(rowIndex) == antennaIndex) rowFactor *= factor;
+    if (data.Antenna2(rowIndex) == antennaIndex) rowFactor *= factor;
   }
 }
 
@@ -120,186 +126,264 @@ void AFTimeBlockEncoder::changeAntennaFactor(std::vector<DBufferRow> &data,
 //
 // Approach: iterate over all antenna and channels, and find the antenna/channel
 // that can increase the sum the most.
-void AFTimeBlockEncoder::fitToMaximum(
-    std::vector<DBufferRow> &data, float *metaBuffer,
-    double max_level, size_t antennaCount) {
+void AFTimeBlockEncoder::fitToMaximum(const FBuffer &data, float *metaBuffer,
+                                      double max_level, size_t antennaCount) {
   // First, the channels and polarizations are scaled such that the maximum
   // value equals the maximum encodable value
   const size_t visPerRow = _nPol * _nChannels;
-  for (size_t visIndex = 0; visIndex != visPerRow; ++visIndex) {
-    double largest_component = 0.0;
-    for (const DBufferRow &row : data) {
-      if (row.antenna1 != row.antenna2) {
-        const std::complex<double> *ptr = &row.visibilities[visIndex];
-        double local_max = std::max(std::max(ptr->real(), ptr->imag()),
-                                   -std::min(ptr->real(), ptr->imag()));
-        if (std::isfinite(local_max) && local_max > largest_component)
-          largest_component = local_max;
+  aocommon::UVector<double> largestComponents(visPerRow, 0.0);
+  forEachRange(visPerRow, data.NRows(), [&](size_t visBegin, size_t visEnd) {
+    // The rows are scanned in order of memory
+    for (size_t rowIndex = 0; rowIndex != data.NRows(); ++rowIndex) {
+      if (data.Antenna1(rowIndex) != data.Antenna2(rowIndex)) {
+        size_t polIndex = visBegin % _nPol;
+        for (size_t visIndex = visBegin; visIndex != visEnd; ++visIndex) {
+          const std::complex<double> v =
+              normalizedValue(data, rowIndex, visIndex, polIndex);
+          double local_max = std::max(std::max(v.real(), v.imag()),
+                                      -std::min(v.real(), v.imag()));
+          if (std::isfinite(local_max) &&
+              local_max > largestComponents[visIndex])
+            largestComponents[visIndex] = local_max;
+          if (++polIndex == _nPol) polIndex = 0;
+        }
       }
     }
-    const double factor =
-        (max_level == 0.0 || largest_component == 0.0)
-            ? 1.0
-            : max_level / largest_component;
-    changeChannelFactor(data, metaBuffer, visIndex, factor);
+    for (size_t visIndex = visBegin; visIndex != visEnd; ++visIndex) {
+      const double largest_component = largestComponents[visIndex];
+      const double factor = (max_level == 0.0 || largest_component == 0.0)
+                                ? 1.0
+                                : max_level / largest_component;
+      changeChannelFactor(metaBuffer, visIndex, factor);
+    }
+  });
+
+  // List the rows of every antenna. An auto-correlation is listed once.
+  _antennaRowOffsets.assign(antennaCount + 1, 0);
+  for (size_t rowIndex = 0; rowIndex != data.NRows(); ++rowIndex) {
+    ++_antennaRowOffsets[data.Antenna1(rowIndex) + 1];
+    if (data.Antenna1(rowIndex) != data.Antenna2(rowIndex))
+      ++_antennaRowOffsets[data.Antenna2(rowIndex) + 1];
   }
+  for (size_t a = 0; a != antennaCount; ++a)
+    _antennaRowOffsets[a + 1] += _antennaRowOffsets[a];
+  _antennaRows.resize(_antennaRowOffsets[antennaCount]);
+  aocommon::UVector<size_t> rowCounts(antennaCount, 0);
+  for (size_t rowIndex = 0; rowIndex != data.NRows(); ++rowIndex) {
+    const size_t antenna1 = data.Antenna1(rowIndex);
+    const size_t antenna2 = data.Antenna2(rowIndex);
+    _antennaRows[_antennaRowOffsets[antenna1] + rowCounts[antenna1]++] =
+        rowIndex;
+    if (antenna1 != antenna2)
+      _antennaRows[_antennaRowOffsets[antenna2] + rowCounts[antenna2]++] =
+          rowIndex;
+  }
+
+  // The polarizations are independent and are fitted in parallel
+  aocommon::UVector<size_t> iterationCounts(_nPol);
+  forEachRange(_nPol, data.NRows() * _nChannels,
+               [&](size_t polBegin, size_t polEnd) {
+                 for (size_t polIndex = polBegin; polIndex != polEnd;
+                      ++polIndex)
+                   iterationCounts[polIndex] = fitPolarizationToMaximum(
+                       data, metaBuffer, max_level, antennaCount, polIndex);
+               });
+  for (size_t count : iterationCounts) _fitIterationCount += count;
+}
 
-  for (size_t polIndex = 0; polIndex != _nPol; ++polIndex) {
-    bool isProgressing;
-    do {
-      // Find the factor that increasest the sum of absolute values the most
-      double bestChannelIncrease = 0.0, channelFactor = 1.0;
-      size_t bestChannel = 0;
+size_t AFTimeBlockEncoder::fitPolarizationToMaximum(const FBuffer &data,
+                                                    float *metaBuffer,
+                                                    double max_level,
+                                                    size_t antennaCount,
+                                                    size_t polIndex) {
+  // The maxima and the sums of absolute values of the channels and antennas
+  // are calculated once, and are updated when a factor is changed. The sums
+  // are also kept per antenna and channel, which is what changes when a
+  // channel is scaled. All factors that are applied are at least one, so the
+  // maxima can only increase.
+  aocommon::UVector<double> channelMax(_nChannels, 0.0),
+      channelSum(_nChannels, 0.0), antennaMax(antennaCount, 0.0),
+      antennaSum(antennaCount, 0.0),
+      antennaChannelMax(antennaCount * _nChannels, 0.0),
+      antennaChannelSum(antennaCount * _nChannels, 0.0);
+  for (size_t rowIndex = 0; rowIndex != data.NRows(); ++rowIndex) {
+    const size_t antenna1 = data.Antenna1(rowIndex);
+    const size_t antenna2 = data.Antenna2(rowIndex);
+    if (antenna1 != antenna2) {
+      double *max1 = &antennaChannelMax[antenna1 * _nChannels];
+      double *max2 = &antennaChannelMax[antenna2 * _nChannels];
+      double *sum1 = &antennaChannelSum[antenna1 * _nChannels];
+      double *sum2 = &antennaChannelSum[antenna2 * _nChannels];
       for (size_t channel = 0; channel != _nChannels; ++channel) {
-        // By how much can we increase this channel?
-        double largest_component = 0.0;
-        for (const DBufferRow &row : data) {
-          if (row.antenna1 != row.antenna2) {
-            const std::complex<double> *ptr =
-                &row.visibilities[channel * _nPol + polIndex];
-            double local_max = std::max(std::max(ptr->real(), ptr->imag()),
-                                       -std::min(ptr->real(), ptr->imag()));
-            if (std::isfinite(local_max) && local_max > largest_component)
-              largest_component = local_max;
-          }
-        }
-        double factor = (largest_component == 0.0)
-                            ? 0.0
-                            : (max_level / largest_component - 1.0);
-        // How much does this increase the total?
-        double thisIncrease = 0.0;
-        for (DBufferRow &row : data) {
-          if (row.antenna1 != row.antenna2) {
-            std::complex<double> v =
-                row.visibilities[channel * _nPol + polIndex] * double(factor);
-            const double absoluteValue =
-                std::fabs(v.real()) + std::fabs(v.imag());
-            if (std::isfinite(absoluteValue)) thisIncrease += absoluteValue;
-          }
+        const std::complex<double> v = normalizedValue(
+            data, rowIndex, channel * _nPol + polIndex, polIndex);
+        const double complMax = std::max(std::max(v.real(), v.imag()),
+                                          -std::min(v.real(), v.imag()));
+        if (std::isfinite(complMax)) {
+          channelMax[channel] = std::max(channelMax[channel], complMax);
+          max1[channel] = std::max(max1[channel], complMax);
+          max2[channel] = std::max(max2[channel], complMax);
         }
-        if (thisIncrease > bestChannelIncrease) {
-          bestChannelIncrease = thisIncrease;
-          bestChannel = channel;
-          channelFactor = factor + 1.0;
+        const double absoluteValue = std::fabs(v.real()) + std::fabs(v.imag());
+        if (std::isfinite(absoluteValue)) {
+          channelSum[channel] += absoluteValue;
+          sum1[channel] += absoluteValue;
+          sum2[channel] += absoluteValue;
         }
       }
+    }
+  }
+  for (size_t a = 0; a != antennaCount; ++a) {
+    for (size_t channel = 0; channel != _nChannels; ++channel) {
+      antennaMax[a] =
+          std::max(antennaMax[a], antennaChannelMax[a * _nChannels + channel]);
+      antennaSum[a] += antennaChannelSum[a * _nChannels + channel];
+    }
+  }
+
+  // Every step brings at least one channel or antenna to the maximum level,
+  // after which it stays there, so this many iterations should suffice.
+  const size_t maxIterations = _nChannels + antennaCount + 1;
+  size_t iteration = 0;
+  bool isProgressing;
+  do {
+    ++iteration;
+    // Find the factor that increasest the sum of absolute values the most
+    double bestChannelIncrease = 0.0, channelFactor = 1.0;
+    size_t bestChannel = 0;
+    for (size_t channel = 0; channel != _nChannels; ++channel) {
+      // By how much can we increase this channel?
+      double factor = (channelMax[channel] == 0.0)
+                          ? 0.0
+                          : (max_level / channelMax[channel] - 1.0);
+      // How much does this increase the total?
+      const double thisIncrease = std::fabs(factor) * channelSum[channel];
+      if (thisIncrease > bestChannelIncrease) {
+        bestChannelIncrease = thisIncrease;
+        bestChannel = channel;
+        channelFactor = factor + 1.0;
+      }
+    }
 
-      aocommon::UVector<double> maxCompPerAntenna(antennaCount, 0.0);
-      for (const DBufferRow &row : data) {
-        if (row.antenna1 != row.antenna2) {
+    size_t bestAntenna = 0;
+    double bestAntennaIncrease = 0.0;
+    for (size_t a = 0; a != antennaCount; ++a) {
+      const double factor =
+          (antennaMax[a] == 0.0) ? 0.0 : (max_level / antennaMax[a] - 1.0);
+      const double thisIncrease = std::fabs(factor) * antennaSum[a];
+      if (thisIncrease > bestAntennaIncrease) {
+        bestAntennaIncrease = thisIncrease;
+        bestAntenna = a;
+      }
+    }
+    // The benefit was calculated for increasing an antenna and increasing a
+    // channel. Select which of those two has the largest benefit and apply:
+    if (bestAntennaIncrease > bestChannelIncrease) {
+      double factor = (antennaMax[bestAntenna] == 0.0)
+                          ? 1.0
+                          : (max_level / antennaMax[bestAntenna]);
+      if (factor < 1.0)
+        isProgressing = false;
+      else {
+        isProgressing = factor > 1.01;
+        // The rows of the antenna are scaled, which changes the maxima and
+        // sums of the other antennas of these rows and of all channels.
+        // Auto-correlations are not part of the fit.
+        for (size_t i = _antennaRowOffsets[bestAntenna];
+             i != _antennaRowOffsets[bestAntenna + 1]; ++i) {
+          const size_t rowIndex = _antennaRows[i];
+          if (data.Antenna1(rowIndex) == data.Antenna2(rowIndex)) continue;
+          const size_t other = data.Antenna1(rowIndex) == bestAntenna
+                                   ? data.Antenna2(rowIndex)
+                                   : data.Antenna1(rowIndex);
+          double *otherMax = &antennaChannelMax[other * _nChannels];
+          double *otherSum = &antennaChannelSum[other * _nChannels];
           for (size_t channel = 0; channel != _nChannels; ++channel) {
-            const std::complex<double> *ptr =
-                &row.visibilities[channel * _nPol + polIndex];
-            double complMax = std::max(std::max(ptr->real(), ptr->imag()),
-                                       -std::min(ptr->real(), ptr->imag()));
+            const std::complex<double> v = normalizedValue(
+                data, rowIndex, channel * _nPol + polIndex, polIndex);
+            const double complMax =
+                std::max(std::max(v.real(), v.imag()),
+                         -std::min(v.real(), v.imag())) *
+                factor;
             if (std::isfinite(complMax)) {
-              if (complMax > maxCompPerAntenna[row.antenna1])
-                maxCompPerAntenna[row.antenna1] = complMax;
-              if (complMax > maxCompPerAntenna[row.antenna2])
-                maxCompPerAntenna[row.antenna2] = complMax;
+              channelMax[channel] = std::max(channelMax[channel], complMax);
+              otherMax[channel] = std::max(otherMax[channel], complMax);
+              antennaMax[other] = std::max(antennaMax[other], complMax);
+            }
+            const double increase =
+                (std::fabs(v.real()) + std::fabs(v.imag())) * (factor - 1.0);
+            if (std::isfinite(increase)) {
+              channelSum[channel] += increase;
+              otherSum[channel] += increase;
+              antennaSum[other] += increase;
             }
           }
         }
-      }
-      aocommon::UVector<double> increasePerAntenna(antennaCount, 0.0);
-      for (const DBufferRow &row : data) {
-        if (row.antenna1 != row.antenna2) {
-          double factor1 = (maxCompPerAntenna[row.antenna1] == 0.0)
-                               ? 0.0
-                               : (max_level /
-                                      maxCompPerAntenna[row.antenna1] -
-                                  1.0);
-          double factor2 = (maxCompPerAntenna[row.antenna2] == 0.0)
-                               ? 0.0
-                               : (max_level /
-                                      maxCompPerAntenna[row.antenna2] -
-                                  1.0);
-          for (size_t channel = 0; channel != _nChannels; ++channel) {
-            std::complex<double> v1 =
-                row.visibilities[channel * _nPol + polIndex] * factor1;
-            double av1 = std::fabs(v1.real()) + std::fabs(v1.imag());
-            if (std::isfinite(av1)) increasePerAntenna[row.antenna1] += av1;
-            std::complex<double> v2 =
-                row.visibilities[channel * _nPol + polIndex] * factor2;
-            double av2 = std::fabs(v2.real()) + std::fabs(v2.imag());
-            if (std::isfinite(av2)) increasePerAntenna[row.antenna2] += av2;
-          }
-        }
-      }
-      size_t bestAntenna = 0;
-      double bestAntennaIncrease = 0.0;
-      for (size_t a = 0; a != antennaCount; ++a) {
-        if (increasePerAntenna[a] > bestAntennaIncrease) {
-          bestAntennaIncrease = increasePerAntenna[a];
-          bestAntenna = a;
+        for (size_t channel = 0; channel != _nChannels; ++channel) {
+          antennaChannelMax[bestAntenna * _nChannels + channel] *= factor;
+          antennaChannelSum[bestAntenna * _nChannels + channel] *= factor;
         }
+        antennaMax[bestAntenna] *= factor;
+        antennaSum[bestAntenna] *= factor;
+        changeAntennaFactor(data, metaBuffer, bestAntenna, antennaCount,
+                            polIndex, factor);
       }
-      // The benefit was calculated for increasing an antenna and increasing a
-      // channel. Select which of those two has the largest benefit and apply:
-      if (bestAntennaIncrease > bestChannelIncrease) {
-        double factor =
-            (maxCompPerAntenna[bestAntenna] == 0.0)
-                ? 1.0
-                : (max_level / maxCompPerAntenna[bestAntenna]);
-        if (factor < 1.0)
-          isProgressing = false;
-        else {
-          isProgressing = factor > 1.01;
-          changeAntennaFactor(data, metaBuffer, bestAntenna, antennaCount,
-                              polIndex, factor);
-        }
+    } else {
+      if (channelFactor < 1.0) {
+        isProgressing = false;
       } else {
-        if (channelFactor < 1.0) {
-          isProgressing = false;
-        } else {
-          isProgressing = channelFactor > 1.001;
-          changeChannelFactor(data, metaBuffer, bestChannel * _nPol + polIndex,
-                              channelFactor);
+        isProgressing = channelFactor > 1.001;
+        channelMax[bestChannel] *= channelFactor;
+        channelSum[bestChannel] *= channelFactor;
+        for (size_t a = 0; a != antennaCount; ++a) {
+          double &max = antennaChannelMax[a * _nChannels + bestChannel];
+          double &sum = antennaChannelSum[a * _nChannels + bestChannel];
+          max *= channelFactor;
+          antennaMax[a] = std::max(antennaMax[a], max);
+          antennaSum[a] += sum * (channelFactor - 1.0);
+          sum *= channelFactor;
         }
+        changeChannelFactor(metaBuffer, bestChannel * _nPol + polIndex,
+                            channelFactor);
       }
-    } while (isProgressing);
-  }
+    }
+  } while (isProgressing && iteration != maxIterations);
+  return iteration;
 }
 
-template <bool UseDithering>
+template <bool UseDithering, typename RandomGenerator>
 void AFTimeBlockEncoder::encode(
     const dyscostman::StochasticEncoder<float> &gausEncoder,
     const TimeBlockBuffer<std::complex<float>> &buffer, float *metaBuffer,
-    symbol_t *symbolBuffer, size_t antennaCount, std::mt19937 *rnd) {
+    symbol_t *symbolBuffer, size_t antennaCount, RandomGenerator *rnd) {
   if (_rmsPerAntenna.size() < antennaCount) _rmsPerAntenna.resize(antennaCount);
-  // Note that encoding is performed with doubles
-  std::vector<DBufferRow> data;
-  buffer.ConvertVector<std::complex<double>>(data);
+  initializeEncodeFactors(buffer);
+  _antennaRMSIterationCount = 0;
+  _fitIterationCount = 0;
   const size_t visPerRow = _nPol * _nChannels;
 
   // Normalize the RMS of the channels
   std::vector<RMSMeasurement> channelRMSes(_nChannels * _nPol);
-  for (const DBufferRow &row : data) {
-    for (size_t i = 0; i != visPerRow; ++i) {
-      channelRMSes[i].Include(row.visibilities[i]);
+  forEachRange(visPerRow, buffer.NRows(), [&](size_t visBegin, size_t visEnd) {
+    for (size_t rowIndex = 0; rowIndex != buffer.NRows(); ++rowIndex) {
+      const std::complex<float> *row = buffer.Row(rowIndex);
+      for (size_t i = visBegin; i != visEnd; ++i) {
+        channelRMSes[i].Include(row[i]);
+      }
     }
-  }
-  for (DBufferRow &row : data) {
-    for (size_t i = 0; i != visPerRow; ++i) {
+    for (size_t i = visBegin; i != visEnd; ++i) {
       double rms = channelRMSes[i].RMS();
       if (rms != 0.0) {
-        row.visibilities[i] /= rms;
+        _encodeVisFactors[i] = 1.0 / rms;
       }
       metaBuffer[i] = rms;
     }
-  }
+  });
 
   for (size_t p = 0; p != _nPol; ++p) {
     // Normalize the RMS of the antennae
-    calculateAntennaeRMS(data, p, antennaCount);
-    for (DBufferRow &row : data) {
-      double mul =
-          (_rmsPerAntenna[row.antenna1] * _rmsPerAntenna[row.antenna2]);
-      double fac = (mul == 0.0) ? 0.0 : 1.0 / mul;
-      for (size_t ch = 0; ch != _nChannels; ++ch) {
-        row.visibilities[ch * _nPol + p] *= fac;
-      }
-    }
+    calculateAntennaeRMS(buffer, p, antennaCount);
+    setAntennaRowFactors(buffer, p);
 
     size_t metaIndex = visPerRow + antennaCount * p;
     for (size_t a = 0; a != antennaCount; ++a)
@@ -307,94 +391,125 @@ void AFTimeBlockEncoder::encode(
   }
 
   if (_fitToMaximum) {
-    fitToMaximum(data, metaBuffer, gausEncoder.MaxQuantity(), antennaCount);
+    fitToMaximum(buffer, metaBuffer, gausEncoder.MaxQuantity(), antennaCount);
   }
 
-  symbol_t *symbolBufferPtr = symbolBuffer;
-  for (const DBufferRow &row : data) {
-    for (size_t i = 0; i != visPerRow; ++i) {
-      if (UseDithering) {
-        symbolBufferPtr[i * 2] = gausEncoder.EncodeWithDithering(
-            row.visibilities[i].real(), _ditherDist(*rnd));
-        symbolBufferPtr[i * 2 + 1] = gausEncoder.EncodeWithDithering(
-            row.visibilities[i].imag(), _ditherDist(*rnd));
-      } else {
-        symbolBufferPtr[i * 2] = gausEncoder.Encode(row.visibilities[i].real());
-        symbolBufferPtr[i * 2 + 1] =
-            gausEncoder.Encode(row.visibilities[i].imag());
-      }
-    }
-    symbolBufferPtr += visPerRow * 2;
-  }
+  quantize<UseDithering>(gausEncoder, buffer, symbolBuffer, rnd);
 }
 
-template void AFTimeBlockEncoder::encode<true>(
+template void AFTimeBlockEncoder::encode<true, std::mt19937>(
     const dyscostman::StochasticEncoder<float> &gausEncoder,
     const TimeBlockBuffer<std::complex<float>> &buffer, float *metaBuffer,
     symbol_t *symbolBuffer, size_t antennaCount, std::mt19937 *rnd);
-template void AFTimeBlockEncoder::encode<false>(
+template void AFTimeBlockEncoder::encode<true, dyscostman::Philox4x32>(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const TimeBlockBuffer<std::complex<float>> &buffer, float *metaBuffer,
+    symbol_t *symbolBuffer, size_t antennaCount, dyscostman::Philox4x32 *rnd);
+template void AFTimeBlockEncoder::encode<true, dyscostman::Xoshiro256x4>(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const TimeBlockBuffer<std::complex<float>> &buffer, float *metaBuffer,
+    symbol_t *symbolBuffer, size_t antennaCount, dyscostman::Xoshiro256x4 *rnd);
+template void AFTimeBlockEncoder::encode<false, std::mt19937>(
     const dyscostman::StochasticEncoder<float> &gausEncoder,
     const TimeBlockBuffer<std::complex<float>> &buffer, float *metaBuffer,
     symbol_t *symbolBuffer, size_t antennaCount, std::mt19937 *rnd);
 
 void AFTimeBlockEncoder::calculateAntennaeRMS(
-    const std::vector<DBufferRow> &data, size_t polIndex, size_t antennaCount) {
-  std::vector<RMSMeasurement> matrixMeas(antennaCount * antennaCount);
-  for (const DBufferRow &row : data) {
-    size_t a1 = row.antenna1, a2 = row.antenna2;
+    const FBuffer &data, size_t polIndex, size_t antennaCount) {
+  const size_t matrixSize = antennaCount * antennaCount;
+  _antennaMeasurements.assign(matrixSize, RMSMeasurement());
+  for (size_t rowIndex = 0; rowIndex != data.NRows(); ++rowIndex) {
+    size_t a1 = data.Antenna1(rowIndex), a2 = data.Antenna2(rowIndex);
     if (a1 != a2) {
       if (a1 > a2) std::swap(a1, a2);
       const size_t index = a1 * antennaCount + a2;
       for (size_t ch = 0; ch != _nChannels; ++ch)
-        matrixMeas[index].Include(row.visibilities[ch * _nPol + polIndex]);
+        _antennaMeasurements[index].Include(
+            normalizedValue(data, rowIndex, ch * _nPol + polIndex, polIndex));
     }
   }
 
-  aocommon::UVector<double> matrix(matrixMeas.size());
+  // Baselines without a finite RMS get a value and weight of zero, so that the
+  // iterations below do not need to test for them.
+  _antennaMatrix.resize(matrixSize);
+  _antennaMatrixWeights.resize(matrixSize);
+  _nextAntennaRMS.resize(antennaCount);
+  _antennaWeightSums.resize(antennaCount);
   for (size_t i = 0; i != antennaCount; ++i) {
     for (size_t j = i; j != antennaCount; ++j) {
-      matrix[i * antennaCount + j] = matrixMeas[i * antennaCount + j].RMS();
-      matrix[j * antennaCount + i] = matrixMeas[i * antennaCount + j].RMS();
+      const double rms = _antennaMeasurements[i * antennaCount + j].RMS();
+      const bool isValid = i != j && std::isfinite(rms);
+      _antennaMatrix[i * antennaCount + j] = isValid ? rms : 0.0;
+      _antennaMatrix[j * antennaCount + i] = isValid ? rms : 0.0;
+      _antennaMatrixWeights[i * antennaCount + j] = isValid ? 1.0 : 0.0;
+      _antennaMatrixWeights[j * antennaCount + i] = isValid ? 1.0 : 0.0;
     }
   }
 
+  // Start from the solution for the ideal case matrix[i, j] = rms[i] * rms[j],
+  // in which the sum of row i is about rms[i] times the sum of all rms
+  // values, and the total sum is about the square of that sum.
+  double total = 0.0;
+  for (size_t i = 0; i != antennaCount; ++i) {
+    double rowSum = 0.0;
+    for (size_t j = 0; j != antennaCount; ++j)
+      rowSum += _antennaMatrix[i * antennaCount + j];
+    _nextAntennaRMS[i] = rowSum;
+    total += rowSum;
+  }
+  const bool hasStart = total > 0.0 && std::isfinite(total);
   // (note that _rmsPerAntenna is larger, so don't use assign())
-  for (size_t i = 0; i != antennaCount; ++i) _rmsPerAntenna[i] = 1.0;
+  for (size_t i = 0; i != antennaCount; ++i)
+    _rmsPerAntenna[i] = hasStart ? _nextAntennaRMS[i] / std::sqrt(total) : 1.0;
 
   double precision = 1.0;
-  for (size_t iteration = 0; iteration != 100 && precision > 1e-6;
-       ++iteration) {
-    aocommon::UVector<double> nextRMS(antennaCount, 0.0);
+  size_t iteration = 0;
+  for (; iteration != 100 && precision > 1e-6; ++iteration) {
+    double valueTotal = 0.0, modelTotal = 0.0;
     for (size_t i = 0; i != antennaCount; ++i) {
-      double weightSum = 0.0;
+      const double *values = &_antennaMatrix[i * antennaCount];
+      const double *weights = &_antennaMatrixWeights[i * antennaCount];
+      double valueSum = 0.0, weightSum = 0.0;
       for (size_t j = 0; j != antennaCount; ++j) {
-        if (i != j && _rmsPerAntenna[j] != 0.0) {
-          double w = _rmsPerAntenna[j];
-          if (std::isfinite(matrix[i * antennaCount + j])) {
-            // matrix / estVec, but since we weight, just:
-            nextRMS[i] += matrix[i * antennaCount + j];
-            weightSum += w;
-          }
-        }
+        // matrix / estVec, but since we weight, just:
+        valueSum += values[j] * double(_rmsPerAntenna[j] != 0.0);
+        weightSum += weights[j] * _rmsPerAntenna[j];
+      }
+      _nextAntennaRMS[i] = valueSum;
+      _antennaWeightSums[i] = weightSum;
+      if (_rmsPerAntenna[i] != 0.0) {
+        valueTotal += valueSum;
+        modelTotal += _rmsPerAntenna[i] * weightSum;
       }
+    }
+    // The iteration converges slowly in the overall scale of the solution,
+    // while that scale can be solved directly: the current solution is scaled
+    // such that the sum of rms[i] * rms[j] equals the sum of the matrix.
+    const double scale = (valueTotal > 0.0 && modelTotal > 0.0)
+                             ? std::sqrt(valueTotal / modelTotal)
+                             : 1.0;
+    for (size_t i = 0; i != antennaCount; ++i) {
+      _rmsPerAntenna[i] *= scale;
+      const double weightSum = _antennaWeightSums[i] * scale;
       if (weightSum == 0.0)
-        nextRMS[i] = 0.0;
+        _nextAntennaRMS[i] = 0.0;
       else
-        nextRMS[i] /= weightSum;
+        _nextAntennaRMS[i] /= weightSum;
     }
 
     double maxVal = 0.0;
     for (size_t i = 0; i != antennaCount; ++i) {
-      _rmsPerAntenna[i] = nextRMS[i] * 0.8 + _rmsPerAntenna[i] * 0.2;
+      _rmsPerAntenna[i] = _nextAntennaRMS[i] * 0.8 + _rmsPerAntenna[i] * 0.2;
       maxVal = std::max(_rmsPerAntenna[i], maxVal);
     }
     precision = 0.0;
     for (size_t i = 0; i != antennaCount; ++i) {
       if (_rmsPerAntenna[i] < maxVal * 1e-5) _rmsPerAntenna[i] = 0.0;
-      precision = std::max(precision,
-                           std::fabs(_rmsPerAntenna[i] - nextRMS[i]) / maxVal);
+      precision = std::max(
+          precision, std::fabs(_rmsPerAntenna[i] - _nextAntennaRMS[i]) / maxVal);
     }
   }
+  _antennaRMSIterationCount += iteration;
 }
 
 void AFTimeBlockEncoder::InitializeDecode(const float *metaBuffer,
@@ -410,29 +525,64 @@ void AFTimeBlockEncoder::InitializeDecode(const float *metaBuffer,
   }
 }
 
-void AFTimeBlockEncoder::Decode(
-    const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
-    const AFTimeBlockEncoder::symbol_t *symbolBuffer, size_t blockRow,
-    size_t antenna1, size_t antenna2) {
+void AFTimeBlockEncoder::decodeRow(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const AFTimeBlockEncoder::symbol_t *symbols, size_t /*blockRow*/,
+    size_t antenna1, size_t antenna2, std::complex<float> *destination) {
   aocommon::UVector<double> antFactors(_nPol);
   for (size_t p = 0; p != _nPol; ++p)
     antFactors[p] = _rmsPerAntenna[antenna1 * _nPol + p] *
                     _rmsPerAntenna[antenna2 * _nPol + p];
 
-  FBufferRow &row = buffer[blockRow];
-  row.antenna1 = antenna1;
-  row.antenna2 = antenna2;
-  row.visibilities.resize(_nChannels * _nPol);
-  std::complex<float> *destination = row.visibilities.data();
-  const symbol_t *srcRowPtr = symbolBuffer + blockRow * SymbolsPerRow();
+  _decodeFactors.resize(_nChannels * _nPol);
   for (size_t ch = 0; ch != _nChannels; ++ch) {
     for (size_t p = 0; p != _nPol; ++p) {
       double chRMS = _rmsPerChannel[ch * _nPol + p];
-      double factor = chRMS * antFactors[p];
-      destination->real(double(gausEncoder.Decode(*srcRowPtr)) * factor);
-      ++srcRowPtr;
-      destination->imag(double(gausEncoder.Decode(*srcRowPtr)) * factor);
-      ++srcRowPtr;
+      _decodeFactors[ch * _nPol + p] = chRMS * antFactors[p];
+    }
+  }
+  gausEncoder.DecodeComplexBatch(symbols, _decodeFactors.data(),
+                                 _nChannels * _nPol, destination);
+}
+
+void AFTimeBlockEncoder::DecodeRow(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const AFTimeBlockEncoder::symbol_t *symbolBuffer, size_t blockRow,
+    size_t antenna1, size_t antenna2, std::complex<float> *destination) {
+  decodeRow(gausEncoder, symbolBuffer + blockRow * SymbolsPerRow(), blockRow,
+            antenna1, antenna2, destination);
+}
+
+void AFTimeBlockEncoder::DecodeRowPacked(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const unsigned char *packedSymbols, unsigned bitCount, size_t blockRow,
+    size_t antenna1, size_t antenna2, std::complex<float> *destination) {
+  _rowSymbols.resize(SymbolsPerRow());
+  dyscostman::BytePacker::readSymbols(
+      bitCount, packedSymbols, blockRow * SymbolsPerRow(),
+      [&](auto readSymbol) {
+        for (symbol_t &symbol : _rowSymbols) symbol = readSymbol();
+      });
+  decodeRow(gausEncoder, _rowSymbols.data(), blockRow, antenna1, antenna2,
+            destination);
+}
+
+void AFTimeBlockEncoder::DecodeRowSlice(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const AFTimeBlockEncoder::symbol_t *symbolBuffer, size_t blockRow,
+    size_t antenna1, size_t antenna2, const RowSlice &slice,
+    std::complex<float> *destination) {
+  const symbol_t *srcRowPtr = symbolBuffer + blockRow * SymbolsPerRow();
+  for (size_t c = 0; c != slice.channelCount; ++c) {
+    const size_t ch = slice.channelStart + c * slice.channelStride;
+    for (size_t i = 0; i != slice.polarizationCount; ++i) {
+      const size_t p = slice.polarizationStart + i * slice.polarizationStride;
+      double factor = _rmsPerChannel[ch * _nPol + p] *
+                      _rmsPerAntenna[antenna1 * _nPol + p] *
+                      _rmsPerAntenna[antenna2 * _nPol + p];
+      const symbol_t *srcPtr = srcRowPtr + (ch * _nPol + p) * 2;
+      destination->real(double(gausEncoder.Decode(srcPtr[0])) * factor);
+      destination->imag(double(gausEncoder.Decode(srcPtr[1])) * factor);
       ++destination;
     }
   }
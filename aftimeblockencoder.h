@@ -25,21 +25,49 @@ class AFTimeBlockEncoder : public TimeBlockEncoder {
                  &rnd);
   }
 
+  virtual void EncodeWithDithering(
+      const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
+      float *metaBuffer, symbol_t *symbolBuffer, size_t antennaCount,
+      dyscostman::Philox4x32 &rnd) final override {
+    encode<true>(gausEncoder, buffer, metaBuffer, symbolBuffer, antennaCount,
+                 &rnd);
+  }
+
+  virtual void EncodeWithDithering(
+      const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
+      float *metaBuffer, symbol_t *symbolBuffer, size_t antennaCount,
+      dyscostman::Xoshiro256x4 &rnd) final override {
+    encode<true>(gausEncoder, buffer, metaBuffer, symbolBuffer, antennaCount,
+                 &rnd);
+  }
+
   virtual void EncodeWithoutDithering(
       const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
       float *metaBuffer, symbol_t *symbolBuffer,
       size_t antennaCount) final override {
-    encode<false>(gausEncoder, buffer, metaBuffer, symbolBuffer, antennaCount,
-                  0);
+    encode<false, std::mt19937>(gausEncoder, buffer, metaBuffer, symbolBuffer,
+                                antennaCount, nullptr);
   }
 
   virtual void InitializeDecode(const float *metaBuffer, size_t nRow,
                                 size_t nAntennae) final override;
 
-  virtual void Decode(const dyscostman::StochasticEncoder<float> &gausEncoder,
-                      FBuffer &buffer, const symbol_t *symbolBuffer,
-                      size_t blockRow, size_t antenna1,
-                      size_t antenna2) final override;
+  virtual void DecodeRow(
+      const dyscostman::StochasticEncoder<float> &gausEncoder,
+      const symbol_t *symbolBuffer, size_t blockRow, size_t antenna1,
+      size_t antenna2, std::complex<float> *destination) final override;
+
+  virtual void DecodeRowPacked(
+      const dyscostman::StochasticEncoder<float> &gausEncoder,
+      const unsigned char *packedSymbols, unsigned bitCount, size_t blockRow,
+      size_t antenna1, size_t antenna2,
+      std::complex<float> *destination) final override;
+
+  virtual void DecodeRowSlice(
+      const dyscostman::StochasticEncoder<float> &gausEncoder,
+      const symbol_t *symbolBuffer, size_t blockRow, size_t antenna1,
+      size_t antenna2, const RowSlice &slice,
+      std::complex<float> *destination) final override;
 
   virtual size_t SymbolCount(size_t nRow, size_t nPol,
                              size_t nChannels) const final override {
@@ -59,32 +87,113 @@ class AFTimeBlockEncoder : public TimeBlockEncoder {
     return nPol * (nChannels + nAntennae);
   }
 
+  /**
+   * Number of iterations that were needed to solve the antenna RMS values of
+   * the last encoded block, summed over the polarizations.
+   */
+  size_t AntennaRMSIterationCount() const { return _antennaRMSIterationCount; }
+
+  /**
+   * Number of iterations of the greedy fit to the maximum level for the last
+   * encoded block, summed over the polarizations. The fit of a polarization
+   * takes at most nChannels + nAntennae + 1 iterations.
+   */
+  size_t FitIterationCount() const { return _fitIterationCount; }
+
   // (Function is currently unused)
   void Normalize(const dyscostman::StochasticEncoder<float> &gausEncoder,
                  TimeBlockBuffer<std::complex<float>> &buffer,
                  size_t antennaCount);
 
  private:
-  void calculateAntennaeRMS(const std::vector<DBufferRow> &data,
-                            size_t polIndex, size_t antennaCount);
+  /**
+   * Decode one row from its symbols.
+   */
+  void decodeRow(const dyscostman::StochasticEncoder<float> &gausEncoder,
+                 const symbol_t *symbols, size_t blockRow, size_t antenna1,
+                 size_t antenna2, std::complex<float> *destination);
+
+  /**
+   * Value of a visibility, normalized with the current normalization factors.
+   * @param polIndex The polarization of the value, i.e. visIndex modulo the
+   * number of polarizations.
+   */
+  std::complex<double> normalizedValue(const FBuffer &data, size_t rowIndex,
+                                       size_t visIndex, size_t polIndex) const {
+    return std::complex<double>(data.Row(rowIndex)[visIndex]) *
+           _encodeRowFactors[rowIndex * _nPol + polIndex] *
+           _encodeVisFactors[visIndex];
+  }
+
+  /**
+   * Calculate the RMS of every antenna for the values of one polarization,
+   * normalized with the current normalization factors.
+   */
+  void calculateAntennaeRMS(const FBuffer &data, size_t polIndex,
+                            size_t antennaCount);
+
+  /**
+   * Set the row factors of one polarization such that the calculated antenna
+   * RMS values are normalized.
+   */
+  void setAntennaRowFactors(const FBuffer &data, size_t polIndex);
 
-  template <bool UseDithering>
+  template <bool UseDithering, typename RandomGenerator>
   void encode(const dyscostman::StochasticEncoder<float> &gausEncoder,
               const FBuffer &buffer, float *metaBuffer, symbol_t *symbolBuffer,
-              size_t antennaCount, std::mt19937 *rnd);
+              size_t antennaCount, RandomGenerator *rnd);
 
-  void changeAntennaFactor(std::vector<DBufferRow> &data, float *metaBuffer,
+  void changeChannelFactor(float *metaBuffer, size_t visIndex, double factor);
+
+  /**
+   * Scale the cross-correlation rows of an antenna. Requires the rows that are
+   * listed by fitToMaximum().
+   */
+  void changeAntennaFactor(const FBuffer &data, float *metaBuffer,
                            size_t antennaIndex, size_t antennaCount,
                            size_t polIndex, double factor);
 
-  void fitToMaximum(std::vector<DBufferRow> &data, float *metaBuffer,
-                    double max_level, size_t antennaCount);
+  void fitToMaximum(const FBuffer &data, float *metaBuffer, double max_level,
+                    size_t antennaCount);
+
+  /**
+   * Greedily scale the antennas and channels of one polarization to increase
+   * the sum of absolute values.
+   * @returns The number of iterations that were used.
+   */
+  size_t fitPolarizationToMaximum(const FBuffer &data, float *metaBuffer,
+                                  double max_level, size_t antennaCount,
+                                  size_t polIndex);
 
   size_t _nPol, _nChannels;
   bool _fitToMaximum;
 
   aocommon::UVector<double> _rmsPerChannel, _rmsPerAntenna;
-  std::uniform_int_distribution<unsigned> _ditherDist;
+
+  /**
+   * Scratch buffers of the decoding: the factor of every value of a row, and
+   * the unpacked symbols of a row in DecodeRowPacked().
+   */
+  aocommon::UVector<double> _decodeFactors;
+  aocommon::UVector<symbol_t> _rowSymbols;
+
+  /**
+   * Scratch buffers of calculateAntennaeRMS(). These are members so that their
+   * storage is reused by subsequent blocks.
+   */
+  std::vector<RMSMeasurement> _antennaMeasurements;
+  aocommon::UVector<double> _antennaMatrix, _antennaMatrixWeights,
+      _nextAntennaRMS, _antennaWeightSums;
+  size_t _antennaRMSIterationCount;
+
+  /**
+   * The rows of every antenna, used by fitToMaximum(): the rows of antenna a
+   * are _antennaRows[_antennaRowOffsets[a]] up to
+   * _antennaRows[_antennaRowOffsets[a + 1]]. The auto-correlations are
+   * included, because changeAntennaFactor() scales them too.
+   */
+  aocommon::UVector<size_t> _antennaRowOffsets, _antennaRows;
+  size_t _fitIterationCount;
 };
 
 #endif
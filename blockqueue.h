@@ -0,0 +1,220 @@
+#ifndef DYSCO_BLOCK_QUEUE_H
+#define DYSCO_BLOCK_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+namespace dyscostman {
+
+/**
+ * Bounded multi-producer multi-consumer ring of block slots, used as the write
+ * cache between the thread that stores blocks and the encoding threads.
+ *
+ * Every slot carries a sequence number (as in Vyukov's bounded MPMC queue) and
+ * a state flag. The slot of position p is free for the producer of p when its
+ * sequence number is 2p and holds the item of p when it is 2p + 1. Unlike
+ * sequence numbers p and p + 1, these can not be confused when the capacity
+ * is one. Producers and consumers claim a position with a single atomic
+ * increment and afterwards only look at the slot that belongs to that
+ * position, so a hand-off never takes a global lock. A thread only sleeps when
+ * its own slot is not ready, and it then waits on the condition variable of
+ * that slot, so a finished block wakes up only the threads that are interested
+ * in that particular slot.
+ *
+ * A slot stays occupied until the consumer calls Release(), i.e. until the
+ * block is encoded and written. This allows readers to wait for a block that
+ * is still being written with WaitWhileQueued().
+ */
+template <typename T>
+class BlockQueue {
+ public:
+  enum class SlotState { kEmpty, kQueued, kProcessing };
+
+  struct Slot {
+    /** Block index of the item in this slot. */
+    size_t blockIndex;
+    /** The item. Is only valid between Acquire() and Release(). */
+    std::unique_ptr<T> item;
+
+   private:
+    friend class BlockQueue;
+    std::atomic<size_t> _sequence;
+    std::atomic<SlotState> _state;
+    size_t _position;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+  };
+
+  explicit BlockQueue(size_t capacity = 0) { Reset(capacity); }
+
+  BlockQueue(const BlockQueue &) = delete;
+  BlockQueue &operator=(const BlockQueue &) = delete;
+
+  /**
+   * Reinitialize the queue with the given capacity. Items in the queue are
+   * discarded. May only be called when no other thread uses the queue.
+   */
+  void Reset(size_t capacity) {
+    if (capacity != _capacity) {
+      _slots.reset(capacity == 0 ? nullptr : new Slot[capacity]);
+      _capacity = capacity;
+    }
+    for (size_t i = 0; i != _capacity; ++i) {
+      _slots[i].blockIndex = 0;
+      _slots[i].item.reset();
+      _slots[i]._sequence.store(i * 2, std::memory_order_relaxed);
+      _slots[i]._state.store(SlotState::kEmpty, std::memory_order_relaxed);
+    }
+    _pushPosition.store(0, std::memory_order_relaxed);
+    _popPosition.store(0, std::memory_order_relaxed);
+    _isStopped.store(false, std::memory_order_release);
+  }
+
+  size_t Capacity() const { return _capacity; }
+
+  /**
+   * Add an item to the queue. Blocks until the slot for the next position is
+   * free or until Stop() is called.
+   * @returns false when the queue was stopped while waiting for the slot, in
+   * which case the item is discarded. When the slot is free, the item is
+   * added even after Stop(), so that it can still be acquired.
+   */
+  bool Push(size_t blockIndex, std::unique_ptr<T> item) {
+    const size_t position =
+        _pushPosition.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = _slots[position % _capacity];
+    const bool isFree = waitFor(slot, [&]() {
+      return slot._sequence.load(std::memory_order_acquire) == position * 2;
+    });
+    if (!isFree) return false;
+    slot.blockIndex = blockIndex;
+    slot.item = std::move(item);
+    slot._position = position;
+    update(slot, SlotState::kQueued, position * 2 + 1);
+    return true;
+  }
+
+  /**
+   * Take the next item from the queue. Blocks until an item is available or
+   * until Stop() is called.
+   * @returns The slot containing the item, or nullptr when the queue was
+   * stopped.
+   */
+  Slot *Acquire() {
+    const size_t position =
+        _popPosition.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = _slots[position % _capacity];
+    const bool isAvailable = waitFor(slot, [&]() {
+      return slot._sequence.load(std::memory_order_acquire) ==
+             position * 2 + 1;
+    });
+    if (!isAvailable) return nullptr;
+    slot._state.store(SlotState::kProcessing, std::memory_order_release);
+    return &slot;
+  }
+
+  /**
+   * Free a slot that was returned by Acquire(), after which the slot can be
+   * reused by a producer.
+   */
+  void Release(Slot *slot) {
+    slot->item.reset();
+    update(*slot, SlotState::kEmpty, (slot->_position + _capacity) * 2);
+  }
+
+  /** Whether the given block is queued or being processed. */
+  bool Contains(size_t blockIndex) const {
+    for (size_t i = 0; i != _capacity; ++i) {
+      if (isOccupiedBy(_slots[i], blockIndex)) return true;
+    }
+    return false;
+  }
+
+  /**
+   * Block until the given block is neither queued nor being processed.
+   */
+  void WaitWhileQueued(size_t blockIndex) {
+    for (size_t i = 0; i != _capacity; ++i) {
+      Slot &slot = _slots[i];
+      waitFor(slot, [&]() { return !isOccupiedBy(slot, blockIndex); });
+    }
+  }
+
+  /** Block until all items in the queue have been released. */
+  void WaitUntilEmpty() {
+    for (size_t i = 0; i != _capacity; ++i) {
+      Slot &slot = _slots[i];
+      waitFor(slot, [&]() {
+        return slot._state.load(std::memory_order_acquire) ==
+               SlotState::kEmpty;
+      });
+    }
+  }
+
+  bool Empty() const {
+    for (size_t i = 0; i != _capacity; ++i) {
+      if (_slots[i]._state.load(std::memory_order_acquire) !=
+          SlotState::kEmpty)
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * Wake up all waiting threads. Acquire() then returns nullptr when no item
+   * is available, and Push() returns false when its slot is not free. Call
+   * Reset() before using the queue again.
+   */
+  void Stop() {
+    _isStopped.store(true, std::memory_order_release);
+    for (size_t i = 0; i != _capacity; ++i) {
+      Slot &slot = _slots[i];
+      { std::lock_guard<std::mutex> lock(slot._mutex); }
+      slot._condition.notify_all();
+    }
+  }
+
+ private:
+  static bool isOccupiedBy(const Slot &slot, size_t blockIndex) {
+    return slot._state.load(std::memory_order_acquire) != SlotState::kEmpty &&
+           slot.blockIndex == blockIndex;
+  }
+
+  /**
+   * Wait until the condition is met. The condition is first tested without
+   * taking the slot mutex. Returns false if the queue was stopped before the
+   * condition was met.
+   */
+  template <typename Condition>
+  bool waitFor(Slot &slot, Condition condition) {
+    if (condition()) return true;
+    std::unique_lock<std::mutex> lock(slot._mutex);
+    while (!condition()) {
+      if (_isStopped.load(std::memory_order_acquire)) return false;
+      slot._condition.wait(lock);
+    }
+    return true;
+  }
+
+  static void update(Slot &slot, SlotState state, size_t sequence) {
+    {
+      std::lock_guard<std::mutex> lock(slot._mutex);
+      slot._state.store(state, std::memory_order_release);
+      slot._sequence.store(sequence, std::memory_order_release);
+    }
+    slot._condition.notify_all();
+  }
+
+  size_t _capacity = 0;
+  std::unique_ptr<Slot[]> _slots;
+  std::atomic<size_t> _pushPosition;
+  std::atomic<size_t> _popPosition;
+  std::atomic<bool> _isStopped;
+};
+
+}  // namespace dyscostman
+
+#endif
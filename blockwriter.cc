@@ -0,0 +1,141 @@
+#include "blockwriter.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace dyscostman {
+
+BlockWriter::BlockWriter(WriteFunction writeFunction, size_t maxBacklogSize)
+    : _writeFunction(std::move(writeFunction)),
+      _maxBacklogSize(maxBacklogSize),
+      _backlogSize(0),
+      _writingBegin(0),
+      _writingEnd(0),
+      _isErrorReported(false),
+      _isStopped(false),
+      _thread([this]() { run(); }) {}
+
+BlockWriter::~BlockWriter() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _isStopped = true;
+  }
+  _pendingCondition.notify_all();
+  _thread.join();
+  if (_error && !_isErrorReported) {
+    try {
+      std::rethrow_exception(_error);
+    } catch (std::exception &e) {
+      std::cerr << "Error while writing DyscoStMan data: " << e.what() << '\n';
+    }
+  }
+}
+
+void BlockWriter::Write(uint64_t offset, const unsigned char *data,
+                        size_t size) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (!_error && _backlogSize != 0 &&
+         _backlogSize + size > _maxBacklogSize) {
+    _writtenCondition.wait(lock);
+  }
+  // After an error the data can no longer be written consistently. The error
+  // is reported by every WaitWhilePending() or Flush().
+  if (_error) return;
+  aocommon::UVector<unsigned char> &chunk = _pending[offset];
+  if (chunk.empty() && !_freeChunks.empty()) {
+    chunk = std::move(_freeChunks.back());
+    _freeChunks.pop_back();
+  } else {
+    // Replaces data that was not yet written
+    _backlogSize -= chunk.size();
+  }
+  _backlogSize += size;
+  chunk.assign(data, data + size);
+  lock.unlock();
+  _pendingCondition.notify_one();
+}
+
+void BlockWriter::WaitWhilePending(uint64_t offset, size_t size) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (isPending(offset, offset + size) && !_error)
+    _writtenCondition.wait(lock);
+  throwIfFailed();
+}
+
+void BlockWriter::Flush() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (_backlogSize != 0 && !_error) _writtenCondition.wait(lock);
+  throwIfFailed();
+}
+
+bool BlockWriter::isPending(uint64_t begin, uint64_t end) const {
+  if (begin < _writingEnd && _writingBegin < end) return true;
+  // The first chunk that might overlap is the last one that starts before the
+  // end of the range
+  auto iter = _pending.lower_bound(end);
+  if (iter == _pending.begin()) return false;
+  --iter;
+  return iter->first + iter->second.size() > begin;
+}
+
+void BlockWriter::throwIfFailed() {
+  if (_error) {
+    _isErrorReported = true;
+    std::rethrow_exception(_error);
+  }
+}
+
+void BlockWriter::run() {
+  std::vector<aocommon::UVector<unsigned char>> run;
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    while (_pending.empty() && !_isStopped) _pendingCondition.wait(lock);
+    if (_pending.empty()) return;
+
+    // Take the first sequence of adjacent chunks
+    auto iter = _pending.begin();
+    _writingBegin = iter->first;
+    _writingEnd = _writingBegin;
+    while (iter != _pending.end() && iter->first == _writingEnd) {
+      _writingEnd += iter->second.size();
+      run.emplace_back(std::move(iter->second));
+      iter = _pending.erase(iter);
+    }
+    lock.unlock();
+
+    std::exception_ptr error;
+    try {
+      if (run.size() == 1) {
+        _writeFunction(_writingBegin, run.front().data(), run.front().size());
+      } else {
+        _writeBuffer.resize(_writingEnd - _writingBegin);
+        unsigned char *position = _writeBuffer.data();
+        for (const aocommon::UVector<unsigned char> &chunk : run)
+          position = std::copy(chunk.begin(), chunk.end(), position);
+        _writeFunction(_writingBegin, _writeBuffer.data(),
+                       _writeBuffer.size());
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    _backlogSize -= _writingEnd - _writingBegin;
+    _writingBegin = _writingEnd = 0;
+    for (aocommon::UVector<unsigned char> &chunk : run)
+      _freeChunks.emplace_back(std::move(chunk));
+    run.clear();
+    if (error) {
+      // The remaining data can no longer be written consistently
+      _error = error;
+      for (auto &chunk : _pending) {
+        _backlogSize -= chunk.second.size();
+        _freeChunks.emplace_back(std::move(chunk.second));
+      }
+      _pending.clear();
+    }
+    _writtenCondition.notify_all();
+  }
+}
+
+}  // namespace dyscostman
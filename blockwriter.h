@@ -0,0 +1,108 @@
+#ifndef DYSCO_BLOCK_WRITER_H
+#define DYSCO_BLOCK_WRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "uvector.h"
+
+namespace dyscostman {
+
+/**
+ * Write-behind stage that performs the file writes of a storage manager on a
+ * dedicated thread. Write() copies the data into the backlog and returns
+ * immediately, so that encoding threads don't wait for the disk. The I/O
+ * thread writes the backlog in order of file offset and combines chunks that
+ * are adjacent in the file, such as the columns of a block and consecutive
+ * blocks, into a single sequential write.
+ *
+ * Write() only blocks when the backlog is larger than the maximum backlog
+ * size. Write() is called from encoding jobs, which can not handle errors, so
+ * it never throws. After an error in the I/O thread, queued and new data is
+ * dropped, and the error is rethrown by every later call to WaitWhilePending()
+ * or Flush(), so that the file is never silently left with holes.
+ */
+class BlockWriter {
+ public:
+  /**
+   * Function that writes data to the file at the given offset. It is called
+   * from the I/O thread.
+   */
+  typedef std::function<void(uint64_t offset, const unsigned char *data,
+                             size_t size)>
+      WriteFunction;
+
+  /**
+   * Construct the writer and start the I/O thread.
+   * @param writeFunction Function that performs the actual writes.
+   * @param maxBacklogSize Number of bytes that may be pending before Write()
+   * blocks. A single write that is larger is accepted when the backlog is
+   * empty.
+   */
+  BlockWriter(WriteFunction writeFunction, size_t maxBacklogSize);
+
+  BlockWriter(const BlockWriter &) = delete;
+  BlockWriter &operator=(const BlockWriter &) = delete;
+
+  /**
+   * Writes the backlog and stops the I/O thread. An error that was never
+   * rethrown is printed.
+   */
+  ~BlockWriter();
+
+  /**
+   * Queue data to be written at the given file offset. Data that is queued for
+   * the same offset and is not yet written is replaced. The data is dropped
+   * when an earlier write failed.
+   */
+  void Write(uint64_t offset, const unsigned char *data, size_t size);
+
+  /**
+   * Wait until no data is pending for the range [offset, offset+size), such
+   * that the range can be read from the file.
+   */
+  void WaitWhilePending(uint64_t offset, size_t size);
+
+  /** Wait until all queued data has been written. */
+  void Flush();
+
+ private:
+  void run();
+  bool isPending(uint64_t begin, uint64_t end) const;
+  void throwIfFailed();
+
+  WriteFunction _writeFunction;
+  const size_t _maxBacklogSize;
+
+  std::mutex _mutex;
+  /** Notifies the I/O thread of new data or of stopping. */
+  std::condition_variable _pendingCondition;
+  /** Notifies waiting callers that data has been written. */
+  std::condition_variable _writtenCondition;
+  /** Chunks that are waiting to be written, ordered by file offset. */
+  std::map<uint64_t, aocommon::UVector<unsigned char>> _pending;
+  /** Buffers of written chunks, reused for new chunks. */
+  std::vector<aocommon::UVector<unsigned char>> _freeChunks;
+  /** Number of bytes that are pending or being written. */
+  size_t _backlogSize;
+  /** File range that the I/O thread is writing, empty if idle. */
+  uint64_t _writingBegin, _writingEnd;
+  /** The first write error. It is kept until the writer is destructed. */
+  std::exception_ptr _error;
+  bool _isErrorReported;
+  bool _isStopped;
+
+  /** Buffer into which the I/O thread combines adjacent chunks. */
+  aocommon::UVector<unsigned char> _writeBuffer;
+  std::thread _thread;
+};
+
+}  // namespace dyscostman
+
+#endif
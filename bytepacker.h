@@ -1,11 +1,56 @@
 #ifndef DYSCO_BYTE_PACKER_H
 #define DYSCO_BYTE_PACKER_H
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <numeric>
 #include <stdexcept>
 
+#include "cpufeatures.h"
+
 namespace dyscostman {
 
+/**
+ * Reads the symbols of a packed array one at a time, so that they can be used
+ * directly without unpacking them into a symbol buffer first. The bit count is
+ * a template parameter, such that the reading of a symbol compiles into a few
+ * shifts. Only the bytes that contain the symbols that are read are accessed.
+ */
+template <unsigned BitCount>
+class PackedSymbolReader {
+ public:
+  /**
+   * @param packedBuffer the buffer with the packed symbols
+   * @param symbolOffset index of the first symbol to read
+   */
+  PackedSymbolReader(const unsigned char *packedBuffer, size_t symbolOffset)
+      : _packedBuffer(packedBuffer + symbolOffset * BitCount / 8) {
+    const unsigned skippedBits = (symbolOffset * BitCount) % 8;
+    _bits = *_packedBuffer >> skippedBits;
+    ++_packedBuffer;
+    _bitCount = 8 - skippedBits;
+  }
+
+  /** Returns the next symbol. */
+  unsigned operator()() {
+    while (_bitCount < BitCount) {
+      _bits |= uint32_t(*_packedBuffer) << _bitCount;
+      ++_packedBuffer;
+      _bitCount += 8;
+    }
+    const unsigned symbol = _bits & ((1u << BitCount) - 1);
+    _bits >>= BitCount;
+    _bitCount -= BitCount;
+    return symbol;
+  }
+
+ private:
+  const unsigned char *_packedBuffer;
+  uint32_t _bits;
+  unsigned _bitCount;
+};
+
 /**
  * Class for bit packing of values into bytes.
  *
@@ -17,11 +62,16 @@ namespace dyscostman {
  * ceil(symbolCount / bitCount).
  *
  * The @ref pack() and @ref unpack() methods can call the method with given
- * bitcount at runtime. If the bitcount is known at compile time, one of the
- * other methods can be used. For each of these calls, the input symbols are
- * assumed to occupy at most the given number of bits. The number of bytes
- * written during pack operations is ceil(symbolCount * bitCount / 8).
- * unpack operations will write symbolCount symbols into the output buffer.
+ * bitcount at runtime, which can be any value from 1 to 16. If the bitcount is
+ * known at compile time, one of the other methods can be used. For each of
+ * these calls, the input symbols are assumed to occupy at most the given
+ * number of bits. The number of bytes written during pack operations is
+ * ceil(symbolCount * bitCount / 8). unpack operations will write symbolCount
+ * symbols into the output buffer.
+ *
+ * When the CPU supports AVX2, the functions process groups of eight symbols
+ * with vector instructions. Such a group occupies bitCount bytes, so the
+ * packed layout is the same as that of the scalar code.
  */
 class BytePacker {
  public:
@@ -48,6 +98,21 @@ class BytePacker {
   static void unpack(unsigned bitCount, unsigned *symbolBuffer,
                      unsigned char *packedBuffer, size_t symbolCount);
 
+  /**
+   * Unpack a range of symbols from a packed array, without unpacking the
+   * symbols before it. The unpacking starts at a byte boundary, so a few
+   * symbols before @p symbolOffset may also be written.
+   * @param bitCount the number of bits used per symbol
+   * @param symbolBuffer output buffer for all symbols of the packed array; the
+   * unpacked symbols are written at their index in the packed array.
+   * @param packedBuffer the input buffer with the packed symbols
+   * @param symbolOffset index of the first symbol to unpack
+   * @param symbolCount number of symbols to unpack
+   */
+  static void unpackRange(unsigned bitCount, unsigned *symbolBuffer,
+                          unsigned char *packedBuffer, size_t symbolOffset,
+                          size_t symbolCount);
+
   /**
    * Pack the symbols from symbolBuffer into the destination array using
    * bitCount=2.
@@ -145,15 +210,82 @@ class BytePacker {
   static void unpack16(unsigned *symbolBuffer, unsigned char *packedBuffer,
                        size_t symbolCount);
 
+  /**
+   * Pack the symbols from symbolBuffer into the destination array using
+   * the given bit count, which may be any value from 1 to 16. This is used for
+   * the bit counts that have no specific function.
+   */
+  template <unsigned BitCount>
+  static void packGeneric(unsigned char *dest, const unsigned *symbolBuffer,
+                          size_t symbolCount);
+  /**
+   * Reverse of packGeneric(). Will write symbolCount items into the
+   * symbolBuffer.
+   */
+  template <unsigned BitCount>
+  static void unpackGeneric(unsigned *symbolBuffer, unsigned char *packedBuffer,
+                            size_t symbolCount);
+
+  /**
+   * Call @p function with a PackedSymbolReader for the given bit count, which
+   * starts reading at the given symbol. This allows the caller to compile its
+   * decoding loop for every supported bit count.
+   */
+  template <typename Function>
+  static void readSymbols(unsigned bitCount, const unsigned char *packedBuffer,
+                          size_t symbolOffset, Function function);
+
   static size_t bufferSize(size_t nSymbols, size_t nBits) {
     return (nSymbols * nBits + 7) / 8;
   }
+
+ private:
+  /**
+   * Number of groups of eight symbols that the vectorized functions process.
+   * The kernels load or store a group as 16 bytes, so the groups near the end
+   * of the packed array are left to the scalar code.
+   */
+  template <unsigned BitCount>
+  static size_t vectorGroupCount(size_t symbolCount);
+
+  /**
+   * Pack groups of eight symbols with the AVX2 kernel, if the CPU supports
+   * it, and advance the arguments past the packed part.
+   */
+  template <unsigned BitCount>
+  static void packVectorized(unsigned char *&dest,
+                             const unsigned *&symbolBuffer,
+                             size_t &symbolCount);
+
+  /**
+   * Unpack groups of eight symbols with the AVX2 kernel, if the CPU supports
+   * it, and advance the arguments past the unpacked part.
+   */
+  template <unsigned BitCount>
+  static void unpackVectorized(unsigned *&symbolBuffer,
+                               unsigned char *&packedBuffer,
+                               size_t &symbolCount);
+
+#ifdef DYSCO_AVX2_KERNELS
+  template <unsigned BitCount>
+  DYSCO_TARGET_AVX2 static void packAvx2(unsigned char *dest,
+                                         const unsigned *symbolBuffer,
+                                         size_t groupCount);
+
+  template <unsigned BitCount>
+  DYSCO_TARGET_AVX2 static void unpackAvx2(unsigned *symbolBuffer,
+                                           const unsigned char *packedBuffer,
+                                           size_t groupCount);
+#endif
 };
 
 inline void BytePacker::pack(unsigned int bitCount, unsigned char *dest,
                              const unsigned int *symbolBuffer,
                              size_t symbolCount) {
   switch (bitCount) {
+    case 1:
+      packGeneric<1>(dest, symbolBuffer, symbolCount);
+      break;
     case 2:
       pack2(dest, symbolBuffer, symbolCount);
       break;
@@ -163,18 +295,39 @@ inline void BytePacker::pack(unsigned int bitCount, unsigned char *dest,
     case 4:
       pack4(dest, symbolBuffer, symbolCount);
       break;
+    case 5:
+      packGeneric<5>(dest, symbolBuffer, symbolCount);
+      break;
     case 6:
       pack6(dest, symbolBuffer, symbolCount);
       break;
+    case 7:
+      packGeneric<7>(dest, symbolBuffer, symbolCount);
+      break;
     case 8:
       pack8(dest, symbolBuffer, symbolCount);
       break;
+    case 9:
+      packGeneric<9>(dest, symbolBuffer, symbolCount);
+      break;
     case 10:
       pack10(dest, symbolBuffer, symbolCount);
       break;
+    case 11:
+      packGeneric<11>(dest, symbolBuffer, symbolCount);
+      break;
     case 12:
       pack12(dest, symbolBuffer, symbolCount);
       break;
+    case 13:
+      packGeneric<13>(dest, symbolBuffer, symbolCount);
+      break;
+    case 14:
+      packGeneric<14>(dest, symbolBuffer, symbolCount);
+      break;
+    case 15:
+      packGeneric<15>(dest, symbolBuffer, symbolCount);
+      break;
     case 16:
       pack16(dest, symbolBuffer, symbolCount);
       break;
@@ -188,6 +341,9 @@ inline void BytePacker::unpack(unsigned int bitCount,
                                unsigned char *packedBuffer,
                                size_t symbolCount) {
   switch (bitCount) {
+    case 1:
+      unpackGeneric<1>(symbolBuffer, packedBuffer, symbolCount);
+      break;
     case 2:
       unpack2(symbolBuffer, packedBuffer, symbolCount);
       break;
@@ -197,18 +353,39 @@ inline void BytePacker::unpack(unsigned int bitCount,
     case 4:
       unpack4(symbolBuffer, packedBuffer, symbolCount);
       break;
+    case 5:
+      unpackGeneric<5>(symbolBuffer, packedBuffer, symbolCount);
+      break;
     case 6:
       unpack6(symbolBuffer, packedBuffer, symbolCount);
       break;
+    case 7:
+      unpackGeneric<7>(symbolBuffer, packedBuffer, symbolCount);
+      break;
     case 8:
       unpack8(symbolBuffer, packedBuffer, symbolCount);
       break;
+    case 9:
+      unpackGeneric<9>(symbolBuffer, packedBuffer, symbolCount);
+      break;
     case 10:
       unpack10(symbolBuffer, packedBuffer, symbolCount);
       break;
+    case 11:
+      unpackGeneric<11>(symbolBuffer, packedBuffer, symbolCount);
+      break;
     case 12:
       unpack12(symbolBuffer, packedBuffer, symbolCount);
       break;
+    case 13:
+      unpackGeneric<13>(symbolBuffer, packedBuffer, symbolCount);
+      break;
+    case 14:
+      unpackGeneric<14>(symbolBuffer, packedBuffer, symbolCount);
+      break;
+    case 15:
+      unpackGeneric<15>(symbolBuffer, packedBuffer, symbolCount);
+      break;
     case 16:
       unpack16(symbolBuffer, packedBuffer, symbolCount);
       break;
@@ -217,9 +394,79 @@ inline void BytePacker::unpack(unsigned int bitCount,
   }
 }
 
+template <typename Function>
+inline void BytePacker::readSymbols(unsigned bitCount,
+                                    const unsigned char *packedBuffer,
+                                    size_t symbolOffset, Function function) {
+  switch (bitCount) {
+    case 1:
+      function(PackedSymbolReader<1>(packedBuffer, symbolOffset));
+      break;
+    case 2:
+      function(PackedSymbolReader<2>(packedBuffer, symbolOffset));
+      break;
+    case 3:
+      function(PackedSymbolReader<3>(packedBuffer, symbolOffset));
+      break;
+    case 4:
+      function(PackedSymbolReader<4>(packedBuffer, symbolOffset));
+      break;
+    case 5:
+      function(PackedSymbolReader<5>(packedBuffer, symbolOffset));
+      break;
+    case 6:
+      function(PackedSymbolReader<6>(packedBuffer, symbolOffset));
+      break;
+    case 7:
+      function(PackedSymbolReader<7>(packedBuffer, symbolOffset));
+      break;
+    case 8:
+      function(PackedSymbolReader<8>(packedBuffer, symbolOffset));
+      break;
+    case 9:
+      function(PackedSymbolReader<9>(packedBuffer, symbolOffset));
+      break;
+    case 10:
+      function(PackedSymbolReader<10>(packedBuffer, symbolOffset));
+      break;
+    case 11:
+      function(PackedSymbolReader<11>(packedBuffer, symbolOffset));
+      break;
+    case 12:
+      function(PackedSymbolReader<12>(packedBuffer, symbolOffset));
+      break;
+    case 13:
+      function(PackedSymbolReader<13>(packedBuffer, symbolOffset));
+      break;
+    case 14:
+      function(PackedSymbolReader<14>(packedBuffer, symbolOffset));
+      break;
+    case 15:
+      function(PackedSymbolReader<15>(packedBuffer, symbolOffset));
+      break;
+    case 16:
+      function(PackedSymbolReader<16>(packedBuffer, symbolOffset));
+      break;
+    default:
+      throw std::runtime_error("Unsupported unpacking size");
+  }
+}
+
+inline void BytePacker::unpackRange(unsigned int bitCount,
+                                    unsigned int *symbolBuffer,
+                                    unsigned char *packedBuffer,
+                                    size_t symbolOffset, size_t symbolCount) {
+  // Number of symbols after which the packed data is again byte aligned
+  const size_t groupSize = 8 / std::gcd(bitCount, 8u);
+  const size_t start = symbolOffset / groupSize * groupSize;
+  unpack(bitCount, symbolBuffer + start, packedBuffer + start * bitCount / 8,
+         symbolOffset + symbolCount - start);
+}
+
 inline void BytePacker::pack2(unsigned char *dest,
                               const unsigned int *symbolBuffer,
                               size_t symbolCount) {
+  packVectorized<2>(dest, symbolBuffer, symbolCount);
   const size_t limit = symbolCount / 4;
   for (size_t i = 0; i != limit; i++) {
     *dest = (*symbolBuffer);  // bits 1-2 into 1-2
@@ -253,6 +500,7 @@ inline void BytePacker::pack2(unsigned char *dest,
 inline void BytePacker::unpack2(unsigned *symbolBuffer,
                                 unsigned char *packedBuffer,
                                 size_t symbolCount) {
+  unpackVectorized<2>(symbolBuffer, packedBuffer, symbolCount);
   const size_t limit = symbolCount / 4;
   for (size_t i = 0; i != limit; i++) {
     *symbolBuffer = *packedBuffer & 0x03;  // bits 1-2 into 1-2
@@ -285,6 +533,7 @@ inline void BytePacker::unpack2(unsigned *symbolBuffer,
 
 inline void BytePacker::pack3(unsigned char *dest, const unsigned *symbolBuffer,
                               size_t symbolCount) {
+  packVectorized<3>(dest, symbolBuffer, symbolCount);
   const size_t limit = symbolCount / 8;
   for (size_t i = 0; i != limit; i++) {
     *dest = *symbolBuffer;  // 1. Bit 1-3 into 1-3
@@ -355,6 +604,7 @@ inline void BytePacker::pack3(unsigned char *dest, const unsigned *symbolBuffer,
 inline void BytePacker::unpack3(unsigned *symbolBuffer,
                                 unsigned char *packedBuffer,
                                 size_t symbolCount) {
+  unpackVectorized<3>(symbolBuffer, packedBuffer, symbolCount);
   const size_t limit = symbolCount / 8;
   for (size_t i = 0; i != limit; i++) {
     *symbolBuffer = (*packedBuffer) & 0x07;  // 1. Bits 1-3 into 1-3
@@ -433,6 +683,7 @@ inline void BytePacker::unpack3(unsigned *symbolBuffer,
 inline void BytePacker::pack4(unsigned char *dest,
                               const unsigned int *symbolBuffer,
                               size_t symbolCount) {
+  packVectorized<4>(dest, symbolBuffer, symbolCount);
   const size_t limit = symbolCount / 2;
   for (size_t i = 0; i != limit; i++) {
     *dest = (*symbolBuffer);  // bits 1-4 into 1-4
@@ -447,6 +698,7 @@ inline void BytePacker::pack4(unsigned char *dest,
 inline void BytePacker::unpack4(unsigned *symbolBuffer,
                                 unsigned char *packedBuffer,
                                 size_t symbolCount) {
+  unpackVectorized<4>(symbolBuffer, packedBuffer, symbolCount);
   const size_t limit = symbolCount / 2;
   for (size_t i = 0; i != limit; i++) {
     *symbolBuffer = *packedBuffer & 0x0F;  // bits 1-4 into 1-4
@@ -461,6 +713,7 @@ inline void BytePacker::unpack4(unsigned *symbolBuffer,
 
 inline void BytePacker::pack6(unsigned char *dest, const unsigned *symbolBuffer,
                               size_t symbolCount) {
+  packVectorized<6>(dest, symbolBuffer, symbolCount);
   const size_t limit = symbolCount / 4;
   for (size_t i = 0; i != limit; i++) {
     *dest = *symbolBuffer;  // Bit 1-6 into 1-6
@@ -510,6 +763,7 @@ inline void BytePacker::pack6(unsigned char *dest, const unsigned *symbolBuffer,
 inline void BytePacker::unpack6(unsigned *symbolBuffer,
                                 unsigned char *packedBuffer,
                                 size_t symbolCount) {
+  unpackVectorized<6>(symbolBuffer, packedBuffer, symbolCount);
   const size_t limit = symbolCount / 4;
   for (size_t i = 0; i != limit; i++) {
     *symbolBuffer = (*packedBuffer) & 63;  // Bits 1-6 into 1-6
@@ -555,18 +809,21 @@ inline void BytePacker::unpack6(unsigned *symbolBuffer,
 
 inline void BytePacker::pack8(unsigned char *dest, const unsigned *symbolBuffer,
                               size_t symbolCount) {
+  packVectorized<8>(dest, symbolBuffer, symbolCount);
   for (size_t i = 0; i != symbolCount; ++i) dest[i] = symbolBuffer[i];
 }
 
 inline void BytePacker::unpack8(unsigned *symbolBuffer,
                                 unsigned char *packedBuffer,
                                 size_t symbolCount) {
+  unpackVectorized<8>(symbolBuffer, packedBuffer, symbolCount);
   for (size_t i = 0; i != symbolCount; ++i) symbolBuffer[i] = packedBuffer[i];
 }
 
 inline void BytePacker::pack10(unsigned char *dest,
                                const unsigned int *symbolBuffer,
                                size_t symbolCount) {
+  packVectorized<10>(dest, symbolBuffer, symbolCount);
   const size_t limit = symbolCount / 4;
   for (size_t i = 0; i != limit; i++) {
     *dest = (*symbolBuffer & 0x0FF);  // Bit 1-8 into 1-8
@@ -619,6 +876,7 @@ inline void BytePacker::pack10(unsigned char *dest,
 inline void BytePacker::unpack10(unsigned int *symbolBuffer,
                                  unsigned char *packedBuffer,
                                  size_t symbolCount) {
+  unpackVectorized<10>(symbolBuffer, packedBuffer, symbolCount);
   const size_t limit = symbolCount / 4;
   for (size_t i = 0; i != limit; i++) {
     *symbolBuffer = *packedBuffer;  // Bits 1-8 into 1-8
@@ -670,6 +928,7 @@ inline void BytePacker::unpack10(unsigned int *symbolBuffer,
 inline void BytePacker::pack12(unsigned char *dest,
                                const unsigned int *symbolBuffer,
                                size_t symbolCount) {
+  packVectorized<12>(dest, symbolBuffer, symbolCount);
   const size_t limit = symbolCount / 2;
   for (size_t i = 0; i != limit; i++) {
     *dest = (*symbolBuffer) & 0x0FF;  // bits 1-8 into 1-8
@@ -695,6 +954,7 @@ inline void BytePacker::pack12(unsigned char *dest,
 inline void BytePacker::unpack12(unsigned int *symbolBuffer,
                                  unsigned char *packedBuffer,
                                  size_t symbolCount) {
+  unpackVectorized<12>(symbolBuffer, packedBuffer, symbolCount);
   const size_t limit = symbolCount / 2;
   for (size_t i = 0; i != limit; i++) {
     *symbolBuffer = *packedBuffer;  // bits 1-8 into 1-8
@@ -718,6 +978,7 @@ inline void BytePacker::unpack12(unsigned int *symbolBuffer,
 inline void BytePacker::pack16(unsigned char *dest,
                                const unsigned *symbolBuffer,
                                size_t symbolCount) {
+  packVectorized<16>(dest, symbolBuffer, symbolCount);
   for (size_t i = 0; i != symbolCount; ++i)
     reinterpret_cast<uint16_t *>(dest)[i] = symbolBuffer[i];
 }
@@ -725,10 +986,203 @@ inline void BytePacker::pack16(unsigned char *dest,
 inline void BytePacker::unpack16(unsigned *symbolBuffer,
                                  unsigned char *packedBuffer,
                                  size_t symbolCount) {
+  unpackVectorized<16>(symbolBuffer, packedBuffer, symbolCount);
   for (size_t i = 0; i != symbolCount; ++i)
     symbolBuffer[i] = reinterpret_cast<uint16_t *>(packedBuffer)[i];
 }
 
+template <unsigned BitCount>
+inline void BytePacker::packGeneric(unsigned char *dest,
+                                    const unsigned *symbolBuffer,
+                                    size_t symbolCount) {
+  packVectorized<BitCount>(dest, symbolBuffer, symbolCount);
+  // Symbols are collected until they fill one or more bytes
+  uint32_t bits = 0;
+  unsigned bitCount = 0;
+  for (size_t i = 0; i != symbolCount; ++i) {
+    bits |= symbolBuffer[i] << bitCount;
+    bitCount += BitCount;
+    while (bitCount >= 8) {
+      *dest = bits;
+      ++dest;
+      bits >>= 8;
+      bitCount -= 8;
+    }
+  }
+  if (bitCount != 0) *dest = bits;
+}
+
+template <unsigned BitCount>
+inline void BytePacker::unpackGeneric(unsigned *symbolBuffer,
+                                      unsigned char *packedBuffer,
+                                      size_t symbolCount) {
+  unpackVectorized<BitCount>(symbolBuffer, packedBuffer, symbolCount);
+  // Like PackedSymbolReader, but bytes are only read when they are needed,
+  // so nothing is read past the packed array.
+  uint32_t bits = 0;
+  unsigned bitCount = 0;
+  for (size_t i = 0; i != symbolCount; ++i) {
+    while (bitCount < BitCount) {
+      bits |= uint32_t(*packedBuffer) << bitCount;
+      ++packedBuffer;
+      bitCount += 8;
+    }
+    symbolBuffer[i] = bits & ((1u << BitCount) - 1);
+    bits >>= BitCount;
+    bitCount -= BitCount;
+  }
+}
+
+template <unsigned BitCount>
+inline size_t BytePacker::vectorGroupCount(size_t symbolCount) {
+  const size_t packedSize = bufferSize(symbolCount, BitCount);
+  return packedSize < 16
+             ? 0
+             : std::min(symbolCount / 8, (packedSize - 16) / BitCount + 1);
+}
+
+template <unsigned BitCount>
+inline void BytePacker::packVectorized(unsigned char *&dest,
+                                       const unsigned *&symbolBuffer,
+                                       size_t &symbolCount) {
+#ifdef DYSCO_AVX2_KERNELS
+  if (HasAvx2()) {
+    const size_t groupCount = vectorGroupCount<BitCount>(symbolCount) / 2 * 2;
+    packAvx2<BitCount>(dest, symbolBuffer, groupCount);
+    dest += groupCount * BitCount;
+    symbolBuffer += groupCount * 8;
+    symbolCount -= groupCount * 8;
+  }
+#endif
+}
+
+template <unsigned BitCount>
+inline void BytePacker::unpackVectorized(unsigned *&symbolBuffer,
+                                         unsigned char *&packedBuffer,
+                                         size_t &symbolCount) {
+#ifdef DYSCO_AVX2_KERNELS
+  if (HasAvx2()) {
+    const size_t groupCount = vectorGroupCount<BitCount>(symbolCount);
+    unpackAvx2<BitCount>(symbolBuffer, packedBuffer, groupCount);
+    symbolBuffer += groupCount * 8;
+    packedBuffer += groupCount * BitCount;
+    symbolCount -= groupCount * 8;
+  }
+#endif
+}
+
+#ifdef DYSCO_AVX2_KERNELS
+template <unsigned BitCount>
+DYSCO_TARGET_AVX2 inline void BytePacker::packAvx2(
+    unsigned char *dest, const unsigned *symbolBuffer, size_t groupCount) {
+  // Two groups are packed at a time. Their symbols are first narrowed to 16
+  // bits, which places symbols 0-3 of both groups in the lower 128-bit half
+  // and symbols 4-7 in the upper half. Neighbouring symbols are then combined
+  // into 32-bit and 64-bit lanes, after which lane i of each half holds four
+  // symbols of group i.
+  const __m256i mask = _mm256_set1_epi16((1u << BitCount) - 1);
+  const __m256i lowWords = _mm256_set1_epi64x(0xFFFFFFFF);
+  // Number of bits of four symbols
+  constexpr unsigned quadBits = 4 * BitCount;
+  for (size_t group = 0; group + 1 < groupCount; group += 2) {
+    const __m256i symbols = _mm256_and_si256(
+        _mm256_packus_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(symbolBuffer)),
+            _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(symbolBuffer + 8))),
+        mask);
+    if constexpr (BitCount == 8 || BitCount == 16) {
+      // Whole bytes: only the order of the symbols has to be restored
+      if constexpr (BitCount == 8) {
+        const __m256i bytes = _mm256_permutevar8x32_epi32(
+            _mm256_packus_epi16(symbols, symbols),
+            _mm256_setr_epi32(0, 4, 1, 5, 0, 0, 0, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),
+                         _mm256_castsi256_si128(bytes));
+      } else {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest),
+                            _mm256_permute4x64_epi64(symbols, 0xD8));
+      }
+    } else {
+      __m256i pairs;
+      if constexpr (BitCount <= 14) {
+        // The multiply-add combines the two 16-bit symbols of a 32-bit lane
+        pairs = _mm256_madd_epi16(
+            symbols, _mm256_set1_epi32((1 << (16 + BitCount)) | 1));
+      } else {
+        pairs = _mm256_or_si256(
+            _mm256_and_si256(symbols, _mm256_set1_epi32(0xFFFF)),
+            _mm256_slli_epi32(_mm256_srli_epi32(symbols, 16), BitCount));
+      }
+      const __m256i quads = _mm256_or_si256(
+          _mm256_and_si256(pairs, lowWords),
+          _mm256_slli_epi64(_mm256_srli_epi64(pairs, 32), 2 * BitCount));
+      // Combine the halves into the 128-bit values of the groups. Shifting by
+      // 64 bits gives zero, so this also works when four symbols fill 64 bits.
+      const __m128i low = _mm256_castsi256_si128(quads);
+      const __m128i high = _mm256_extracti128_si256(quads, 1);
+      const __m128i lowWords128 =
+          _mm_or_si128(low, _mm_slli_epi64(high, quadBits));
+      const __m128i highWords128 = _mm_srli_epi64(high, 64 - quadBits);
+      // All 16 bytes are stored; the bytes after a group are overwritten by
+      // the next group.
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),
+                       _mm_unpacklo_epi64(lowWords128, highWords128));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + BitCount),
+                       _mm_unpackhi_epi64(lowWords128, highWords128));
+    }
+    dest += 2 * BitCount;
+    symbolBuffer += 16;
+  }
+}
+
+template <unsigned BitCount>
+DYSCO_TARGET_AVX2 inline void BytePacker::unpackAvx2(
+    unsigned *symbolBuffer, const unsigned char *packedBuffer,
+    size_t groupCount) {
+  // Symbol i of a group starts in byte i * BitCount / 8 of the group and
+  // covers at most three bytes. These bytes are shuffled into 32-bit lane i,
+  // which is then shifted to align the symbol. The shuffle works within the
+  // 128-bit halves, so the 16 loaded bytes are copied into both halves. Whole
+  // bytes are only widened.
+  alignas(32) int8_t byteIndices[32];
+  alignas(32) int32_t shifts[8];
+  for (unsigned i = 0; i != 8; ++i) {
+    const unsigned firstBit = i * BitCount;
+    const unsigned lastByte = (firstBit + BitCount - 1) / 8;
+    for (unsigned j = 0; j != 4; ++j) {
+      const unsigned byte = firstBit / 8 + j;
+      byteIndices[i * 4 + j] = byte <= lastByte ? byte : -1;
+    }
+    shifts[i] = firstBit % 8;
+  }
+  const __m256i shuffle =
+      _mm256_load_si256(reinterpret_cast<const __m256i *>(byteIndices));
+  const __m256i shift =
+      _mm256_load_si256(reinterpret_cast<const __m256i *>(shifts));
+  const __m256i mask = _mm256_set1_epi32((1u << BitCount) - 1);
+  for (size_t group = 0; group != groupCount; ++group) {
+    const __m128i packed =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(packedBuffer));
+    __m256i symbols;
+    if constexpr (BitCount == 8) {
+      symbols = _mm256_cvtepu8_epi32(packed);
+    } else if constexpr (BitCount == 16) {
+      symbols = _mm256_cvtepu16_epi32(packed);
+    } else {
+      symbols = _mm256_and_si256(
+          _mm256_srlv_epi32(_mm256_shuffle_epi8(
+                                _mm256_broadcastsi128_si256(packed), shuffle),
+                            shift),
+          mask);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(symbolBuffer), symbols);
+    packedBuffer += BitCount;
+    symbolBuffer += 8;
+  }
+}
+#endif
+
 }  // namespace dyscostman
 
 #endif
@@ -0,0 +1,42 @@
+#ifndef DYSCO_CPU_FEATURES_H
+#define DYSCO_CPU_FEATURES_H
+
+/**
+ * @file
+ * Run-time selection of the SIMD kernels. A kernel that uses AVX2 is marked
+ * with DYSCO_TARGET_AVX2, which makes the compiler generate AVX2 code for that
+ * function only, independent of the compile options. Such a kernel may only
+ * be called when HasAvx2() returns true, and is only available when
+ * DYSCO_AVX2_KERNELS is defined. This way, builds that are made portable
+ * still use the kernels on CPUs that support them.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+#define DYSCO_AVX2_KERNELS
+#define DYSCO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace dyscostman {
+
+/**
+ * Whether the AVX2 kernels can be used. When the code is compiled for a CPU
+ * with AVX2, this is known at compile time. Otherwise, the CPU is queried the
+ * first time this is called.
+ */
+inline bool HasAvx2() {
+#if defined(__AVX2__)
+  return true;
+#elif defined(DYSCO_AVX2_KERNELS)
+  static const bool hasAvx2 =
+      (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+  return hasAvx2;
+#else
+  return false;
+#endif
+}
+
+}  // namespace dyscostman
+
+#endif
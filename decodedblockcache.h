@@ -0,0 +1,133 @@
+#ifndef DYSCO_DECODED_BLOCK_CACHE_H
+#define DYSCO_DECODED_BLOCK_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace dyscostman {
+
+/**
+ * Keeps recently decoded blocks, so that a reader that switches back to a
+ * block does not have to read and decode it again. The cache holds blocks up
+ * to a maximum size in bytes, and evicts the least recently used blocks when
+ * it gets larger. It is used by the reading thread only and is therefore not
+ * thread safe.
+ */
+template <typename T>
+class DecodedBlockCache {
+ public:
+  explicit DecodedBlockCache(size_t maxSize = 0)
+      : _maxSize(maxSize), _size(0), _hits(0), _misses(0) {}
+
+  DecodedBlockCache(const DecodedBlockCache &) = delete;
+  DecodedBlockCache &operator=(const DecodedBlockCache &) = delete;
+
+  /**
+   * Remove a block from the cache. This counts as a hit when the block was
+   * in the cache, and as a miss otherwise.
+   * @returns The block, or nullptr when it was not in the cache.
+   */
+  std::unique_ptr<T> Take(size_t blockIndex) {
+    std::unique_ptr<T> item = Erase(blockIndex);
+    if (item)
+      ++_hits;
+    else
+      ++_misses;
+    return item;
+  }
+
+  /**
+   * Remove a block from the cache, e.g. because it is outdated, without
+   * counting it as a hit or miss.
+   */
+  std::unique_ptr<T> Erase(size_t blockIndex) {
+    auto iter = _blocks.find(blockIndex);
+    if (iter == _blocks.end()) return nullptr;
+    std::unique_ptr<T> item = std::move(iter->second.item);
+    _size -= iter->second.size;
+    _order.erase(iter->second.orderPosition);
+    _blocks.erase(iter);
+    return item;
+  }
+
+  /**
+   * Add a block as most recently used block. A previously stored item for
+   * the same block is replaced.
+   * @param size Size of the block in bytes.
+   * @returns Items that no longer fit in the cache, which may include the
+   * given item when it is larger than the maximum size.
+   */
+  std::vector<std::unique_ptr<T>> Store(size_t blockIndex,
+                                        std::unique_ptr<T> item, size_t size) {
+    std::vector<std::unique_ptr<T>> evicted;
+    std::unique_ptr<T> previous = Erase(blockIndex);
+    if (previous) evicted.emplace_back(std::move(previous));
+    if (size > _maxSize) {
+      evicted.emplace_back(std::move(item));
+      return evicted;
+    }
+    _order.push_front(blockIndex);
+    _blocks.emplace(blockIndex, Entry{std::move(item), size, _order.begin()});
+    _size += size;
+    evict(evicted);
+    return evicted;
+  }
+
+  bool Contains(size_t blockIndex) const {
+    return _blocks.find(blockIndex) != _blocks.end();
+  }
+
+  /**
+   * Change the maximum size.
+   * @returns Items that no longer fit in the cache.
+   */
+  std::vector<std::unique_ptr<T>> SetMaxSize(size_t maxSize) {
+    _maxSize = maxSize;
+    std::vector<std::unique_ptr<T>> evicted;
+    evict(evicted);
+    return evicted;
+  }
+
+  /** Remove all blocks. The hit and miss counts are kept. */
+  void Clear() {
+    _blocks.clear();
+    _order.clear();
+    _size = 0;
+  }
+
+  size_t MaxSize() const { return _maxSize; }
+  /** Total size of the blocks in the cache in bytes. */
+  size_t Size() const { return _size; }
+  size_t BlockCount() const { return _blocks.size(); }
+  size_t Hits() const { return _hits; }
+  size_t Misses() const { return _misses; }
+
+ private:
+  struct Entry {
+    std::unique_ptr<T> item;
+    size_t size;
+    std::list<size_t>::iterator orderPosition;
+  };
+
+  void evict(std::vector<std::unique_ptr<T>> &evicted) {
+    while (_size > _maxSize) {
+      const size_t blockIndex = _order.back();
+      evicted.emplace_back(Erase(blockIndex));
+    }
+  }
+
+  size_t _maxSize;
+  size_t _size;
+  size_t _hits;
+  size_t _misses;
+  std::map<size_t, Entry> _blocks;
+  /** Block indices from most to least recently used. */
+  std::list<size_t> _order;
+};
+
+}  // namespace dyscostman
+
+#endif
@@ -1,9 +1,14 @@
 #ifndef DYSCO_DICTIONARY_H_
 #define DYSCO_DICTIONARY_H_
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 
+#include "cpufeatures.h"
 #include "uvector.h"
 
 namespace dyscostman {
@@ -21,7 +26,10 @@ class Dictionary {
 
   void reserve(size_t size) { _values.reserve(size); }
 
-  void resize(size_t size) { _values.resize(size); }
+  void resize(size_t size) {
+    _values.resize(size);
+    _lookupTable.clear();
+  }
 
   /**
    * Returns an iterator pointing to the first element in the dictionary
@@ -66,10 +74,178 @@ class Dictionary {
     return (it < base + n && *it < val) ? it + 1 : it;
   }
 
+  /**
+   * Returns the same as lower_bound(), but starts the search at the given
+   * index and moves from there one element at a time. This is faster when
+   * the position of the value is known approximately.
+   */
+  const_iterator lower_bound_near(value_t val, size_t index) const {
+    const value_t* base = _values.data();
+    const size_t n = _values.size();
+    if (index > n) index = n;
+    while (index != 0 && !(base[index - 1] < val)) --index;
+    while (index != n && base[index] < val) ++index;
+    return base + index;
+  }
+
+  /**
+   * Create a table that is used by lower_bound_lookup(). The values are
+   * divided over buckets by the high bits of their float representation,
+   * which gives small buckets near zero and large buckets in the tails of a
+   * distribution. For every bucket, the table stores the index of the first
+   * value that falls in it. The table has to be recreated when the values
+   * are changed.
+   * @param maxTableSize Maximum number of buckets. Lookups are fastest when
+   * the buckets contain at most a few values.
+   */
+  void create_lookup_table(size_t maxTableSize) {
+    assert(_values.size() >= 2 && maxTableSize >= 1);
+    const value_t* base = _values.data();
+    const size_t n = _values.size();
+    // The encoding dictionary ends with a bounding element that is the
+    // maximum float, which is left out of the range.
+    value_t last = base[n - 1];
+    if (!(last < std::numeric_limits<value_t>::max())) last = base[n - 2];
+    // Magnitudes smaller than half the smallest distance between values are
+    // not distinguished, to avoid many empty buckets for tiny values.
+    value_t minDistance = std::numeric_limits<value_t>::max();
+    for (size_t i = 1; i != n; ++i) {
+      const value_t distance = base[i] - base[i - 1];
+      if (distance > 0) minDistance = std::min(minDistance, distance);
+    }
+    _tableMinMagnitude = FloatBits(minDistance * value_t(0.5));
+    _tableStart = lookupKey(base[0]);
+    _tableEnd = std::max(lookupKey(last), _tableStart);
+    const uint32_t keyRange =
+        static_cast<uint32_t>(_tableEnd) - static_cast<uint32_t>(_tableStart);
+    _tableShift = 0;
+    while ((keyRange >> _tableShift) >= maxTableSize) ++_tableShift;
+    const size_t tableSize = (keyRange >> _tableShift) + 1;
+
+    _lookupTable.resize(tableSize + 1);
+    size_t index = 0;
+    size_t maxBucketSize = 1;
+    for (size_t bucket = 0; bucket != tableSize; ++bucket) {
+      const size_t bucketStart = index;
+      while (index != n && lookupBucket(base[index]) <= bucket) ++index;
+      _lookupTable[bucket] = bucketStart;
+      maxBucketSize = std::max(maxBucketSize, index - bucketStart);
+    }
+    _lookupTable[tableSize] = n;
+    _lookupStep = BitFloor(maxBucketSize);
+  }
+
+  bool has_lookup_table() const { return !_lookupTable.empty(); }
+
+  /**
+   * Returns the same as lower_bound(), but uses the table created by
+   * create_lookup_table() to find the few values that the value has to be
+   * compared with, which are then searched without branches. The bucket of a
+   * value is calculated with the same expression as when the table was
+   * created, so the result is exact.
+   */
+  const_iterator lower_bound_lookup(value_t val) const {
+    assert(has_lookup_table());
+    const value_t* base = _values.data();
+    const size_t last = _values.size() - 1;
+    const size_t bucket = lookupBucket(val);
+    size_t index = _lookupTable[bucket];
+    const size_t end = _lookupTable[bucket + 1];
+    // Every value before index is less than val. The steps add up to at
+    // least the largest bucket size.
+    for (size_t step = _lookupStep; step != 0; step >>= 1) {
+      const size_t probe = index + step;
+      index += step * ((probe <= end) & (base[std::min(probe - 1, last)] < val));
+    }
+    return base + index;
+  }
+
+#ifdef DYSCO_AVX2_KERNELS
+  /**
+   * Eight-value version of lower_bound_lookup(), with the same result.
+   * Requires HasAvx2().
+   * @returns For every value, the index of the first element that is not
+   * less than the value, or size() if there is no such element.
+   */
+  DYSCO_TARGET_AVX2 __m256i lower_bound_lookup_avx2(__m256 values) const {
+    assert(has_lookup_table());
+    const float* base = _values.data();
+    const int* table = reinterpret_cast<const int*>(_lookupTable.data());
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i last = _mm256_set1_epi32(_values.size() - 1);
+
+    // Same calculation as lookupBucket()
+    const __m256i bits = _mm256_castps_si256(values);
+    const __m256i magnitude =
+        _mm256_and_si256(bits, _mm256_set1_epi32(kFloatMagnitudeMask));
+    const __m256i isNaN =
+        _mm256_cmpgt_epi32(magnitude, _mm256_set1_epi32(kFloatInfinityBits));
+    const __m256i minMagnitude = _mm256_set1_epi32(_tableMinMagnitude);
+    __m256i key = _mm256_sub_epi32(_mm256_max_epi32(magnitude, minMagnitude),
+                                   minMagnitude);
+    key = _mm256_blendv_epi8(key, _mm256_sub_epi32(_mm256_setzero_si256(), key),
+                             _mm256_srai_epi32(bits, 31));
+    key = _mm256_min_epi32(_mm256_max_epi32(key, _mm256_set1_epi32(_tableStart)),
+                           _mm256_set1_epi32(_tableEnd));
+    __m256i bucket = _mm256_srl_epi32(
+        _mm256_sub_epi32(key, _mm256_set1_epi32(_tableStart)),
+        _mm_cvtsi32_si128(_tableShift));
+    bucket = _mm256_andnot_si256(isNaN, bucket);
+
+    __m256i index = _mm256_i32gather_epi32(table, bucket, 4);
+    const __m256i end =
+        _mm256_i32gather_epi32(table, _mm256_add_epi32(bucket, one), 4);
+    for (size_t step = _lookupStep; step != 0; step >>= 1) {
+      const __m256i probe = _mm256_add_epi32(index, _mm256_set1_epi32(step));
+      const __m256 probeValues = _mm256_i32gather_ps(
+          base, _mm256_min_epi32(_mm256_sub_epi32(probe, one), last), 4);
+      const __m256i isLess = _mm256_castps_si256(
+          _mm256_cmp_ps(probeValues, values, _CMP_LT_OQ));
+      const __m256i isPastEnd = _mm256_cmpgt_epi32(probe, end);
+      index = _mm256_blendv_epi8(index, probe,
+                                 _mm256_andnot_si256(isPastEnd, isLess));
+    }
+    return index;
+  }
+
+  /**
+   * Search eight values at the same time. This performs the same steps as
+   * lower_bound_branchless_two_minimum() for every value, using a gather for
+   * the probes, so the result is identical. Requires HasAvx2().
+   * @returns For every value, the index of the first element that is not
+   * less than the value, or size() if there is no such element.
+   */
+  DYSCO_TARGET_AVX2 __m256i lower_bound_avx2(__m256 values) const {
+    assert(_values.size() >= 2);
+    const float* base = _values.data();
+    const size_t n = _values.size();
+    const __m256i size = _mm256_set1_epi32(n);
+    const __m256i last = _mm256_set1_epi32(n - 1);
+    __m256i it = _mm256_setzero_si256();
+    for (size_t step = BitFloor(n); step != 0; step >>= 1) {
+      const __m256i probe =
+          _mm256_add_epi32(it, _mm256_set1_epi32(std::min(step, n - 1)));
+      // Probes past the end are not taken; they read the last element to
+      // avoid reading outside the dictionary
+      const __m256i inRange = _mm256_cmpgt_epi32(size, probe);
+      const __m256 probeValues =
+          _mm256_i32gather_ps(base, _mm256_min_epi32(probe, last), 4);
+      const __m256i isLess = _mm256_castps_si256(
+          _mm256_cmp_ps(probeValues, values, _CMP_LT_OQ));
+      it = _mm256_blendv_epi8(it, probe, _mm256_and_si256(inRange, isLess));
+    }
+    // Final correction; isLess is -1 where it needs to be incremented
+    const __m256i isLess = _mm256_castps_si256(
+        _mm256_cmp_ps(_mm256_i32gather_ps(base, it, 4), values, _CMP_LT_OQ));
+    return _mm256_sub_epi32(it, isLess);
+  }
+#endif
+
   /**
    * Branchless version of lower_bound. Dictionary may not be empty.
-   * This is currently (2026) the fastest implementation, and is
-   * about two times faster than lower_bound_two_minimum.
+   * This is the fastest of the searches that do not need a lookup table,
+   * and is about two times faster than lower_bound_two_minimum. When the
+   * dictionary has a lookup table, lower_bound_lookup is faster.
    */
   const_iterator lower_bound_branchless(value_t val) const {
     assert(!empty());
@@ -201,7 +377,55 @@ class Dictionary {
 #endif
   }
   
+  static constexpr uint32_t kFloatMagnitudeMask = 0x7FFFFFFF;
+  static constexpr uint32_t kFloatInfinityBits = 0x7F800000;
+
+  static uint32_t FloatBits(value_t val) {
+    uint32_t bits;
+    std::memcpy(&bits, &val, sizeof(bits));
+    return bits;
+  }
+
+  /**
+   * Integer that increases monotonically with the value, made from the sign
+   * and magnitude bits of the float. Magnitudes up to the minimum magnitude
+   * all give zero.
+   */
+  int32_t lookupKey(value_t val) const {
+    const uint32_t bits = FloatBits(val);
+    const int32_t magnitude =
+        std::max(bits & kFloatMagnitudeMask, _tableMinMagnitude) -
+        _tableMinMagnitude;
+    return (bits >> 31) ? -magnitude : magnitude;
+  }
+
+  /**
+   * Bucket of a value in the lookup table. This increases monotonically with
+   * the value, and values outside the range are put in the first or last
+   * bucket. NaN values are put in the first bucket, as they are found at
+   * the start by lower_bound().
+   */
+  size_t lookupBucket(value_t val) const {
+    if ((FloatBits(val) & kFloatMagnitudeMask) > kFloatInfinityBits) return 0;
+    const int32_t key = std::clamp(lookupKey(val), _tableStart, _tableEnd);
+    const uint32_t offset =
+        static_cast<uint32_t>(key) - static_cast<uint32_t>(_tableStart);
+    return offset >> _tableShift;
+  }
+
   aocommon::UVector<value_t> _values;
+  /**
+   * For every bucket the index of its first value, followed by the size of
+   * the dictionary. Empty if no table was created.
+   */
+  aocommon::UVector<symbol_t> _lookupTable;
+  /** Largest power of two not larger than the largest bucket size. */
+  size_t _lookupStep = 0;
+  uint32_t _tableMinMagnitude = 0;
+  /** Keys of the smallest and largest value in the table. */
+  int32_t _tableStart = 0;
+  int32_t _tableEnd = 0;
+  unsigned _tableShift = 0;
 };
 
 }  // namespace dyscostman
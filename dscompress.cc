@@ -1,4 +1,5 @@
 #include "dyscodistribution.h"
+#include "dyscodithergenerator.h"
 #include "dysconormalization.h"
 #include "dyscostman.h"
 #include "stmanmodifier.h"
@@ -18,7 +19,10 @@ void createDyscoStManColumn(casacore::Table &ms, const std::string &name,
                             unsigned bitsPerComplex, unsigned bitsPerWeight,
                             Normalization normalization,
                             DyscoDistribution distribution, double studentsTNu,
-                            double distributionTruncation, bool staticSeed) {
+                            double distributionTruncation, bool staticSeed,
+                            DitherGenerator ditherGenerator,
+                            unsigned encoderThreads,
+                            unsigned writeCacheBlocks) {
   std::cout << "Constructing new column '" << name << "'...\n";
   casacore::ArrayColumnDesc<T> columnDesc(name, "", "DyscoStMan", "DyscoStMan",
                                           shape);
@@ -52,6 +56,9 @@ void createDyscoStManColumn(casacore::Table &ms, const std::string &name,
       std::cout << "Setting static seed...\n";
       dataManager.SetStaticSeed(true);
     }
+    dataManager.SetDitherGenerator(ditherGenerator);
+    dataManager.SetEncoderThreadCount(encoderThreads);
+    dataManager.SetWriteCacheBlockCount(writeCacheBlocks);
     std::cout << "Adding column...\n";
     ms.addColumn(columnDesc, dataManager);
     isAlreadyUsed = false;
@@ -98,12 +105,13 @@ int main(int argc, char *argv[]) {
            "visibility is a complex number,\n"
            "\tthe total nr bits per visibility will be twice this number. The "
            "compression rate is n/32.\n"
+           "\tAny value from 2 to 16 can be used.\n"
            "-weight-bit-rate <n>\n"
            "\tSets the number of bits per float for the data weights. The "
            "storage manager will use a single\n"
            "\tweight for all polarizations, hence with four polarizations the "
            "compression of weight is\n"
-           "\t1/4 * n/32.\n"
+           "\t1/4 * n/32. Any value from 1 to 16 can be used.\n"
            "-reorder\n"
            "\tWill rewrite the measurement set after replacing the column. "
            "This makes sure that the space\n"
@@ -123,6 +131,23 @@ int main(int argc, char *argv[]) {
            "\tnoise between different measurement sets and should therefore "
            "only be used for\n"
            "\texperimentation.\n"
+           "-dither-generator <philox/xoshiro>\n"
+           "\tSelect the random number generator for the dithering. Xoshiro "
+           "is faster, but a block\n"
+           "\tis then quantized by a single thread. Files that use xoshiro "
+           "can only be read by\n"
+           "\tversions of Dysco that support file format 1.1. The default is "
+           "philox.\n"
+           "-encoder-threads <n>\n"
+           "\tNumber of threads used per column for encoding. The threads "
+           "come from a pool that is\n"
+           "\tshared by all columns and has one thread per core. The default "
+           "is the number of\n"
+           "\tcores, limited to 8.\n"
+           "-write-cache-blocks <n>\n"
+           "\tNumber of blocks per column that are kept in memory while "
+           "waiting to be encoded. The\n"
+           "\tdefault is 1.2 times the number of encoder threads plus one.\n"
            "\n"
            "Defaults: \n"
            "\tbits per data val = 8\n"
@@ -138,6 +163,8 @@ int main(int argc, char *argv[]) {
   unsigned bitsPerFloat = 8, bitsPerWeight = 12;
   double distributionTruncation = 2.5;
   bool staticSeed = false;
+  DitherGenerator ditherGenerator = DitherGenerator::kPhilox;
+  unsigned encoderThreads = 0, writeCacheBlocks = 0;
 
   std::vector<std::string> columnNames;
 
@@ -173,6 +200,21 @@ int main(int argc, char *argv[]) {
       normalization = Normalization::kRow;
     } else if (p == "static-seed") {
       staticSeed = true;
+    } else if (p == "dither-generator") {
+      ++argi;
+      const std::string generator = argv[argi];
+      if (generator == "philox")
+        ditherGenerator = DitherGenerator::kPhilox;
+      else if (generator == "xoshiro")
+        ditherGenerator = DitherGenerator::kXoshiro;
+      else
+        throw std::runtime_error("Invalid dither generator: " + generator);
+    } else if (p == "encoder-threads") {
+      ++argi;
+      encoderThreads = atoi(argv[argi]);
+    } else if (p == "write-cache-blocks") {
+      ++argi;
+      writeCacheBlocks = atoi(argv[argi]);
     } else
       throw std::runtime_error(std::string("Invalid parameter: ") + argv[argi]);
     ++argi;
@@ -349,11 +391,13 @@ int main(int argc, char *argv[]) {
       if (columnName == "WEIGHT_SPECTRUM")
         createDyscoStManColumn<float>(
             *ms, columnName, shape, bitsPerFloat, bitsPerWeight, normalization,
-            distribution, 1.0, distributionTruncation, staticSeed);
+            distribution, 1.0, distributionTruncation, staticSeed,
+            ditherGenerator, encoderThreads, writeCacheBlocks);
       else
         createDyscoStManColumn<casacore::Complex>(
             *ms, columnName, shape, bitsPerFloat, bitsPerWeight, normalization,
-            distribution, 1.0, distributionTruncation, staticSeed);
+            distribution, 1.0, distributionTruncation, staticSeed,
+            ditherGenerator, encoderThreads, writeCacheBlocks);
     }
     for (std::string columnName : columnNames) {
       if (columnName == "WEIGHT_SPECTRUM")
@@ -2,6 +2,7 @@
 #include "aftimeblockencoder.h"
 #include "rftimeblockencoder.h"
 #include "rowtimeblockencoder.h"
+#include "threadpool.h"
 
 namespace dyscostman {
 
@@ -13,19 +14,7 @@ void DyscoDataColumn::Prepare(DyscoDistribution distribution,
   _normalization = normalization;
   ThreadedDyscoColumn::Prepare(distribution, normalization, studentsTNu,
                                distributionTruncation);
-  const size_t nPolarizations = shape()[0], nChannels = shape()[1];
-
-  switch (normalization) {
-    case Normalization::kAF:
-      _decoder.reset(new AFTimeBlockEncoder(nPolarizations, nChannels, true));
-      break;
-    case Normalization::kRF:
-      _decoder.reset(new RFTimeBlockEncoder(nPolarizations, nChannels));
-      break;
-    case Normalization::kRow:
-      _decoder.reset(new RowTimeBlockEncoder(nPolarizations, nChannels));
-      break;
-  }
+  _decoder = createEncoder();
 
   switch (distribution) {
     case GaussianDistribution:
@@ -33,8 +22,9 @@ void DyscoDataColumn::Prepare(DyscoDistribution distribution,
           new StochasticEncoder<float>(1 << getBitsPerSymbol(), 1.0, true));
       break;
     case UniformDistribution:
-      _gausEncoder.reset(
-          new StochasticEncoder<float>(1 << getBitsPerSymbol(), 1.0, false));
+      _gausEncoder.reset(new StochasticEncoder<float>(
+          StochasticEncoder<float>::UniformEncoder(1 << getBitsPerSymbol(),
+                                                   1.0)));
       break;
     case StudentsTDistribution:
       _gausEncoder.reset(new StochasticEncoder<float>(
@@ -49,20 +39,7 @@ void DyscoDataColumn::Prepare(DyscoDistribution distribution,
   }
 }
 
-void DyscoDataColumn::initializeDecode(TimeBlockBuffer<data_t> * /*buffer*/,
-                                       const float *metaBuffer, size_t nRow,
-                                       size_t nAntennae) {
-  _decoder->InitializeDecode(metaBuffer, nRow, nAntennae);
-}
-
-void DyscoDataColumn::decode(TimeBlockBuffer<data_t> *buffer,
-                             const unsigned int *data, size_t blockRow,
-                             size_t a1, size_t a2) {
-  _decoder->Decode(*_gausEncoder, *buffer, data, blockRow, a1, a2);
-}
-
-std::unique_ptr<ThreadedDyscoColumn<std::complex<float>>::ThreadDataBase>
-DyscoDataColumn::initializeEncodeThread() {
+std::unique_ptr<TimeBlockEncoder> DyscoDataColumn::createEncoder() const {
   const size_t nPolarizations = shape()[0], nChannels = shape()[1];
   std::unique_ptr<TimeBlockEncoder> encoder;
   switch (_normalization) {
@@ -76,21 +53,69 @@ DyscoDataColumn::initializeEncodeThread() {
       encoder.reset(new RowTimeBlockEncoder(nPolarizations, nChannels));
       break;
   }
-  std::unique_ptr<ThreadData> newThreadData(new ThreadData(std::move(encoder)));
-  // Seed every thread from a random number
-  if (_randomize)
-    newThreadData->rnd.seed(_rnd());
-  else
-    std::cout << "Warning: New thread NOT seeded.\n";
-  return newThreadData;
+  return encoder;
+}
+
+std::unique_ptr<ThreadedDyscoColumn<std::complex<float>>::ThreadDataBase>
+DyscoDataColumn::initializeDecodeThread() {
+  return std::unique_ptr<ThreadDataBase>(new ThreadData(createEncoder()));
+}
+
+void DyscoDataColumn::initializeDecode(ThreadDataBase *threadData,
+                                       const float *metaBuffer, size_t nRow,
+                                       size_t nAntennae) {
+  ThreadData &data = static_cast<ThreadData &>(*threadData);
+  data.encoder->InitializeDecode(metaBuffer, nRow, nAntennae);
+}
+
+void DyscoDataColumn::decode(ThreadDataBase *threadData,
+                             const unsigned char *packedSymbols,
+                             size_t blockRow, size_t a1, size_t a2,
+                             data_t *destination) {
+  ThreadData &decoderData = static_cast<ThreadData &>(*threadData);
+  decoderData.encoder->DecodeRowPacked(*_gausEncoder, packedSymbols,
+                                       getBitsPerSymbol(), blockRow, a1, a2,
+                                       destination);
+}
+
+void DyscoDataColumn::decodeSlice(ThreadDataBase *threadData,
+                                  const unsigned int *data, size_t blockRow,
+                                  size_t a1, size_t a2, const RowSlice &slice,
+                                  data_t *destination) {
+  ThreadData &decoderData = static_cast<ThreadData &>(*threadData);
+  decoderData.encoder->DecodeRowSlice(*_gausEncoder, data, blockRow, a1, a2,
+                                      slice, destination);
+}
+
+std::unique_ptr<ThreadedDyscoColumn<std::complex<float>>::ThreadDataBase>
+DyscoDataColumn::initializeEncodeThread() {
+  std::unique_ptr<TimeBlockEncoder> encoder = createEncoder();
+  // Large blocks are split over the threads of the pool, so that encoding
+  // does not stall when only a few blocks are being encoded.
+  encoder->SetParallelFor(
+      [](size_t nTasks, const std::function<void(size_t)> &task) {
+        ThreadPool::Instance().ParallelFor(nTasks, task);
+      });
+  return std::unique_ptr<ThreadDataBase>(new ThreadData(std::move(encoder)));
 }
 
 void DyscoDataColumn::encode(ThreadDataBase *threadData,
                              TimeBlockBuffer<data_t> *buffer, float *metaBuffer,
-                             symbol_t *symbolBuffer, size_t nAntennae) {
+                             symbol_t *symbolBuffer, size_t nAntennae,
+                             size_t blockIndex) {
   ThreadData &data = static_cast<ThreadData &>(*threadData);
-  data.encoder->EncodeWithDithering(*_gausEncoder, *buffer, metaBuffer,
-                                    symbolBuffer, nAntennae, data.rnd);
+  // Every block of every column is dithered with its own stream
+  const uint64_t stream =
+      (uint64_t(OffsetInBlock()) << 32) | uint32_t(blockIndex);
+  if (_ditherGenerator == DitherGenerator::kXoshiro) {
+    Xoshiro256x4 rnd(_seed, stream);
+    data.encoder->EncodeWithDithering(*_gausEncoder, *buffer, metaBuffer,
+                                      symbolBuffer, nAntennae, rnd);
+  } else {
+    Philox4x32 rnd(_seed, stream);
+    data.encoder->EncodeWithDithering(*_gausEncoder, *buffer, metaBuffer,
+                                      symbolBuffer, nAntennae, rnd);
+  }
 }
 
 size_t DyscoDataColumn::metaDataFloatCount(size_t nRows, size_t nPolarizations,
@@ -104,14 +129,4 @@ size_t DyscoDataColumn::symbolCount(size_t nRowsInBlock, size_t nPolarizations,
   return _decoder->SymbolCount(nRowsInBlock, nPolarizations, nChannels);
 }
 
-size_t DyscoDataColumn::defaultThreadCount() const {
-  if (!_randomize) {
-    std::cout
-        << "Warning: using only one thread to avoid randomizing the results.\n";
-    return 1;
-  } else {
-    return ThreadedDyscoColumn::defaultThreadCount();
-  }
-}
-
 }  // namespace dyscostman
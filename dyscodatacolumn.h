@@ -3,6 +3,7 @@
 
 #include "threadeddyscocolumn.h"
 
+#include "dyscodithergenerator.h"
 #include "stochasticencoder.h"
 #include "timeblockencoder.h"
 
@@ -23,43 +24,61 @@ class DyscoDataColumn final : public ThreadedDyscoColumn<std::complex<float>> {
    */
   DyscoDataColumn(DyscoStMan *parent, int dtype)
       : ThreadedDyscoColumn(parent, dtype),
-        _rnd(std::random_device{}()),
+        _seed(std::random_device{}()),
         _gausEncoder(),
         _distribution(GaussianDistribution),
         _normalization(Normalization::kRF),
-        _randomize(true) {}
+        _ditherGenerator(DitherGenerator::kPhilox) {}
 
   DyscoDataColumn(const DyscoDataColumn &source) = delete;
 
   void operator=(const DyscoDataColumn &source) = delete;
 
   /** Destructor. */
-  virtual ~DyscoDataColumn() { shutdown(); }
+  virtual ~DyscoDataColumn() { shutdownInDestructor(); }
 
   virtual void Prepare(DyscoDistribution distribution,
                        Normalization normalization, double studentsTNu,
                        double distributionTruncation) override;
 
+  /**
+   * Use a fixed seed for the dithering. Since every block is dithered with its
+   * own stream that only depends on the seed, the column and the block index,
+   * the output is then reproducible for any number of encoding threads.
+   */
   void SetStaticRandomizationSeed() {
     std::cout
         << "Warning: Initializing random number generator with static seed!\n";
-    _rnd = std::mt19937();
-    _randomize = false;
+    _seed = 0;
+  }
+
+  /** Select the random generator for the dither values. */
+  void SetDitherGenerator(DitherGenerator ditherGenerator) {
+    _ditherGenerator = ditherGenerator;
   }
 
  protected:
-  virtual void initializeDecode(TimeBlockBuffer<data_t> *buffer,
+  virtual std::unique_ptr<ThreadDataBase> initializeDecodeThread() override;
+
+  virtual void initializeDecode(ThreadDataBase *threadData,
                                 const float *metaBuffer, size_t nRow,
                                 size_t nAntennae) override;
 
-  virtual void decode(TimeBlockBuffer<data_t> *buffer, const symbol_t *data,
-                      size_t blockRow, size_t a1, size_t a2) override;
+  virtual void decode(ThreadDataBase *threadData,
+                      const unsigned char *packedSymbols, size_t blockRow,
+                      size_t a1, size_t a2, data_t *destination) override;
+
+  virtual void decodeSlice(ThreadDataBase *threadData, const symbol_t *data,
+                           size_t blockRow, size_t a1, size_t a2,
+                           const RowSlice &slice,
+                           data_t *destination) override;
 
   virtual std::unique_ptr<ThreadDataBase> initializeEncodeThread() override;
 
   virtual void encode(ThreadDataBase *threadData,
                       TimeBlockBuffer<data_t> *buffer, float *metaBuffer,
-                      symbol_t *symbolBuffer, size_t nAntennae) override;
+                      symbol_t *symbolBuffer, size_t nAntennae,
+                      size_t blockIndex) override;
 
   virtual size_t metaDataFloatCount(size_t nRow, size_t nPolarizations,
                                     size_t nChannels,
@@ -68,23 +87,22 @@ class DyscoDataColumn final : public ThreadedDyscoColumn<std::complex<float>> {
   virtual size_t symbolCount(size_t nRowsInBlock, size_t nPolarizations,
                              size_t nChannels) const override;
 
-  virtual size_t defaultThreadCount() const override;
-
  private:
   struct ThreadData final : public ThreadDataBase {
     ThreadData(std::unique_ptr<TimeBlockEncoder> timeBlockEncoder)
         : encoder(std::move(timeBlockEncoder)) {}
     std::unique_ptr<TimeBlockEncoder> encoder;
-    std::mt19937 rnd;
   };
 
-  std::mt19937 _rnd;
+  std::unique_ptr<TimeBlockEncoder> createEncoder() const;
+
+  uint64_t _seed;
   std::unique_ptr<StochasticEncoder<float>> _gausEncoder;
   std::unique_ptr<TimeBlockEncoder> _decoder;
   DyscoDistribution _distribution;
   Normalization _normalization;
+  DitherGenerator _ditherGenerator;
   double _studentsTNu;
-  bool _randomize;
 };
 
 }  // namespace dyscostman
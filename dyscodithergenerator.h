@@ -0,0 +1,14 @@
+#ifndef DYSCO_DITHER_GENERATOR_H
+#define DYSCO_DITHER_GENERATOR_H
+
+namespace dyscostman {
+/**
+ * Random generator that produces the dither values. kPhilox is the
+ * counter-based Philox4x32 generator, which allows splitting a block over
+ * threads. kXoshiro is the faster Xoshiro256x4 generator, with which a block is
+ * quantized by a single thread.
+ */
+enum class DitherGenerator { kPhilox, kXoshiro };
+}
+
+#endif
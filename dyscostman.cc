@@ -11,7 +11,13 @@ void register_dyscostman() { dyscostman::DyscoStMan::registerClass(); }
 namespace dyscostman {
 
 const unsigned short DyscoStMan::VERSION_MAJOR = 1,
-                     DyscoStMan::VERSION_MINOR = 0;
+                     DyscoStMan::VERSION_MINOR = 1;
+
+namespace {
+// Amount of compressed data that may wait for the I/O thread before the
+// encoding threads block
+constexpr size_t kMaxWriteBacklogSize = 64 * 1024 * 1024;
+}  // namespace
 
 DyscoStMan::DyscoStMan(unsigned dataBitCount, unsigned weightBitCount,
                        const casacore::String &name)
@@ -29,7 +35,12 @@ DyscoStMan::DyscoStMan(unsigned dataBitCount, unsigned weightBitCount,
       _normalization(Normalization::kAF),
       _studentTNu(0.0),
       _distributionTruncation(2.5),
-      _staticSeed(false) {}
+      _staticSeed(false),
+      _ditherGenerator(DitherGenerator::kPhilox),
+      _encoderThreadCount(0),
+      _writeCacheBlockCount(0),
+      _readAheadBlockCount(0),
+      _decodedCacheSize(0) {}
 
 DyscoStMan::DyscoStMan(const casacore::String &name,
                        const casacore::Record &spec)
@@ -47,7 +58,12 @@ DyscoStMan::DyscoStMan(const casacore::String &name,
       _normalization(Normalization::kAF),
       _studentTNu(0.0),
       _distributionTruncation(0.0),
-      _staticSeed(false) {
+      _staticSeed(false),
+      _ditherGenerator(DitherGenerator::kPhilox),
+      _encoderThreadCount(0),
+      _writeCacheBlockCount(0),
+      _readAheadBlockCount(0),
+      _decodedCacheSize(0) {
   setFromSpec(spec);
 }
 
@@ -66,7 +82,12 @@ DyscoStMan::DyscoStMan(const DyscoStMan &source)
       _normalization(source._normalization),
       _studentTNu(source._studentTNu),
       _distributionTruncation(source._distributionTruncation),
-      _staticSeed(source._staticSeed) {}
+      _staticSeed(source._staticSeed),
+      _ditherGenerator(source._ditherGenerator),
+      _encoderThreadCount(source._encoderThreadCount),
+      _writeCacheBlockCount(source._writeCacheBlockCount),
+      _readAheadBlockCount(source._readAheadBlockCount),
+      _decodedCacheSize(source._decodedCacheSize) {}
 
 void DyscoStMan::setFromSpec(const casacore::Record &spec) {
   // Here we need to load from _spec
@@ -106,6 +127,39 @@ void DyscoStMan::setFromSpec(const casacore::Record &spec) {
       _studentTNu = 0.0;
     _distributionTruncation = spec.asDouble("distributionTruncation");
   }
+  if (spec.description().fieldNumber("encoderThreads") >= 0) {
+    const int threadCount = spec.asInt("encoderThreads");
+    if (threadCount < 0)
+      throw DyscoStManError("Invalid number of encoder threads specified");
+    _encoderThreadCount = threadCount;
+  }
+  if (spec.description().fieldNumber("writeCacheBlocks") >= 0) {
+    const int blockCount = spec.asInt("writeCacheBlocks");
+    if (blockCount < 0)
+      throw DyscoStManError("Invalid write cache size specified");
+    _writeCacheBlockCount = blockCount;
+  }
+  if (spec.description().fieldNumber("readAheadBlocks") >= 0) {
+    const int blockCount = spec.asInt("readAheadBlocks");
+    if (blockCount < 0)
+      throw DyscoStManError("Invalid read-ahead size specified");
+    _readAheadBlockCount = blockCount;
+  }
+  if (spec.description().fieldNumber("decodedCacheSize") >= 0) {
+    const int size = spec.asInt("decodedCacheSize");
+    if (size < 0)
+      throw DyscoStManError("Invalid decoded cache size specified");
+    _decodedCacheSize = size;
+  }
+  if (spec.description().fieldNumber("ditherGenerator") >= 0) {
+    const std::string str = spec.asString("ditherGenerator");
+    if (str == "Philox")
+      _ditherGenerator = DitherGenerator::kPhilox;
+    else if (str == "Xoshiro")
+      _ditherGenerator = DitherGenerator::kXoshiro;
+    else
+      throw DyscoStManError("Unsupported dither generator specified");
+  }
 }
 
 void DyscoStMan::makeEmpty() {
@@ -115,7 +169,11 @@ void DyscoStMan::makeEmpty() {
   _columns.clear();
 }
 
-DyscoStMan::~DyscoStMan() { makeEmpty(); }
+DyscoStMan::~DyscoStMan() {
+  makeEmpty();
+  // Write the remaining blocks before the file is closed
+  _blockWriter.reset();
+}
 
 casacore::Record DyscoStMan::dataManagerSpec() const {
   casacore::Record spec;
@@ -152,15 +210,39 @@ casacore::Record DyscoStMan::dataManagerSpec() const {
   spec.define("normalization", normStr);
   spec.define("studentTNu", _studentTNu);
   spec.define("distributionTruncation", _distributionTruncation);
+  spec.define("encoderThreads", int(_encoderThreadCount));
+  spec.define("writeCacheBlocks", int(_writeCacheBlockCount));
+  spec.define("readAheadBlocks", int(_readAheadBlockCount));
+  spec.define("decodedCacheSize", int(_decodedCacheSize));
+  const std::string generatorStr =
+      _ditherGenerator == DitherGenerator::kXoshiro ? "Xoshiro" : "Philox";
+  spec.define("ditherGenerator", generatorStr);
   return spec;
 }
 
+size_t DyscoStMan::DecodedCacheHits() const {
+  size_t hits = 0;
+  for (const std::unique_ptr<DyscoStManColumn> &col : _columns)
+    hits += col->DecodedCacheHits();
+  return hits;
+}
+
+size_t DyscoStMan::ReadAheadHits() const {
+  size_t hits = 0;
+  for (const std::unique_ptr<DyscoStManColumn> &col : _columns)
+    hits += col->ReadAheadHits();
+  return hits;
+}
+
 void DyscoStMan::registerClass() {
   DataManager::registerCtor("DyscoStMan", makeObject);
 }
 
 casacore::Bool DyscoStMan::flush(casacore::AipsIO &,
                                  casacore::Bool /*doFsync*/) {
+  for (std::unique_ptr<DyscoStManColumn> &col : _columns)
+    col->ThrowIfEncodingFailed();
+  if (_blockWriter) _blockWriter->Flush();
   return false;
 }
 
@@ -173,9 +255,28 @@ void DyscoStMan::create(casacore::uInt nRow) {
     throw DyscoStManError("I/O error: could not create new file '" +
                           fileName() + "'");
   _nBlocksInFile = 0;
+  startBlockWriter();
+}
+
+void DyscoStMan::startBlockWriter() {
+  _blockWriter.reset();
+  _blockWriter.reset(new BlockWriter(
+      [this](uint64_t offset, const unsigned char *data, size_t size) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _fStream->seekp(offset, std::ios_base::beg);
+        _fStream->write(reinterpret_cast<const char *>(data), size);
+        if (_fStream->fail())
+          throw DyscoStManError("I/O error: error while writing file '" +
+                                fileName() + "'");
+      },
+      kMaxWriteBacklogSize));
 }
 
 void DyscoStMan::writeHeader() {
+  // The header size determines the offsets of the blocks, so blocks that are
+  // still pending need to be written first
+  if (_blockWriter) _blockWriter->Flush();
+  std::lock_guard<std::mutex> lock(_mutex);
   _fStream->seekp(0, std::ios_base::beg);
   Header header;
   header.columnCount = _columns.size();
@@ -184,7 +285,12 @@ void DyscoStMan::writeHeader() {
   header.antennaCount = _antennaCount;
   header.blockSize = _blockSize;
   header.versionMajor = VERSION_MAJOR;
-  header.versionMinor = VERSION_MINOR;
+  // Version 1.1 adds the dither generator. Files that use the default
+  // generator are written as version 1.0, so that older versions can read
+  // them.
+  header.versionMinor =
+      _ditherGenerator == DitherGenerator::kPhilox ? 0 : VERSION_MINOR;
+  header.ditherGenerator = static_cast<uint8_t>(_ditherGenerator);
   header.dataBitCount = _dataBitCount;
   header.weightBitCount = _weightBitCount;
   header.distribution = _distribution;
@@ -227,16 +333,26 @@ void DyscoStMan::readHeader() {
   _normalization = (enum Normalization)header.normalization;
   _studentTNu = header.studentTNu;
   _distributionTruncation = header.distributionTruncation;
+  _ditherGenerator = static_cast<DitherGenerator>(header.ditherGenerator);
   _rowsPerBlock = header.rowsPerBlock;
   _antennaCount = header.antennaCount;
   _blockSize = header.blockSize;
 
-  if (header.versionMajor != 1 || header.versionMinor != 0) {
+  if (header.versionMajor != VERSION_MAJOR ||
+      header.versionMinor > VERSION_MINOR) {
     std::stringstream s;
     s << "The compressed file has file format version " << header.versionMajor
       << "." << header.versionMinor
-      << ", but this version of Dysco can only open file format version 1.0. "
-         "Upgrade Dysco.\n";
+      << ", but this version of Dysco can only open file format versions 1.0 "
+         "and 1.1. Upgrade Dysco.\n";
+    throw DyscoStManError(s.str());
+  }
+
+  if (_ditherGenerator != DitherGenerator::kPhilox &&
+      _ditherGenerator != DitherGenerator::kXoshiro) {
+    std::stringstream s;
+    s << "The DyscoStMan file uses an unknown dither generator ("
+      << unsigned(header.ditherGenerator) << ") -- is the file corrupted?";
     throw DyscoStManError(s.str());
   }
 
@@ -302,6 +418,7 @@ void DyscoStMan::open(casacore::uInt nRow, casacore::AipsIO &) {
     _nBlocksInFile = (size_t(size) - _headerSize) / _blockSize;
   else
     _nBlocksInFile = 0;
+  startBlockWriter();
 }
 
 casacore::DataManagerColumn *DyscoStMan::makeScalarColumn(
@@ -355,12 +472,17 @@ void DyscoStMan::prepare() {
     throw DyscoStManError(
         "One of the required parameters of the DyscoStMan was not "
         "set!\nDyscoStMan was not correctly initialized by your program.");
+  if (_dataBitCount < 2 || _dataBitCount > 16)
+    throw DyscoStManError("The data bit rate should be between 2 and 16");
+  if (_weightBitCount > 16)
+    throw DyscoStManError("The weight bit rate should be between 1 and 16");
 
   for (std::unique_ptr<DyscoStManColumn> &col : _columns) {
     DyscoDataColumn *dataCol = dynamic_cast<DyscoDataColumn *>(col.get());
-    if (dataCol)
+    if (dataCol) {
       dataCol->SetBitsPerSymbol(_dataBitCount);
-    else {
+      dataCol->SetDitherGenerator(_ditherGenerator);
+    } else {
       DyscoWeightColumn *wghtCol = dynamic_cast<DyscoWeightColumn *>(col.get());
       if (wghtCol) wghtCol->SetBitsPerSymbol(_weightBitCount);
     }
@@ -413,11 +535,12 @@ void DyscoStMan::removeColumn(casacore::DataManagerColumn *column) {
 void DyscoStMan::readCompressedData(size_t blockIndex,
                                     const DyscoStManColumn *column,
                                     unsigned char *dest, size_t size) {
-  std::lock_guard<std::mutex> lock(_mutex);
-  size_t fileOffset = getFileOffset(blockIndex);
+  const size_t offset = getFileOffset(blockIndex) + column->OffsetInBlock();
+  // The block might still be in the backlog of the I/O thread
+  _blockWriter->WaitWhilePending(offset, size);
 
-  size_t columnOffset = column->OffsetInBlock();
-  _fStream->seekg(fileOffset + columnOffset, std::ios_base::beg);
+  std::lock_guard<std::mutex> lock(_mutex);
+  _fStream->seekg(offset, std::ios_base::beg);
   _fStream->read(reinterpret_cast<char *>(dest), size);
   if (_fStream->fail()) {
     // This can be sort of ok ; row exists because other columns have written
@@ -432,16 +555,16 @@ void DyscoStMan::readCompressedData(size_t blockIndex,
 void DyscoStMan::writeCompressedData(size_t blockIndex,
                                      const DyscoStManColumn *column,
                                      const unsigned char *data, size_t size) {
-  std::lock_guard<std::mutex> lock(_mutex);
-  if (_nBlocksInFile <= blockIndex) {
-    _nBlocksInFile = blockIndex + 1;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_nBlocksInFile <= blockIndex) {
+      _nBlocksInFile = blockIndex + 1;
+    }
   }
-  size_t fileOffset = getFileOffset(blockIndex);
-  _fStream->seekp(fileOffset + column->OffsetInBlock(), std::ios_base::beg);
-  _fStream->write(reinterpret_cast<const char *>(data), size);
-  if (_fStream->fail())
-    throw DyscoStManError("I/O error: error while writing file '" + fileName() +
-                          "'");
+  // The data is copied into the backlog of the I/O thread, so the encoding
+  // thread does not wait for the disk
+  _blockWriter->Write(getFileOffset(blockIndex) + column->OffsetInBlock(),
+                      data, size);
 }
 
 }  // namespace dyscostman
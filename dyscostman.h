@@ -11,7 +11,9 @@
 #include <mutex>
 #include <vector>
 
+#include "blockwriter.h"
 #include "dyscodistribution.h"
+#include "dyscodithergenerator.h"
 #include "dysconormalization.h"
 #include "threadgroup.h"
 #include "uvector.h"
@@ -51,9 +53,10 @@ class DyscoStMan : public casacore::DataManager {
    * initialized to AF normalization with a truncated Gaussian distribution for
    * the quantization, and a truncation of sigma = 2.5. To change the settings,
    * use one of the Set...Distribution() methods and SetNormalization().
-   * @param dataBitRate The number of bits per float used for visibilities.
+   * @param dataBitRate The number of bits per float used for visibilities,
+   * from 2 to 16.
    * @param weightBitRate The number of bits per float used for the weight
-   * column.
+   * column, from 1 to 16.
    * @param name Storage manager name.
    */
   DyscoStMan(unsigned dataBitRate, unsigned weightBitRate,
@@ -124,6 +127,104 @@ class DyscoStMan : public casacore::DataManager {
 
   void SetStaticSeed(bool staticSeed) { _staticSeed = staticSeed; }
 
+  /**
+   * Select the random generator for the dither values. The choice is stored
+   * in the file, so that it is also used when rows are added to an existing
+   * measurement set. Files that use the default Philox generator keep file
+   * format version 1.0, so older versions of Dysco can still read them. This
+   * method should only be called directly after creating DyscoStMan, before
+   * adding columns, and reading/writing data.
+   */
+  void SetDitherGenerator(DitherGenerator ditherGenerator) {
+    _ditherGenerator = ditherGenerator;
+  }
+
+  DitherGenerator GetDitherGenerator() const { return _ditherGenerator; }
+
+  /**
+   * Set the number of threads that every column uses for encoding. The
+   * threads are taken from a pool that is shared by all columns in the
+   * process, which has one thread per core. This method should only be called
+   * directly after creating DyscoStMan, before adding columns, and
+   * reading/writing data.
+   * @param threadCount Number of encoding threads per column, or zero to use
+   * the number of available cores, limited to 8.
+   */
+  void SetEncoderThreadCount(unsigned threadCount) {
+    _encoderThreadCount = threadCount;
+  }
+
+  /**
+   * Number of encoding threads per column as set by SetEncoderThreadCount().
+   * @returns Thread count, or zero when the count is determined automatically.
+   */
+  unsigned EncoderThreadCount() const { return _encoderThreadCount; }
+
+  /**
+   * Set the maximum number of blocks per column that are kept in memory
+   * while waiting to be encoded. This method should only be called directly
+   * after creating DyscoStMan, before adding columns, and reading/writing
+   * data.
+   * @param blockCount Write cache size in blocks, or zero to use 1.2 times the
+   * number of encoding threads plus one.
+   */
+  void SetWriteCacheBlockCount(unsigned blockCount) {
+    _writeCacheBlockCount = blockCount;
+  }
+
+  /**
+   * Size of the write cache as set by SetWriteCacheBlockCount().
+   * @returns Number of blocks, or zero when the size is determined
+   * automatically.
+   */
+  unsigned WriteCacheBlockCount() const { return _writeCacheBlockCount; }
+
+  /**
+   * Set the number of blocks per column that are decoded in the background
+   * while reading. When a block is read, the blocks that follow it are
+   * decoded by the shared thread pool, which speeds up reading the columns in
+   * row order. Unlike the other settings, this may also be changed after
+   * opening an existing measurement set.
+   * @param blockCount Number of blocks to read ahead, or zero to disable
+   * read-ahead.
+   */
+  void SetReadAheadBlockCount(unsigned blockCount) {
+    _readAheadBlockCount = blockCount;
+  }
+
+  /**
+   * Number of blocks that are read ahead, as set by SetReadAheadBlockCount().
+   */
+  unsigned ReadAheadBlockCount() const { return _readAheadBlockCount; }
+
+  /**
+   * Set the maximum size of the cache of decoded blocks that each column keeps
+   * for reading. Blocks that were read recently are kept in this cache, so
+   * that switching back to such a block does not require decoding it again.
+   * Like SetReadAheadBlockCount(), this may be changed after opening an
+   * existing measurement set.
+   * @param sizeInMB Size per column in megabytes, or zero to disable the cache.
+   */
+  void SetDecodedCacheSize(unsigned sizeInMB) { _decodedCacheSize = sizeInMB; }
+
+  /**
+   * Size of the cache of decoded blocks in megabytes, as set by
+   * SetDecodedCacheSize().
+   */
+  unsigned DecodedCacheSize() const { return _decodedCacheSize; }
+
+  /**
+   * Number of blocks that the columns took from their cache of decoded
+   * blocks, summed over the columns. Useful to tune SetDecodedCacheSize().
+   */
+  size_t DecodedCacheHits() const;
+
+  /**
+   * Number of blocks that the columns took from the blocks that were read
+   * ahead, summed over the columns. Useful to tune SetReadAheadBlockCount().
+   */
+  size_t ReadAheadHits() const;
+
   /**
    * This constructor is called by Casa when it needs to create a DyscoStMan.
    * Casa will call makeObject() that will call this constructor.
@@ -315,6 +416,9 @@ class DyscoStMan : public casacore::DataManager {
   void writeCompressedData(size_t blockIndex, const DyscoStManColumn *column,
                            const unsigned char *data, size_t size);
 
+  /** Start the write-behind stage for _fStream. */
+  void startBlockWriter();
+
   void readHeader();
 
   void writeHeader();
@@ -390,8 +494,14 @@ class DyscoStMan : public casacore::DataManager {
   uint32_t _blockSize;
 
   unsigned _headerSize;
+  /** Protects the file stream and the number of blocks in the file. */
   mutable std::mutex _mutex;
   std::unique_ptr<std::fstream> _fStream;
+  /**
+   * Writes the compressed blocks to _fStream on a separate thread. Exists while
+   * the file is open.
+   */
+  std::unique_ptr<BlockWriter> _blockWriter;
 
   std::string _name;
   unsigned _dataBitCount;
@@ -400,6 +510,11 @@ class DyscoStMan : public casacore::DataManager {
   Normalization _normalization;
   double _studentTNu, _distributionTruncation;
   bool _staticSeed;
+  DitherGenerator _ditherGenerator;
+  unsigned _encoderThreadCount;
+  unsigned _writeCacheBlockCount;
+  unsigned _readAheadBlockCount;
+  unsigned _decodedCacheSize;
 
   std::vector<std::unique_ptr<DyscoStManColumn>> _columns;
 };
@@ -36,6 +36,23 @@ class DyscoStManColumn : public casacore::StManColumn {
   /** To be called before destructing the class. */
   virtual void shutdown() = 0;
 
+  /**
+   * Rethrow an error that occurred while encoding or writing a block in the
+   * background, if any.
+   */
+  virtual void ThrowIfEncodingFailed() = 0;
+
+  /**
+   * Number of times that a block to be read was found in the cache of decoded
+   * blocks.
+   */
+  virtual size_t DecodedCacheHits() const = 0;
+
+  /**
+   * Number of times that a block to be read had already been read ahead.
+   */
+  virtual size_t ReadAheadHits() const = 0;
+
   /**
    * Whether this column is writable
    * @returns @c true
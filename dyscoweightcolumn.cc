@@ -12,23 +12,40 @@ void DyscoWeightColumn::Prepare(DyscoDistribution distribution,
                                         1 << getBitsPerSymbol()));
 }
 
-void DyscoWeightColumn::initializeDecode(TimeBlockBuffer<data_t> * /*buffer*/,
+std::unique_ptr<ThreadedDyscoColumn<float>::ThreadDataBase>
+DyscoWeightColumn::initializeDecodeThread() {
+  return std::unique_ptr<ThreadDataBase>(new ThreadData(*_encoder));
+}
+
+void DyscoWeightColumn::initializeDecode(ThreadDataBase *threadData,
                                          const float *metaBuffer,
                                          size_t /*nRow*/,
                                          size_t /*nAntennae*/) {
-  _encoder->InitializeDecode(metaBuffer);
+  static_cast<ThreadData &>(*threadData).decoder.InitializeDecode(metaBuffer);
+}
+
+void DyscoWeightColumn::decode(ThreadDataBase *threadData,
+                               const unsigned char *packedSymbols,
+                               size_t blockRow, size_t /*a1*/, size_t /*a2*/,
+                               data_t *destination) {
+  static_cast<ThreadData &>(*threadData)
+      .decoder.Decode(packedSymbols, getBitsPerSymbol(), blockRow,
+                      destination);
 }
 
-void DyscoWeightColumn::decode(TimeBlockBuffer<data_t> *buffer,
-                               const unsigned int *data, size_t blockRow,
-                               size_t /*a1*/, size_t /*a2*/) {
-  _encoder->Decode(*buffer, data, blockRow);
+void DyscoWeightColumn::decodeSlice(ThreadDataBase *threadData,
+                                    const unsigned int *data, size_t blockRow,
+                                    size_t /*a1*/, size_t /*a2*/,
+                                    const RowSlice &slice,
+                                    data_t *destination) {
+  static_cast<ThreadData &>(*threadData)
+      .decoder.Decode(data, blockRow, slice, destination);
 }
 
 void DyscoWeightColumn::encode(ThreadDataBase * /*threadData*/,
                                TimeBlockBuffer<data_t> *buffer,
                                float *metaBuffer, symbol_t *symbolBuffer,
-                               size_t /*nAntennae*/) {
+                               size_t /*nAntennae*/, size_t /*blockIndex*/) {
   _encoder->Encode(*buffer, metaBuffer, symbolBuffer);
 }
 
@@ -28,19 +28,27 @@ class DyscoWeightColumn final : public ThreadedDyscoColumn<float> {
   void operator=(const DyscoWeightColumn &source) = delete;
 
   /** Destructor. */
-  virtual ~DyscoWeightColumn() { shutdown(); }
+  virtual ~DyscoWeightColumn() { shutdownInDestructor(); }
 
   virtual void Prepare(DyscoDistribution distribution,
                        Normalization normalization, double studentsTNu,
                        double distributionTruncation) override;
 
  protected:
-  virtual void initializeDecode(TimeBlockBuffer<data_t> *buffer,
+  virtual std::unique_ptr<ThreadDataBase> initializeDecodeThread() override;
+
+  virtual void initializeDecode(ThreadDataBase *threadData,
                                 const float *metaBuffer, size_t nRow,
                                 size_t nAntennae) override;
 
-  virtual void decode(TimeBlockBuffer<data_t> *buffer, const symbol_t *data,
-                      size_t blockRow, size_t a1, size_t a2) override;
+  virtual void decode(ThreadDataBase *threadData,
+                      const unsigned char *packedSymbols, size_t blockRow,
+                      size_t a1, size_t a2, data_t *destination) override;
+
+  virtual void decodeSlice(ThreadDataBase *threadData, const symbol_t *data,
+                           size_t blockRow, size_t a1, size_t a2,
+                           const RowSlice &slice,
+                           data_t *destination) override;
 
   virtual std::unique_ptr<ThreadDataBase> initializeEncodeThread() override {
     return nullptr;
@@ -48,7 +56,8 @@ class DyscoWeightColumn final : public ThreadedDyscoColumn<float> {
 
   virtual void encode(ThreadDataBase *threadData,
                       TimeBlockBuffer<data_t> *buffer, float *metaBuffer,
-                      symbol_t *symbolBuffer, size_t nAntennae) override;
+                      symbol_t *symbolBuffer, size_t nAntennae,
+                      size_t blockIndex) override;
 
   virtual size_t metaDataFloatCount(size_t /*nRows*/, size_t /*nPolarizations*/,
                                     size_t /*nChannels*/,
@@ -62,6 +71,12 @@ class DyscoWeightColumn final : public ThreadedDyscoColumn<float> {
   }
 
  private:
+  struct ThreadData final : public ThreadDataBase {
+    ThreadData(const WeightBlockEncoder &weightEncoder)
+        : decoder(weightEncoder) {}
+    WeightBlockEncoder decoder;
+  };
+
   std::unique_ptr<WeightBlockEncoder> _encoder;
 };
 
@@ -31,11 +31,19 @@ struct Header : public Serializable {
   uint8_t normalization;
   double studentTNu, distributionTruncation;
 
+  /** Only stored from version 1.1 onwards; zero (Philox) for version 1.0 */
+  uint8_t ditherGenerator = 0;
+
   uint32_t calculateColumnHeaderOffset() const {
     return 7 * 4 +                              // 6 x uint32 + string length
            storageManagerName.size() + 2 * 2 +  // 2 x uint16
            4 * 1 +                              // 4 x uint8
-           2 * 8;                               // 2 x double
+           2 * 8 +                              // 2 x double
+           (hasDitherGenerator() ? 1 : 0);      // uint8
+  }
+
+  bool hasDitherGenerator() const {
+    return versionMajor > 1 || (versionMajor == 1 && versionMinor >= 1);
   }
 
   virtual void Serialize(std::ostream &stream) const final override {
@@ -54,6 +62,7 @@ struct Header : public Serializable {
     SerializeToUInt8(stream, normalization);
     SerializeToDouble(stream, studentTNu);
     SerializeToDouble(stream, distributionTruncation);
+    if (hasDitherGenerator()) SerializeToUInt8(stream, ditherGenerator);
   }
 
   virtual void Unserialize(std::istream &stream) final override {
@@ -77,6 +86,10 @@ struct Header : public Serializable {
     normalization = UnserializeUInt8(stream);
     studentTNu = UnserializeDouble(stream);
     distributionTruncation = UnserializeDouble(stream);
+    if (hasDitherGenerator())
+      ditherGenerator = UnserializeUInt8(stream);
+    else
+      ditherGenerator = 0;
   }
 
   // the column headers start here (first generic header, then column specific
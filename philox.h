@@ -0,0 +1,201 @@
+#ifndef DYSCO_PHILOX_H
+#define DYSCO_PHILOX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "cpufeatures.h"
+
+namespace dyscostman {
+
+/**
+ * Counter-based random number generator Philox4x32-10 (Salmon et al., 2011,
+ * "Parallel random numbers: as easy as 1, 2, 3"). Every value is a function
+ * of a key, a stream index and the position in the stream, so independent
+ * streams can be created for every block and every position can be sought
+ * directly. This makes the generated values independent of the order in which
+ * blocks are encoded and of the number of threads.
+ *
+ * The class satisfies the UniformRandomBitGenerator requirements, so it can be
+ * used with the standard random distributions.
+ */
+class Philox4x32 {
+ public:
+  typedef uint32_t result_type;
+
+  /**
+   * Construct the generator for a given stream.
+   * @param key The key, e.g. a random seed.
+   * @param stream Index of the stream. Different streams with the same key
+   * are independent.
+   */
+  Philox4x32(uint64_t key, uint64_t stream)
+      : _key{uint32_t(key), uint32_t(key >> 32)},
+        _counter{0, 0, uint32_t(stream), uint32_t(stream >> 32)},
+        _outputIndex(4) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() {
+    if (_outputIndex == 4) {
+      Generate(_counter, _key, _output);
+      increment();
+      _outputIndex = 0;
+    }
+    return _output[_outputIndex++];
+  }
+
+  /**
+   * Fill a buffer with the next values of the stream. The values are the same
+   * as those returned by calling operator() for every element, but are
+   * generated for eight counters at a time when the CPU supports AVX2.
+   */
+  void Fill(result_type *values, size_t count) {
+    for (; count != 0 && _outputIndex != 4; --count)
+      *values++ = _output[_outputIndex++];
+    size_t blockCount = count / 4;
+#ifdef DYSCO_AVX2_KERNELS
+    if (HasAvx2()) {
+      for (; blockCount >= 8; blockCount -= 8) {
+        generate8(values);
+        values += 32;
+      }
+    }
+#endif
+    for (; blockCount != 0; --blockCount) {
+      Generate(_counter, _key, values);
+      increment();
+      values += 4;
+    }
+    for (count %= 4; count != 0; --count) *values++ = operator()();
+  }
+
+  /**
+   * Move to the given position in the stream, such that the next call to
+   * operator() returns the value with that index.
+   */
+  void Seek(uint64_t position) {
+    _counter[0] = uint32_t(position / 4);
+    _counter[1] = uint32_t((position / 4) >> 32);
+    _outputIndex = 4;
+    const unsigned skip = position % 4;
+    if (skip != 0) {
+      operator()();
+      _outputIndex = skip;
+    }
+  }
+
+  /**
+   * Index of the value that is returned by the next call to operator().
+   */
+  uint64_t Position() const {
+    const uint64_t counter = (uint64_t(_counter[1]) << 32) | _counter[0];
+    return counter * 4 - (4 - _outputIndex);
+  }
+
+  /**
+   * Calculate the four output values for a single counter value.
+   */
+  static void Generate(const uint32_t counter[4], const uint32_t key[2],
+                       uint32_t output[4]) {
+    uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+    uint32_t k[2] = {key[0], key[1]};
+    for (size_t round = 0; round != 10; ++round) {
+      if (round != 0) {
+        k[0] += 0x9E3779B9;
+        k[1] += 0xBB67AE85;
+      }
+      const uint64_t product0 = uint64_t(0xD2511F53) * c[0];
+      const uint64_t product1 = uint64_t(0xCD9E8D57) * c[2];
+      const uint32_t hi0 = product0 >> 32, lo0 = uint32_t(product0);
+      const uint32_t hi1 = product1 >> 32, lo1 = uint32_t(product1);
+      c[0] = hi1 ^ c[1] ^ k[0];
+      c[1] = lo1;
+      c[2] = hi0 ^ c[3] ^ k[1];
+      c[3] = lo0;
+    }
+    for (size_t i = 0; i != 4; ++i) output[i] = c[i];
+  }
+
+ private:
+  void increment() {
+    ++_counter[0];
+    if (_counter[0] == 0) ++_counter[1];
+  }
+
+#ifdef DYSCO_AVX2_KERNELS
+  /**
+   * Calculate the output of the next eight counters, like Generate() does for
+   * a single counter, and advance the counter. Every 64-bit lane holds one
+   * 32-bit word of a counter, so that _mm256_mul_epu32() gives the full
+   * products. Requires HasAvx2().
+   */
+  DYSCO_TARGET_AVX2 void generate8(result_type *values) {
+    const uint64_t start = (uint64_t(_counter[1]) << 32) | _counter[0];
+    const __m256i lowMask = _mm256_set1_epi64x(0xFFFFFFFF);
+    __m256i c[2][4];
+    for (size_t half = 0; half != 2; ++half) {
+      const __m256i counter = _mm256_add_epi64(
+          _mm256_set1_epi64x(start + half * 4), _mm256_set_epi64x(3, 2, 1, 0));
+      c[half][0] = _mm256_and_si256(counter, lowMask);
+      c[half][1] = _mm256_srli_epi64(counter, 32);
+      c[half][2] = _mm256_set1_epi64x(_counter[2]);
+      c[half][3] = _mm256_set1_epi64x(_counter[3]);
+    }
+    const __m256i multiplier0 = _mm256_set1_epi64x(0xD2511F53);
+    const __m256i multiplier1 = _mm256_set1_epi64x(0xCD9E8D57);
+    uint32_t k[2] = {_key[0], _key[1]};
+    for (size_t round = 0; round != 10; ++round) {
+      if (round != 0) {
+        k[0] += 0x9E3779B9;
+        k[1] += 0xBB67AE85;
+      }
+      const __m256i key0 = _mm256_set1_epi64x(k[0]);
+      const __m256i key1 = _mm256_set1_epi64x(k[1]);
+      for (size_t half = 0; half != 2; ++half) {
+        const __m256i product0 = _mm256_mul_epu32(c[half][0], multiplier0);
+        const __m256i product1 = _mm256_mul_epu32(c[half][2], multiplier1);
+        c[half][0] = _mm256_xor_si256(
+            _mm256_xor_si256(_mm256_srli_epi64(product1, 32), c[half][1]),
+            key0);
+        c[half][1] = _mm256_and_si256(product1, lowMask);
+        c[half][2] = _mm256_xor_si256(
+            _mm256_xor_si256(_mm256_srli_epi64(product0, 32), c[half][3]),
+            key1);
+        c[half][3] = _mm256_and_si256(product0, lowMask);
+      }
+    }
+    for (size_t half = 0; half != 2; ++half) {
+      // Combine the words into the order of the output: words 0 and 1 of
+      // counter i are in lane i of a, words 2 and 3 in lane i of b.
+      const __m256i a =
+          _mm256_or_si256(c[half][0], _mm256_slli_epi64(c[half][1], 32));
+      const __m256i b =
+          _mm256_or_si256(c[half][2], _mm256_slli_epi64(c[half][3], 32));
+      const __m256i low = _mm256_unpacklo_epi64(a, b);
+      const __m256i high = _mm256_unpackhi_epi64(a, b);
+      __m256i *destination = reinterpret_cast<__m256i *>(values + half * 16);
+      _mm256_storeu_si256(destination,
+                          _mm256_permute2x128_si256(low, high, 0x20));
+      _mm256_storeu_si256(destination + 1,
+                          _mm256_permute2x128_si256(low, high, 0x31));
+    }
+    const uint64_t next = start + 8;
+    _counter[0] = uint32_t(next);
+    _counter[1] = uint32_t(next >> 32);
+  }
+#endif
+
+  uint32_t _key[2];
+  uint32_t _counter[4];
+  uint32_t _output[4];
+  unsigned _outputIndex;
+};
+
+}  // namespace dyscostman
+
+#endif
@@ -1,4 +1,5 @@
 #include "rftimeblockencoder.h"
+#include "bytepacker.h"
 #include "stochasticencoder.h"
 
 #include <random>
@@ -7,109 +8,100 @@ RFTimeBlockEncoder::RFTimeBlockEncoder(size_t nPol, size_t nChannels)
     : _nPol(nPol),
       _nChannels(nChannels),
       _channelFactors(_nChannels * nPol),
-      _rowFactors(),
-      _ditherDist(
-          dyscostman::StochasticEncoder<double>::GetDitherDistribution()) {}
+      _rowFactors() {}
 
 RFTimeBlockEncoder::~RFTimeBlockEncoder() = default;
 
-void RFTimeBlockEncoder::maximizeRows(std::vector<DBufferRow> &data, float *metaBuffer,
-    double maxLevel) const {
+void RFTimeBlockEncoder::maximizeRows(const FBuffer &data, float *metaBuffer,
+                                      double maxLevel) {
   // Scale rows: Scale every row maximum to the max level.
   // Polarizations are processed separately: every polarization
   // has its own row-scaling factor.
   const size_t visPerRow = _nPol * _nChannels;
-  for (size_t rowIndex = 0; rowIndex != data.size(); ++rowIndex) {
-    DBufferRow &row = data[rowIndex];
-    for (size_t polIndex = 0; polIndex != _nPol; ++polIndex) {
-      double max_val = 0.0;
-      for (size_t channel = 0; channel != _nChannels; ++channel) {
-        std::complex<double> v = row.visibilities[channel * _nPol + polIndex];
-        double m = std::max(std::fabs(v.real()), std::fabs(v.imag()));
-        if (std::isfinite(m))
-          max_val = std::max(max_val, m);
-      }
-      const double factor = max_val == 0.0
-                                ? 1.0
-                                : maxLevel / max_val;
-      for (size_t channel = 0; channel != _nChannels; ++channel) {
-       row.visibilities[channel * _nPol + polIndex] *= factor;
-      }
+  forEachRange(data.NRows(), visPerRow, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t rowIndex = rowBegin; rowIndex != rowEnd; ++rowIndex) {
+      const std::complex<float> *row = data.Row(rowIndex);
+      for (size_t polIndex = 0; polIndex != _nPol; ++polIndex) {
+        double max_val = 0.0;
+        for (size_t channel = 0; channel != _nChannels; ++channel) {
+          const std::complex<float> v = row[channel * _nPol + polIndex];
+          double m = std::max(std::fabs(v.real()), std::fabs(v.imag()));
+          if (std::isfinite(m)) max_val = std::max(max_val, m);
+        }
+        const double factor = max_val == 0.0 ? 1.0 : maxLevel / max_val;
+        _encodeRowFactors[rowIndex * _nPol + polIndex] = factor;
 
-      metaBuffer[visPerRow + rowIndex * _nPol + polIndex] =
-          (maxLevel == 0.0) ? 1.0 : max_val / maxLevel;
+        metaBuffer[visPerRow + rowIndex * _nPol + polIndex] =
+            (maxLevel == 0.0) ? 1.0 : max_val / maxLevel;
+      }
     }
-  }
+  });
 }
 
-void RFTimeBlockEncoder::maximizeChannels(std::vector<DBufferRow> &data, float *metaBuffer,
-    double maxLevel) const {
+void RFTimeBlockEncoder::maximizeChannels(const FBuffer &data,
+                                          float *metaBuffer, double maxLevel) {
   const size_t visPerRow = _nPol * _nChannels;
   // Scale channels: channels are scaled such that the maximum
-  // value equals the maximum encodable value
-  for (size_t visIndex = 0; visIndex != visPerRow; ++visIndex) {
-    double largest_component = 0.0;
-    for (const DBufferRow &row : data) {
-      const std::complex<double> *ptr = &row.visibilities[visIndex];
-      const double local_max = std::max(std::fabs(ptr->real()), std::fabs(ptr->imag()));
-      if (std::isfinite(local_max) && local_max > largest_component)
-        largest_component = local_max;
-    }
-    const double factor =
-        (maxLevel == 0.0 || largest_component == 0.0)
-            ? 1.0
-            : maxLevel / largest_component;
-    metaBuffer[visIndex] = 1.0 / factor;
-    for (RFTimeBlockEncoder::DBufferRow &row : data) {
-      row.visibilities[visIndex] *= factor;
+  // value equals the maximum encodable value. The channel and polarization
+  // ranges are processed in parallel.
+  forEachRange(visPerRow, data.NRows(), [&](size_t visBegin, size_t visEnd) {
+    for (size_t visIndex = visBegin; visIndex != visEnd; ++visIndex) {
+      const size_t polIndex = visIndex % _nPol;
+      double largest_component = 0.0;
+      for (size_t rowIndex = 0; rowIndex != data.NRows(); ++rowIndex) {
+        const std::complex<double> v =
+            std::complex<double>(data.Row(rowIndex)[visIndex]) *
+            _encodeRowFactors[rowIndex * _nPol + polIndex];
+        const double local_max =
+            std::max(std::fabs(v.real()), std::fabs(v.imag()));
+        if (std::isfinite(local_max) && local_max > largest_component)
+          largest_component = local_max;
+      }
+      const double factor = (maxLevel == 0.0 || largest_component == 0.0)
+                                ? 1.0
+                                : maxLevel / largest_component;
+      metaBuffer[visIndex] = 1.0 / factor;
+      _encodeVisFactors[visIndex] = factor;
     }
-  }
+  });
 }
 
-template <bool UseDithering>
+template <bool UseDithering, typename RandomGenerator>
 void RFTimeBlockEncoder::encode(
     const dyscostman::StochasticEncoder<float> &gausEncoder,
     const TimeBlockEncoder::FBuffer &buffer, float *metaBuffer,
     TimeBlockEncoder::symbol_t *symbolBuffer, size_t /*antennaCount*/,
-    std::mt19937 *rnd) {
-  // Note that encoding is performed with doubles
-  std::vector<DBufferRow> data;
-  buffer.ConvertVector<std::complex<double>>(data);
-  const size_t visPerRow = _nPol * _nChannels;
+    RandomGenerator *rnd) {
+  initializeEncodeFactors(buffer);
 
   // Rows are processed before
   // channels, because auto-correlations might have much
   // higher values compared to cross-correlations. By first
   // scaling the rows, the auto-correlations and cross-correlations
   // are brought to the same level.
-  maximizeRows(data, metaBuffer, gausEncoder.MaxQuantity());
-
-  maximizeChannels(data, metaBuffer, gausEncoder.MaxQuantity());
-
-  symbol_t *symbolBufferPtr = symbolBuffer;
-  for (const DBufferRow &row : data) {
-    for (size_t i = 0; i != visPerRow; ++i) {
-      if (UseDithering) {
-        symbolBufferPtr[i * 2] = gausEncoder.EncodeWithDithering(
-            row.visibilities[i].real(), _ditherDist(*rnd));
-        symbolBufferPtr[i * 2 + 1] = gausEncoder.EncodeWithDithering(
-            row.visibilities[i].imag(), _ditherDist(*rnd));
-      } else {
-        symbolBufferPtr[i * 2] = gausEncoder.Encode(row.visibilities[i].real());
-        symbolBufferPtr[i * 2 + 1] =
-            gausEncoder.Encode(row.visibilities[i].imag());
-      }
-    }
-    symbolBufferPtr += visPerRow * 2;
-  }
+  maximizeRows(buffer, metaBuffer, gausEncoder.MaxQuantity());
+
+  maximizeChannels(buffer, metaBuffer, gausEncoder.MaxQuantity());
+
+  quantize<UseDithering>(gausEncoder, buffer, symbolBuffer, rnd);
 }
 
-template void RFTimeBlockEncoder::encode<true>(
+template void RFTimeBlockEncoder::encode<true, std::mt19937>(
     const dyscostman::StochasticEncoder<float> &gausEncoder,
     const TimeBlockEncoder::FBuffer &buffer, float *metaBuffer,
     TimeBlockEncoder::symbol_t *symbolBuffer, size_t,
     std::mt19937 *rnd);
-template void RFTimeBlockEncoder::encode<false>(
+template void RFTimeBlockEncoder::encode<true, dyscostman::Philox4x32>(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const TimeBlockEncoder::FBuffer &buffer, float *metaBuffer,
+    TimeBlockEncoder::symbol_t *symbolBuffer, size_t,
+    dyscostman::Philox4x32 *rnd);
+template void RFTimeBlockEncoder::encode<true, dyscostman::Xoshiro256x4>(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const TimeBlockEncoder::FBuffer &buffer, float *metaBuffer,
+    TimeBlockEncoder::symbol_t *symbolBuffer, size_t,
+    dyscostman::Xoshiro256x4 *rnd);
+template void RFTimeBlockEncoder::encode<false, std::mt19937>(
     const dyscostman::StochasticEncoder<float> &gausEncoder,
     const TimeBlockEncoder::FBuffer &buffer, float *metaBuffer,
     TimeBlockEncoder::symbol_t *symbolBuffer, size_t,
@@ -122,25 +114,59 @@ void RFTimeBlockEncoder::InitializeDecode(const float *metaBuffer, size_t nRow,
   _rowFactors.assign(metaBuffer, metaBuffer + _nPol * nRow);
 }
 
-void RFTimeBlockEncoder::Decode(
+void RFTimeBlockEncoder::decodeRow(
     const dyscostman::StochasticEncoder<float> &gausEncoder,
-    TimeBlockEncoder::FBuffer &buffer,
-    const TimeBlockEncoder::symbol_t *symbolBuffer, size_t blockRow,
-    size_t antenna1, size_t antenna2) {
-  FBufferRow &row = buffer[blockRow];
-  row.antenna1 = antenna1;
-  row.antenna2 = antenna2;
-  row.visibilities.resize(_nChannels * _nPol);
-  std::complex<float> *destination = row.visibilities.data();
-  const symbol_t *srcRowPtr = symbolBuffer + blockRow * SymbolsPerRow();
+    const TimeBlockEncoder::symbol_t *symbols, size_t blockRow,
+    size_t /*antenna1*/, size_t /*antenna2*/,
+    std::complex<float> *destination) {
   const size_t visPerRow = _nPol * _nChannels;
+  _decodeFactors.resize(visPerRow);
   for (size_t i = 0; i != visPerRow; ++i) {
     double chFactor = _channelFactors[i];
-    double factor = chFactor * _rowFactors[blockRow * _nPol + i % _nPol];
-    destination->real(double(gausEncoder.Decode(*srcRowPtr)) * factor);
-    ++srcRowPtr;
-    destination->imag(double(gausEncoder.Decode(*srcRowPtr)) * factor);
-    ++srcRowPtr;
-    ++destination;
+    _decodeFactors[i] = chFactor * _rowFactors[blockRow * _nPol + i % _nPol];
+  }
+  gausEncoder.DecodeComplexBatch(symbols, _decodeFactors.data(), visPerRow,
+                                 destination);
+}
+
+void RFTimeBlockEncoder::DecodeRow(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const TimeBlockEncoder::symbol_t *symbolBuffer, size_t blockRow,
+    size_t antenna1, size_t antenna2, std::complex<float> *destination) {
+  decodeRow(gausEncoder, symbolBuffer + blockRow * SymbolsPerRow(), blockRow,
+            antenna1, antenna2, destination);
+}
+
+void RFTimeBlockEncoder::DecodeRowPacked(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const unsigned char *packedSymbols, unsigned bitCount, size_t blockRow,
+    size_t antenna1, size_t antenna2, std::complex<float> *destination) {
+  _rowSymbols.resize(SymbolsPerRow());
+  dyscostman::BytePacker::readSymbols(
+      bitCount, packedSymbols, blockRow * SymbolsPerRow(),
+      [&](auto readSymbol) {
+        for (symbol_t &symbol : _rowSymbols) symbol = readSymbol();
+      });
+  decodeRow(gausEncoder, _rowSymbols.data(), blockRow, antenna1, antenna2,
+            destination);
+}
+
+void RFTimeBlockEncoder::DecodeRowSlice(
+    const dyscostman::StochasticEncoder<float> &gausEncoder,
+    const TimeBlockEncoder::symbol_t *symbolBuffer, size_t blockRow,
+    size_t /*antenna1*/, size_t /*antenna2*/, const RowSlice &slice,
+    std::complex<float> *destination) {
+  const symbol_t *srcRowPtr = symbolBuffer + blockRow * SymbolsPerRow();
+  for (size_t c = 0; c != slice.channelCount; ++c) {
+    const size_t ch = slice.channelStart + c * slice.channelStride;
+    for (size_t i = 0; i != slice.polarizationCount; ++i) {
+      const size_t p = slice.polarizationStart + i * slice.polarizationStride;
+      double factor = _channelFactors[ch * _nPol + p] *
+                      _rowFactors[blockRow * _nPol + p];
+      const symbol_t *srcPtr = srcRowPtr + (ch * _nPol + p) * 2;
+      destination->real(double(gausEncoder.Decode(srcPtr[0])) * factor);
+      destination->imag(double(gausEncoder.Decode(srcPtr[1])) * factor);
+      ++destination;
+    }
   }
 }
@@ -0,0 +1,27 @@
+#ifndef DYSCO_ROW_SLICE_H
+#define DYSCO_ROW_SLICE_H
+
+#include <cstddef>
+
+/**
+ * Selection of channels and polarizations of a row, for decoding part of a
+ * row. The selected values are ordered by channel and then by polarization,
+ * like the values of a full row.
+ */
+struct RowSlice {
+  size_t polarizationStart;
+  size_t polarizationCount;
+  size_t polarizationStride;
+  size_t channelStart;
+  size_t channelCount;
+  size_t channelStride;
+
+  /** Number of selected values. */
+  size_t Size() const { return polarizationCount * channelCount; }
+
+  size_t LastChannel() const {
+    return channelStart + (channelCount - 1) * channelStride;
+  }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "rowtimeblockencoder.h"
+#include "bytepacker.h"
 #include "stochasticencoder.h"
 
 using namespace dyscostman;
@@ -6,7 +7,6 @@ using namespace dyscostman;
 RowTimeBlockEncoder::RowTimeBlockEncoder(size_t nPol, size_t nChannels)
     : _nPol(nPol),
       _nChannels(nChannels),
-      _ditherDist(StochasticEncoder<float>::GetDitherDistribution()),
       _rowFactors() {}
 
 void RowTimeBlockEncoder::InitializeDecode(const float *metaBuffer, size_t nRow,
@@ -14,77 +14,101 @@ void RowTimeBlockEncoder::InitializeDecode(const float *metaBuffer, size_t nRow,
   _rowFactors.assign(metaBuffer, metaBuffer + nRow);
 }
 
-void RowTimeBlockEncoder::Decode(const StochasticEncoder<float> &gausEncoder,
-                                 FBuffer &buffer, const symbol_t *symbolBuffer,
-                                 size_t blockRow, size_t antenna1,
-                                 size_t antenna2) {
-  FBufferRow &row = buffer[blockRow];
-  row.antenna1 = antenna1;
-  row.antenna2 = antenna2;
-  row.visibilities.resize(_nChannels * _nPol);
-  std::complex<float> *destination = row.visibilities.data();
-  const symbol_t *srcRowPtr = symbolBuffer + blockRow * SymbolsPerRow();
+void RowTimeBlockEncoder::decodeRow(
+    const StochasticEncoder<float> &gausEncoder, const symbol_t *symbols,
+    size_t blockRow, size_t /*antenna1*/, size_t /*antenna2*/,
+    std::complex<float> *destination) {
   const size_t visPerRow = _nPol * _nChannels;
-  for (size_t i = 0; i != visPerRow; ++i) {
-    double factor = _rowFactors[blockRow];
-    destination->real(double(gausEncoder.Decode(*srcRowPtr)) * factor);
-    ++srcRowPtr;
-    destination->imag(double(gausEncoder.Decode(*srcRowPtr)) * factor);
-    ++srcRowPtr;
-    ++destination;
+  _decodeFactors.assign(visPerRow, _rowFactors[blockRow]);
+  gausEncoder.DecodeComplexBatch(symbols, _decodeFactors.data(), visPerRow,
+                                 destination);
+}
+
+void RowTimeBlockEncoder::DecodeRow(
+    const StochasticEncoder<float> &gausEncoder, const symbol_t *symbolBuffer,
+    size_t blockRow, size_t antenna1, size_t antenna2,
+    std::complex<float> *destination) {
+  decodeRow(gausEncoder, symbolBuffer + blockRow * SymbolsPerRow(), blockRow,
+            antenna1, antenna2, destination);
+}
+
+void RowTimeBlockEncoder::DecodeRowPacked(
+    const StochasticEncoder<float> &gausEncoder,
+    const unsigned char *packedSymbols, unsigned bitCount, size_t blockRow,
+    size_t antenna1, size_t antenna2, std::complex<float> *destination) {
+  _rowSymbols.resize(SymbolsPerRow());
+  BytePacker::readSymbols(
+      bitCount, packedSymbols, blockRow * SymbolsPerRow(),
+      [&](auto readSymbol) {
+        for (symbol_t &symbol : _rowSymbols) symbol = readSymbol();
+      });
+  decodeRow(gausEncoder, _rowSymbols.data(), blockRow, antenna1, antenna2,
+            destination);
+}
+
+void RowTimeBlockEncoder::DecodeRowSlice(
+    const StochasticEncoder<float> &gausEncoder, const symbol_t *symbolBuffer,
+    size_t blockRow, size_t /*antenna1*/, size_t /*antenna2*/,
+    const RowSlice &slice, std::complex<float> *destination) {
+  const symbol_t *srcRowPtr = symbolBuffer + blockRow * SymbolsPerRow();
+  const double factor = _rowFactors[blockRow];
+  for (size_t c = 0; c != slice.channelCount; ++c) {
+    const size_t ch = slice.channelStart + c * slice.channelStride;
+    for (size_t i = 0; i != slice.polarizationCount; ++i) {
+      const size_t p = slice.polarizationStart + i * slice.polarizationStride;
+      const symbol_t *srcPtr = srcRowPtr + (ch * _nPol + p) * 2;
+      destination->real(double(gausEncoder.Decode(srcPtr[0])) * factor);
+      destination->imag(double(gausEncoder.Decode(srcPtr[1])) * factor);
+      ++destination;
+    }
   }
 }
 
-template <bool UseDithering>
+template <bool UseDithering, typename RandomGenerator>
 void RowTimeBlockEncoder::encode(const StochasticEncoder<float> &gausEncoder,
                                  const FBuffer &buffer, float *metaBuffer,
                                  symbol_t *symbolBuffer,
-                                 size_t /*antennaCount*/, std::mt19937 *rnd) {
-  // Note that encoding is performed with doubles
-  std::vector<DBufferRow> data;
-  buffer.ConvertVector<std::complex<double>>(data);
+                                 size_t /*antennaCount*/,
+                                 RandomGenerator *rnd) {
   const size_t visPerRow = _nPol * _nChannels;
+  initializeEncodeFactors(buffer);
 
   // Scale every maximum per row to the max level
   const double maxLevel = gausEncoder.MaxQuantity();
-  for (size_t rowIndex = 0; rowIndex != data.size(); ++rowIndex) {
-    DBufferRow &row = data[rowIndex];
-    double maxVal = 0.0;
-    for (size_t i = 0; i != visPerRow; ++i) {
-      std::complex<double> v = row.visibilities[i];
-      double m = std::max(std::fabs(v.real()), std::fabs(v.imag()));
-      if (std::isfinite(m)) maxVal = std::max(maxVal, m);
-    }
-    const double factor = (maxVal == 0.0) ? 1.0 : maxLevel / maxVal;
-    for (size_t i = 0; i != visPerRow; ++i) row.visibilities[i] *= factor;
-    metaBuffer[rowIndex] = maxVal / maxLevel;
-  }
-
-  symbol_t *symbolBufferPtr = symbolBuffer;
-  for (const DBufferRow &row : data) {
-    for (size_t i = 0; i != visPerRow; ++i) {
-      if (UseDithering) {
-        symbolBufferPtr[i * 2] = gausEncoder.EncodeWithDithering(
-            row.visibilities[i].real(), _ditherDist(*rnd));
-        symbolBufferPtr[i * 2 + 1] = gausEncoder.EncodeWithDithering(
-            row.visibilities[i].imag(), _ditherDist(*rnd));
-      } else {
-        symbolBufferPtr[i * 2] = gausEncoder.Encode(row.visibilities[i].real());
-        symbolBufferPtr[i * 2 + 1] =
-            gausEncoder.Encode(row.visibilities[i].imag());
+  forEachRange(buffer.NRows(), visPerRow, [&](size_t rowBegin, size_t rowEnd) {
+    for (size_t rowIndex = rowBegin; rowIndex != rowEnd; ++rowIndex) {
+      const std::complex<float> *row = buffer.Row(rowIndex);
+      double maxVal = 0.0;
+      for (size_t i = 0; i != visPerRow; ++i) {
+        double m = std::max(std::fabs(row[i].real()), std::fabs(row[i].imag()));
+        if (std::isfinite(m)) maxVal = std::max(maxVal, m);
       }
+      const double factor = (maxVal == 0.0) ? 1.0 : maxLevel / maxVal;
+      std::fill_n(&_encodeRowFactors[rowIndex * _nPol], _nPol, factor);
+      metaBuffer[rowIndex] = maxVal / maxLevel;
     }
-    symbolBufferPtr += visPerRow * 2;
-  }
+  });
+
+  quantize<UseDithering>(gausEncoder, buffer, symbolBuffer, rnd);
 }
 
 template
-void RowTimeBlockEncoder::encode<false>(const StochasticEncoder<float> &gausEncoder,
+void RowTimeBlockEncoder::encode<false, std::mt19937>(const StochasticEncoder<float> &gausEncoder,
                                  const FBuffer &buffer, float *metaBuffer,
                                  symbol_t *symbolBuffer,
                                  size_t, std::mt19937 *rnd);
 template
-void RowTimeBlockEncoder::encode<true>(const StochasticEncoder<float> &gausEncoder,
+void RowTimeBlockEncoder::encode<true, std::mt19937>(const StochasticEncoder<float> &gausEncoder,
                                  const FBuffer &buffer, float *metaBuffer,
                                  symbol_t *symbolBuffer,
                                  size_t, std::mt19937 *rnd);
+template
+void RowTimeBlockEncoder::encode<true, dyscostman::Philox4x32>(const StochasticEncoder<float> &gausEncoder,
+                                 const FBuffer &buffer, float *metaBuffer,
+                                 symbol_t *symbolBuffer,
+                                 size_t, dyscostman::Philox4x32 *rnd);
+template
+void RowTimeBlockEncoder::encode<true, dyscostman::Xoshiro256x4>(const StochasticEncoder<float> &gausEncoder,
+                                 const FBuffer &buffer, float *metaBuffer,
+                                 symbol_t *symbolBuffer,
+                                 size_t, dyscostman::Xoshiro256x4 *rnd);
@@ -25,21 +25,49 @@ class RowTimeBlockEncoder : public TimeBlockEncoder {
                  &rnd);
   }
 
+  virtual void EncodeWithDithering(
+      const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
+      float *metaBuffer, symbol_t *symbolBuffer, size_t antennaCount,
+      dyscostman::Philox4x32 &rnd) final override {
+    encode<true>(gausEncoder, buffer, metaBuffer, symbolBuffer, antennaCount,
+                 &rnd);
+  }
+
+  virtual void EncodeWithDithering(
+      const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
+      float *metaBuffer, symbol_t *symbolBuffer, size_t antennaCount,
+      dyscostman::Xoshiro256x4 &rnd) final override {
+    encode<true>(gausEncoder, buffer, metaBuffer, symbolBuffer, antennaCount,
+                 &rnd);
+  }
+
   virtual void EncodeWithoutDithering(
       const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
       float *metaBuffer, symbol_t *symbolBuffer,
       size_t antennaCount) final override {
-    encode<false>(gausEncoder, buffer, metaBuffer, symbolBuffer, antennaCount,
-                  0);
+    encode<false, std::mt19937>(gausEncoder, buffer, metaBuffer, symbolBuffer,
+                                antennaCount, nullptr);
   }
 
   virtual void InitializeDecode(const float *metaBuffer, size_t nRow,
                                 size_t nAntennae) final override;
 
-  virtual void Decode(const dyscostman::StochasticEncoder<float> &gausEncoder,
-                      FBuffer &buffer, const symbol_t *symbolBuffer,
-                      size_t blockRow, size_t antenna1,
-                      size_t antenna2) final override;
+  virtual void DecodeRow(
+      const dyscostman::StochasticEncoder<float> &gausEncoder,
+      const symbol_t *symbolBuffer, size_t blockRow, size_t antenna1,
+      size_t antenna2, std::complex<float> *destination) final override;
+
+  virtual void DecodeRowPacked(
+      const dyscostman::StochasticEncoder<float> &gausEncoder,
+      const unsigned char *packedSymbols, unsigned bitCount, size_t blockRow,
+      size_t antenna1, size_t antenna2,
+      std::complex<float> *destination) final override;
+
+  virtual void DecodeRowSlice(
+      const dyscostman::StochasticEncoder<float> &gausEncoder,
+      const symbol_t *symbolBuffer, size_t blockRow, size_t antenna1,
+      size_t antenna2, const RowSlice &slice,
+      std::complex<float> *destination) final override;
 
   virtual size_t SymbolCount(size_t nRow, size_t nPol,
                              size_t nChannels) const final override {
@@ -61,15 +89,28 @@ class RowTimeBlockEncoder : public TimeBlockEncoder {
   }
 
  private:
-  template <bool UseDithering>
+  /**
+   * Decode one row from its symbols.
+   */
+  void decodeRow(const dyscostman::StochasticEncoder<float> &gausEncoder,
+                 const symbol_t *symbols, size_t blockRow, size_t antenna1,
+                 size_t antenna2, std::complex<float> *destination);
+
+  template <bool UseDithering, typename RandomGenerator>
   void encode(const dyscostman::StochasticEncoder<float> &gausEncoder,
               const FBuffer &buffer, float *metaBuffer, symbol_t *symbolBuffer,
-              size_t antennaCount, std::mt19937 *rnd);
+              size_t antennaCount, RandomGenerator *rnd);
 
   size_t _nPol, _nChannels;
 
-  std::uniform_int_distribution<unsigned> _ditherDist;
   aocommon::UVector<double> _rowFactors;
+
+  /**
+   * Scratch buffers of the decoding: the factor of every value of a row, and
+   * the unpacked symbols of a row in DecodeRowPacked().
+   */
+  aocommon::UVector<double> _decodeFactors;
+  aocommon::UVector<symbol_t> _rowSymbols;
 };
 
 #endif
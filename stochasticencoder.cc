@@ -119,6 +119,8 @@ StochasticEncoder<ValueType>::StochasticEncoder(size_t quantCount,
   // we know it behaves OK in this case. This will make sure that
   // lower_bound() never sees the NaN.
   *decItem = std::numeric_limits<ValueType>::quiet_NaN();
+
+  initializeLookupTables();
 }
 
 template <typename ValueType>
@@ -140,6 +142,8 @@ void StochasticEncoder<ValueType>::initializeStudentT(double nu, double rms) {
   }
   *encItem = std::numeric_limits<ValueType>::max();
   *decItem = std::numeric_limits<ValueType>::quiet_NaN();
+
+  initializeLookupTables();
 }
 
 template <typename ValueType>
@@ -168,6 +172,8 @@ void StochasticEncoder<ValueType>::initializeTruncatedGaussian(
   }
   *encItem = std::numeric_limits<ValueType>::max();
   *decItem = std::numeric_limits<ValueType>::quiet_NaN();
+
+  initializeLookupTables();
 }
 
 template class StochasticEncoder<float>;
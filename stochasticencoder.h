@@ -3,7 +3,9 @@
 
 #include <algorithm>
 #include <cmath>
+#include <complex>
 #include <cstring>
+#include <limits>
 
 #include "dictionary.h"
 
@@ -19,8 +21,9 @@ namespace dyscostman {
  *
  * Encoding and decoding have asymetric time complexity / speeds, as decoding
  * is easier than encoding. Decoding is a single indexing into an array, thus
- * extremely fast and with constant time complexity. Encoding is a binary
- * search through the quantizaton values, thus takes O(log quantcount).
+ * extremely fast and with constant time complexity. Encoding is a search
+ * through the quantizaton values, which uses a lookup table to find the
+ * few values that need to be compared.
  * Typical performance of encoding is 100 MB/s.
  *
  * If the values are encoded into a number of bits which are not divisible by
@@ -52,6 +55,18 @@ class StochasticEncoder {
     return encoder;
   }
 
+  /**
+   * Create an encoder for a uniform distribution. The dictionary is the same
+   * as the one of StochasticEncoder(quantCount, rms, false), but because its
+   * boundaries are evenly spaced, the symbol of a value is calculated
+   * directly instead of searched for. The results are identical.
+   */
+  static StochasticEncoder UniformEncoder(size_t quantCount, ValueType rms) {
+    StochasticEncoder<ValueType> encoder(quantCount, rms, false);
+    encoder.initializeUniformSearch(rms);
+    return encoder;
+  }
+
   static StochasticEncoder TruncatedGausEncoder(size_t quantCount, double trunc,
                                                 double rms) {
     StochasticEncoder<ValueType> encoder(quantCount);
@@ -72,19 +87,41 @@ class StochasticEncoder {
 
   /**
    * Get the quantized symbol for the given floating point value.
-   * This method is implemented with a binary search, so takes
-   * O(log N), with N the dictionary size (2^bitcount).
+   * The value is searched with the lookup table of the dictionary, which
+   * takes at most three comparisons for the Gaussian and Student-T
+   * dictionaries (see initializeLookupTables()). The uniform encoder
+   * calculates the position instead.
    * Use Decode() on the returned symbol to get
    * the decoded value.
    * @param value Floating point value to be encoded.
    */
   symbol_t Encode(ValueType value) const {
     if (std::isfinite(value))
-      return _encDictionary.symbol(_encDictionary.lower_bound(value));
+      return _encDictionary.symbol(lowerBound(_encDictionary, value, 1.0));
     else
       return QuantizationCount() - 1;
   }
 
+  /**
+   * Encode an array of values. The result is identical to calling Encode()
+   * for every value. When the CPU supports AVX2, eight values are searched at
+   * the same time, and non-finite values are handled with a mask instead of a
+   * branch.
+   * @param symbols Receives @p count symbols.
+   */
+  void EncodeBatch(const float *values, size_t count, symbol_t *symbols) const;
+
+  /**
+   * Encode an array of values with dithering. The result is identical to
+   * calling EncodeWithDithering() for every value and its dither value.
+   * @param ditherValues One dither value per value, drawn from
+   * GetDitherDistribution().
+   * @param symbols Receives @p count symbols.
+   */
+  void EncodeWithDitheringBatch(const float *values,
+                                const unsigned *ditherValues, size_t count,
+                                symbol_t *symbols) const;
+
   static std::uniform_int_distribution<unsigned> GetDitherDistribution() {
     return std::uniform_int_distribution<unsigned>(0, ((1u << 31) - 1));
   }
@@ -93,8 +130,8 @@ class StochasticEncoder {
    * Get the quantized symbol for the given floating point value.
    * Dithering is applied, which will cause the average error to
    * converge to zero, assuming the error is uniformly distributed.
-   * This method is implemented with a binary search, so takes
-   * O(log N), with N the dictionary size (2^bitcount).
+   * The value is searched with the lookup table in the same way as in
+   * Encode().
    * Use Decode() on the returned symbol to get
    * the decoded value.
    * @param value Floating point value to be encoded.
@@ -103,7 +140,7 @@ class StochasticEncoder {
   symbol_t EncodeWithDithering(ValueType value, unsigned ditherValue) const {
     if (std::isfinite(value)) {
       const typename Dictionary::const_iterator lowerBound =
-          _decDictionary.lower_bound(value);
+          this->lowerBound(_decDictionary, value, 0.5);
       if (lowerBound == _decDictionary.begin())
         return _decDictionary.symbol(lowerBound);
       if (lowerBound == _decDictionary.end())
@@ -144,6 +181,18 @@ class StochasticEncoder {
     return _decDictionary.value(symbol);
   }
 
+  /**
+   * Decode the symbols of an array of complex values and scale them. The
+   * result is identical to calling Decode() for the real and imaginary symbol
+   * of every value and multiplying both with its factor in double precision.
+   * When the CPU supports AVX2, eight symbols are decoded with one gather.
+   * @param symbols The 2 * @p count symbols, real and imaginary interleaved.
+   * @param factors One factor per value.
+   * @param values Receives @p count values.
+   */
+  void DecodeComplexBatch(const symbol_t *symbols, const double *factors,
+                          size_t count, std::complex<float> *values) const;
+
   size_t QuantizationCount() const { return _decDictionary.size() + 1; }
 
   ValueType MaxQuantity() const { return _decDictionary.largest_value(); }
@@ -156,6 +205,70 @@ class StochasticEncoder {
 
   void initializeStudentT(double nu, double rms);
 
+  void initializeUniformSearch(ValueType rms) {
+    const ValueType stddev = rms * std::sqrt(3);
+    const ValueType halfCount = ValueType(_decDictionary.size()) / 2;
+    _uniformScale = halfCount / stddev;
+    _uniformOffset = halfCount;
+    _isUniform = true;
+  }
+
+  /**
+   * Search a value in one of the dictionaries. For a uniform encoder, the
+   * position is calculated, which is then corrected for rounding errors.
+   * @param shift Position of the first dictionary value in units of the
+   * spacing: 1 for the encoding boundaries, 0.5 for the decoding values.
+   */
+  typename Dictionary::const_iterator lowerBound(const Dictionary &dictionary,
+                                                 ValueType value,
+                                                 ValueType shift) const {
+    if (_isUniform) {
+      const ValueType position =
+          std::clamp<ValueType>(value * _uniformScale + _uniformOffset - shift,
+                                0, dictionary.size());
+      return dictionary.lower_bound_near(value, std::ceil(position));
+    } else if (dictionary.has_lookup_table()) {
+      return dictionary.lower_bound_lookup(value);
+    } else {
+      return dictionary.lower_bound(value);
+    }
+  }
+
+#ifdef DYSCO_AVX2_KERNELS
+  DYSCO_TARGET_AVX2 static __m256i lowerBoundAvx2(const Dictionary &dictionary,
+                                                  __m256 values) {
+    if (dictionary.has_lookup_table())
+      return dictionary.lower_bound_lookup_avx2(values);
+    else
+      return dictionary.lower_bound_avx2(values);
+  }
+
+  /**
+   * AVX2 kernels of the batch functions. They process the largest multiple
+   * of eight values and return that number. Require HasAvx2().
+   */
+  DYSCO_TARGET_AVX2 size_t encodeBatchAvx2(const float *values, size_t count,
+                                           symbol_t *symbols) const;
+  DYSCO_TARGET_AVX2 size_t encodeWithDitheringBatchAvx2(
+      const float *values, const unsigned *ditherValues, size_t count,
+      symbol_t *symbols) const;
+  /** Like the above, but processes the largest multiple of four values. */
+  DYSCO_TARGET_AVX2 size_t decodeComplexBatchAvx2(
+      const symbol_t *symbols, const double *factors, size_t count,
+      std::complex<float> *values) const;
+#endif
+
+  /**
+   * Create the lookup tables of the dictionaries, which make searching
+   * them faster than a binary search. With up to four buckets per value,
+   * a search takes at most three comparisons for the Gaussian and Student-T
+   * distributions up to 16 bits.
+   */
+  void initializeLookupTables() {
+    _encDictionary.create_lookup_table(_encDictionary.size() * 4);
+    _decDictionary.create_lookup_table(_decDictionary.size() * 4);
+  }
+
   void initializeTruncatedGaussian(double truncationValue, double rms);
 
   typedef long double num_t;
@@ -165,8 +278,144 @@ class StochasticEncoder {
 
   Dictionary _encDictionary;
   Dictionary _decDictionary;
+  bool _isUniform = false;
+  ValueType _uniformScale = 0;
+  ValueType _uniformOffset = 0;
 };
 
+template <typename ValueType>
+void StochasticEncoder<ValueType>::EncodeBatch(const float *values,
+                                               size_t count,
+                                               symbol_t *symbols) const {
+  size_t i = 0;
+#ifdef DYSCO_AVX2_KERNELS
+  if (HasAvx2()) i = encodeBatchAvx2(values, count, symbols);
+#endif
+  for (; i != count; ++i) symbols[i] = Encode(values[i]);
+}
+
+template <typename ValueType>
+void StochasticEncoder<ValueType>::EncodeWithDitheringBatch(
+    const float *values, const unsigned *ditherValues, size_t count,
+    symbol_t *symbols) const {
+  size_t i = 0;
+#ifdef DYSCO_AVX2_KERNELS
+  if (HasAvx2())
+    i = encodeWithDitheringBatchAvx2(values, ditherValues, count, symbols);
+#endif
+  for (; i != count; ++i)
+    symbols[i] = EncodeWithDithering(values[i], ditherValues[i]);
+}
+
+template <typename ValueType>
+void StochasticEncoder<ValueType>::DecodeComplexBatch(
+    const symbol_t *symbols, const double *factors, size_t count,
+    std::complex<float> *values) const {
+  size_t i = 0;
+#ifdef DYSCO_AVX2_KERNELS
+  if (HasAvx2()) i = decodeComplexBatchAvx2(symbols, factors, count, values);
+#endif
+  for (; i != count; ++i) {
+    values[i].real(double(Decode(symbols[i * 2])) * factors[i]);
+    values[i].imag(double(Decode(symbols[i * 2 + 1])) * factors[i]);
+  }
+}
+
+#ifdef DYSCO_AVX2_KERNELS
+template <typename ValueType>
+DYSCO_TARGET_AVX2 size_t StochasticEncoder<ValueType>::encodeBatchAvx2(
+    const float *values, size_t count, symbol_t *symbols) const {
+  const size_t vectorCount = count / 8 * 8;
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  const __m256 infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256i nonFiniteSymbol = _mm256_set1_epi32(QuantizationCount() - 1);
+  for (size_t i = 0; i != vectorCount; i += 8) {
+    const __m256 v = _mm256_loadu_ps(values + i);
+    const __m256i isFinite = _mm256_castps_si256(
+        _mm256_cmp_ps(_mm256_and_ps(v, absMask), infinity, _CMP_LT_OQ));
+    const __m256i result =
+        _mm256_blendv_epi8(nonFiniteSymbol, lowerBoundAvx2(_encDictionary, v),
+                           isFinite);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(symbols + i), result);
+  }
+  return vectorCount;
+}
+
+template <typename ValueType>
+DYSCO_TARGET_AVX2 size_t
+StochasticEncoder<ValueType>::encodeWithDitheringBatchAvx2(
+    const float *values, const unsigned *ditherValues, size_t count,
+    symbol_t *symbols) const {
+  const size_t vectorCount = count / 8 * 8;
+  const float *dictionary = _decDictionary.begin();
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  const __m256 infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 ditherScale = _mm256_set1_ps(ValueType(1u << 31));
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i size = _mm256_set1_epi32(_decDictionary.size());
+  const __m256i last = _mm256_set1_epi32(_decDictionary.size() - 1);
+  const __m256i nonFiniteSymbol = _mm256_set1_epi32(_encDictionary.size());
+  for (size_t i = 0; i != vectorCount; i += 8) {
+    const __m256 v = _mm256_loadu_ps(values + i);
+    const __m256i lowerBound = lowerBoundAvx2(_decDictionary, v);
+    // Clamp so that both neighbours are inside the dictionary; the values at
+    // the ends are replaced below
+    const __m256i right =
+        _mm256_min_epi32(_mm256_max_epi32(lowerBound, one), last);
+    const __m256i left = _mm256_sub_epi32(right, one);
+    const __m256 rightValue = _mm256_i32gather_ps(dictionary, right, 4);
+    const __m256 leftValue = _mm256_i32gather_ps(dictionary, left, 4);
+    const __m256 ditherMark =
+        _mm256_div_ps(_mm256_mul_ps(ditherScale, _mm256_sub_ps(v, leftValue)),
+                      _mm256_sub_ps(rightValue, leftValue));
+    const __m256 dither = _mm256_cvtepi32_ps(_mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(ditherValues + i)));
+    // isAbove is -1 where the right symbol is chosen
+    const __m256i isAbove =
+        _mm256_castps_si256(_mm256_cmp_ps(ditherMark, dither, _CMP_GT_OQ));
+    __m256i result = _mm256_sub_epi32(left, isAbove);
+    result = _mm256_blendv_epi8(result, zero,
+                                _mm256_cmpeq_epi32(lowerBound, zero));
+    result = _mm256_blendv_epi8(result, last,
+                                _mm256_cmpeq_epi32(lowerBound, size));
+    const __m256i isFinite = _mm256_castps_si256(
+        _mm256_cmp_ps(_mm256_and_ps(v, absMask), infinity, _CMP_LT_OQ));
+    result = _mm256_blendv_epi8(nonFiniteSymbol, result, isFinite);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(symbols + i), result);
+  }
+  return vectorCount;
+}
+
+template <typename ValueType>
+DYSCO_TARGET_AVX2 size_t StochasticEncoder<ValueType>::decodeComplexBatchAvx2(
+    const symbol_t *symbols, const double *factors, size_t count,
+    std::complex<float> *values) const {
+  const size_t vectorCount = count / 4 * 4;
+  // The symbol for non-finite values indexes the NaN that is stored after the
+  // last dictionary value
+  const float *dictionary = _decDictionary.begin();
+  for (size_t i = 0; i != vectorCount; i += 4) {
+    const __m256 decoded = _mm256_i32gather_ps(
+        dictionary,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(symbols + i * 2)),
+        4);
+    // The real and imaginary part of a value share its factor
+    const __m256d f = _mm256_loadu_pd(factors + i);
+    const __m256d low =
+        _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(decoded)),
+                      _mm256_permute4x64_pd(f, 0x50));
+    const __m256d high =
+        _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(decoded, 1)),
+                      _mm256_permute4x64_pd(f, 0xFA));
+    _mm256_storeu_ps(
+        reinterpret_cast<float *>(values + i),
+        _mm256_set_m128(_mm256_cvtpd_ps(high), _mm256_cvtpd_ps(low)));
+  }
+  return vectorCount;
+}
+#endif
+
 }  // namespace dyscostman
 
 #endif
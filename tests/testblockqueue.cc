@@ -0,0 +1,97 @@
+#include "../blockqueue.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace dyscostman;
+
+BOOST_AUTO_TEST_SUITE(block_queue)
+
+BOOST_AUTO_TEST_CASE(push_and_acquire) {
+  BlockQueue<int> queue(3);
+  BOOST_CHECK_EQUAL(queue.Capacity(), 3u);
+  BOOST_CHECK(queue.Empty());
+
+  queue.Push(7, std::unique_ptr<int>(new int(70)));
+  queue.Push(8, std::unique_ptr<int>(new int(80)));
+  BOOST_CHECK(!queue.Empty());
+  BOOST_CHECK(queue.Contains(7));
+  BOOST_CHECK(queue.Contains(8));
+  BOOST_CHECK(!queue.Contains(9));
+
+  BlockQueue<int>::Slot *slot = queue.Acquire();
+  BOOST_REQUIRE(slot != nullptr);
+  BOOST_CHECK_EQUAL(slot->blockIndex, 7u);
+  BOOST_CHECK_EQUAL(*slot->item, 70);
+  // Items that are being processed are still part of the queue
+  BOOST_CHECK(queue.Contains(7));
+  queue.Release(slot);
+  BOOST_CHECK(!queue.Contains(7));
+
+  slot = queue.Acquire();
+  BOOST_REQUIRE(slot != nullptr);
+  BOOST_CHECK_EQUAL(slot->blockIndex, 8u);
+  queue.Release(slot);
+  BOOST_CHECK(queue.Empty());
+}
+
+BOOST_AUTO_TEST_CASE(stop) {
+  BlockQueue<int> queue(2);
+  std::thread consumer([&]() { BOOST_CHECK(queue.Acquire() == nullptr); });
+  queue.Stop();
+  consumer.join();
+
+  queue.Reset(2);
+  BOOST_CHECK(queue.Push(1, std::unique_ptr<int>(new int(1))));
+  BlockQueue<int>::Slot *slot = queue.Acquire();
+  BOOST_REQUIRE(slot != nullptr);
+  BOOST_CHECK_EQUAL(slot->blockIndex, 1u);
+  queue.Release(slot);
+}
+
+BOOST_AUTO_TEST_CASE(stop_while_pushing) {
+  BlockQueue<int> queue(1);
+  BOOST_CHECK(queue.Push(1, std::unique_ptr<int>(new int(1))));
+  // The queue is full, so this waits until the queue is stopped
+  std::thread producer([&]() {
+    BOOST_CHECK(!queue.Push(2, std::unique_ptr<int>(new int(2))));
+  });
+  queue.Stop();
+  producer.join();
+  BOOST_CHECK(queue.Contains(1));
+  BOOST_CHECK(!queue.Contains(2));
+}
+
+BOOST_AUTO_TEST_CASE(multiple_consumers) {
+  constexpr size_t kNBlocks = 1000;
+  constexpr size_t kNThreads = 4;
+  BlockQueue<size_t> queue(5);
+  std::vector<std::atomic<size_t>> processed(kNBlocks);
+  for (std::atomic<size_t> &p : processed) p = 0;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i != kNThreads; ++i) {
+    threads.emplace_back([&]() {
+      while (BlockQueue<size_t>::Slot *slot = queue.Acquire()) {
+        if (*slot->item == slot->blockIndex) ++processed[slot->blockIndex];
+        queue.Release(slot);
+      }
+    });
+  }
+  for (size_t block = 0; block != kNBlocks; ++block) {
+    if (block >= 10) {
+      queue.WaitWhileQueued(block - 10);
+      BOOST_CHECK(!queue.Contains(block - 10));
+    }
+    queue.Push(block, std::unique_ptr<size_t>(new size_t(block)));
+  }
+  queue.WaitUntilEmpty();
+  queue.Stop();
+  for (std::thread &t : threads) t.join();
+  for (size_t block = 0; block != kNBlocks; ++block)
+    BOOST_CHECK_EQUAL(processed[block], 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
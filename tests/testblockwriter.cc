@@ -0,0 +1,141 @@
+#include "../blockwriter.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace dyscostman;
+
+namespace {
+// In-memory file of which the writes can be held back
+class TestFile {
+ public:
+  BlockWriter::WriteFunction Function() {
+    return [this](uint64_t offset, const unsigned char *data, size_t size) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _isWriting = true;
+      _condition.notify_all();
+      while (!_isOpen) _condition.wait(lock);
+      if (_fail) throw std::runtime_error("write failed");
+      if (contents.size() < offset + size) contents.resize(offset + size);
+      std::copy_n(data, size, contents.begin() + offset);
+      writes.emplace_back(offset, size);
+    };
+  }
+
+  /** Wait until the I/O thread has started a write. */
+  void WaitForWrite() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_isWriting) _condition.wait(lock);
+  }
+
+  void Open() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _isOpen = true;
+    _condition.notify_all();
+  }
+
+  void SetFail(bool fail) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _fail = fail;
+  }
+
+  std::vector<unsigned char> contents;
+  std::vector<std::pair<uint64_t, size_t>> writes;
+
+ private:
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  bool _isWriting = false;
+  bool _isOpen = false;
+  bool _fail = false;
+};
+
+std::vector<unsigned char> Chunk(unsigned char value) {
+  return std::vector<unsigned char>(4, value);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(block_writer)
+
+BOOST_AUTO_TEST_CASE(coalesce) {
+  TestFile file;
+  BlockWriter writer(file.Function(), 1024);
+  // The first write is taken by the I/O thread, which then waits for the file
+  writer.Write(0, Chunk(1).data(), 4);
+  file.WaitForWrite();
+  for (uint64_t offset : {12, 4, 8, 20}) {
+    writer.Write(offset, Chunk(offset).data(), 4);
+  }
+  // Replace pending data
+  writer.Write(20, Chunk(21).data(), 4);
+  // Nothing is pending in the gap
+  writer.WaitWhilePending(16, 4);
+  file.Open();
+  writer.WaitWhilePending(8, 1);
+  writer.Flush();
+
+  const std::vector<std::pair<uint64_t, size_t>> expectedWrites{
+      {0, 4}, {4, 12}, {20, 4}};
+  BOOST_CHECK(file.writes == expectedWrites);
+  BOOST_REQUIRE_EQUAL(file.contents.size(), 24u);
+  const unsigned char expectedValues[6] = {1, 4, 8, 12, 0, 21};
+  for (size_t i = 0; i != file.contents.size(); ++i)
+    BOOST_CHECK_EQUAL(file.contents[i], expectedValues[i / 4]);
+}
+
+BOOST_AUTO_TEST_CASE(backlog_limit) {
+  TestFile file;
+  BlockWriter writer(file.Function(), 8);
+  writer.Write(0, Chunk(1).data(), 4);
+  writer.Write(4, Chunk(2).data(), 4);
+  std::atomic<bool> isWritten(false);
+  std::thread thread([&]() {
+    writer.Write(8, Chunk(3).data(), 4);
+    isWritten = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  BOOST_CHECK(!isWritten);
+  file.Open();
+  thread.join();
+  BOOST_CHECK(isWritten);
+  writer.Flush();
+  BOOST_CHECK_EQUAL(file.contents.size(), 12u);
+}
+
+BOOST_AUTO_TEST_CASE(error) {
+  TestFile file;
+  BlockWriter writer(file.Function(), 1024);
+  file.SetFail(true);
+  file.Open();
+  writer.Write(0, Chunk(1).data(), 4);
+  BOOST_CHECK_THROW(writer.Flush(), std::runtime_error);
+  // The error is kept, so that later writes can not leave holes in the file
+  file.SetFail(false);
+  writer.Write(4, Chunk(2).data(), 4);
+  BOOST_CHECK_THROW(writer.Flush(), std::runtime_error);
+  BOOST_CHECK_THROW(writer.WaitWhilePending(4, 4), std::runtime_error);
+  BOOST_CHECK(file.writes.empty());
+}
+
+BOOST_AUTO_TEST_CASE(error_not_thrown_by_write) {
+  TestFile file;
+  BlockWriter writer(file.Function(), 1024);
+  file.SetFail(true);
+  file.Open();
+  writer.Write(0, Chunk(1).data(), 4);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  // Writes are done by encoding jobs, so the error is only reported by Flush()
+  BOOST_CHECK_NO_THROW(writer.Write(4, Chunk(2).data(), 4));
+  BOOST_CHECK_THROW(writer.Flush(), std::runtime_error);
+  BOOST_CHECK(file.writes.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
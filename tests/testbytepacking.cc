@@ -3,6 +3,9 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <chrono>
+#include <iostream>
+#include <random>
 #include <sstream>
 
 using namespace dyscostman;
@@ -28,8 +31,9 @@ void assertEqualArray(const T* expected, const T* actual, size_t size,
 }
 
 BOOST_AUTO_TEST_CASE(under_and_overflow) {
-  const size_t NBITSIZES = 8;
-  size_t bitSizes[NBITSIZES] = {2, 3, 4, 6, 8, 10, 12, 16};
+  const size_t NBITSIZES = 16;
+  size_t bitSizes[NBITSIZES] = {1, 2, 3,  4,  5,  6,  7,  8,
+                                9, 10, 11, 12, 13, 14, 15, 16};
   for (size_t i = 0; i != NBITSIZES; ++i) {
     for (size_t s = 0; s != 12; ++s) {
       unsigned arr[12] = {1, 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31};
@@ -111,7 +115,52 @@ void testCombinations(const aocommon::UVector<unsigned int>& data, int bitCount)
   testSingle(resizedData, bitCount);
 }
 
-const int bitrates[] = {2, 3, 4, 6, 8, 10, 12, 16};
+const int bitrates[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+
+BOOST_AUTO_TEST_CASE(unpack_range) {
+  const size_t NBITSIZES = 16;
+  size_t bitSizes[NBITSIZES] = {1, 2, 3,  4,  5,  6,  7,  8,
+                                9, 10, 11, 12, 13, 14, 15, 16};
+  for (size_t i = 0; i != NBITSIZES; ++i) {
+    unsigned arr[20];
+    for (size_t x = 0; x != 20; ++x)
+      arr[x] = (x * 7 + 3) & ((1 << bitSizes[i]) - 1);
+    unsigned char packed[40];
+    BytePacker::pack(bitSizes[i], packed, arr, 20);
+    for (size_t offset = 0; offset != 20; ++offset) {
+      for (size_t count = 1; offset + count <= 20; ++count) {
+        unsigned result[21];
+        for (size_t x = 0; x != 21; ++x) result[x] = 37;
+        BytePacker::unpackRange(bitSizes[i], result, packed, offset, count);
+        std::stringstream msg;
+        msg << "unpackRange (offset=" << offset << ",count=" << count
+            << ",bits=" << bitSizes[i] << ')';
+        assertEqualArray(&arr[offset], &result[offset], count, msg.str());
+        // Nothing is written past the range
+        BOOST_CHECK_EQUAL(result[offset + count], 37u);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(read_symbols) {
+  for (int bitCount : bitrates) {
+    unsigned arr[20];
+    for (size_t x = 0; x != 20; ++x)
+      arr[x] = (x * 7 + 3) & ((1 << bitCount) - 1);
+    unsigned char packed[40];
+    BytePacker::pack(bitCount, packed, arr, 20);
+    for (size_t offset = 0; offset != 20; ++offset) {
+      unsigned result[20];
+      BytePacker::readSymbols(bitCount, packed, offset, [&](auto readSymbol) {
+        for (size_t x = offset; x != 20; ++x) result[x] = readSymbol();
+      });
+      std::stringstream msg;
+      msg << "readSymbols (offset=" << offset << ",bits=" << bitCount << ')';
+      assertEqualArray(&arr[offset], &result[offset], 20 - offset, msg.str());
+    }
+  }
+}
 
 BOOST_AUTO_TEST_CASE(pack_unpack) {
   for (int sample : bitrates) {
@@ -125,4 +174,70 @@ BOOST_AUTO_TEST_CASE(pack_unpack) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(bit_order) {
+  // Long arrays are packed and unpacked in groups by the vectorized code, and
+  // the result is checked with the symbol reader, which reads one symbol at
+  // a time.
+  std::mt19937 rng(42);
+  for (int bitCount : bitrates) {
+    std::uniform_int_distribution<unsigned> dist(0, (1u << bitCount) - 1);
+    for (size_t symbolCount : {size_t(64), size_t(1001)}) {
+      aocommon::UVector<unsigned> symbols(symbolCount);
+      for (unsigned& symbol : symbols) symbol = dist(rng);
+      aocommon::UVector<unsigned char> packed(
+          BytePacker::bufferSize(symbolCount, bitCount));
+      BytePacker::pack(bitCount, packed.data(), symbols.data(), symbolCount);
+      aocommon::UVector<unsigned> result(symbolCount);
+      BytePacker::readSymbols(bitCount, packed.data(), 0, [&](auto readSymbol) {
+        for (unsigned& symbol : result) symbol = readSymbol();
+      });
+      std::stringstream msg;
+      msg << "readSymbols (count=" << symbolCount << ",bits=" << bitCount
+          << ')';
+      assertEqualArray(symbols.data(), result.data(), symbolCount, msg.str());
+      BytePacker::unpack(bitCount, result.data(), packed.data(), symbolCount);
+      assertEqualArray(symbols.data(), result.data(), symbolCount,
+                       "unpack " + msg.str());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(unsupported_bit_count) {
+  unsigned symbols[8] = {};
+  unsigned char packed[32];
+  BOOST_CHECK_THROW(BytePacker::pack(0, packed, symbols, 8), std::runtime_error);
+  BOOST_CHECK_THROW(BytePacker::pack(17, packed, symbols, 8),
+                    std::runtime_error);
+  BOOST_CHECK_THROW(BytePacker::unpack(17, symbols, packed, 8),
+                    std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(benchmark, *boost::unit_test::disabled()) {
+  constexpr size_t kSymbolCount = 1 << 20;
+  constexpr size_t kRepeatCount = 100;
+  std::mt19937 rng(42);
+  for (int bitCount : bitrates) {
+    std::uniform_int_distribution<unsigned> dist(0, (1u << bitCount) - 1);
+    aocommon::UVector<unsigned> symbols(kSymbolCount);
+    for (unsigned& symbol : symbols) symbol = dist(rng);
+    aocommon::UVector<unsigned char> packed(
+        BytePacker::bufferSize(kSymbolCount, bitCount));
+
+    const auto packStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i != kRepeatCount; ++i)
+      BytePacker::pack(bitCount, packed.data(), symbols.data(), kSymbolCount);
+    const auto unpackStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i != kRepeatCount; ++i)
+      BytePacker::unpack(bitCount, symbols.data(), packed.data(), kSymbolCount);
+    const auto end = std::chrono::steady_clock::now();
+
+    const double symbolTotal = double(kSymbolCount) * kRepeatCount;
+    const std::chrono::duration<double> packTime = unpackStart - packStart;
+    const std::chrono::duration<double> unpackTime = end - unpackStart;
+    std::cout << bitCount << " bits: pack "
+              << symbolTotal / packTime.count() / 1e6 << " M symbols/s, unpack "
+              << symbolTotal / unpackTime.count() / 1e6 << " M symbols/s\n";
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,68 @@
+#include "../decodedblockcache.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace dyscostman;
+
+BOOST_AUTO_TEST_SUITE(decoded_block_cache)
+
+BOOST_AUTO_TEST_CASE(hit_and_miss) {
+  DecodedBlockCache<int> cache(100);
+  BOOST_CHECK(cache.Store(3, std::unique_ptr<int>(new int(30)), 40).empty());
+  BOOST_CHECK(cache.Contains(3));
+  BOOST_CHECK_EQUAL(cache.Size(), 40u);
+
+  std::unique_ptr<int> item = cache.Take(3);
+  BOOST_REQUIRE(item);
+  BOOST_CHECK_EQUAL(*item, 30);
+  BOOST_CHECK(!cache.Contains(3));
+  BOOST_CHECK_EQUAL(cache.Size(), 0u);
+  BOOST_CHECK(!cache.Take(3));
+  BOOST_CHECK_EQUAL(cache.Hits(), 1u);
+  BOOST_CHECK_EQUAL(cache.Misses(), 1u);
+
+  // Erasing is not counted
+  cache.Store(4, std::unique_ptr<int>(new int(40)), 40);
+  BOOST_CHECK(cache.Erase(4));
+  BOOST_CHECK(!cache.Erase(4));
+  BOOST_CHECK_EQUAL(cache.Hits(), 1u);
+  BOOST_CHECK_EQUAL(cache.Misses(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(least_recently_used) {
+  DecodedBlockCache<int> cache(100);
+  cache.Store(1, std::unique_ptr<int>(new int(10)), 40);
+  cache.Store(2, std::unique_ptr<int>(new int(20)), 40);
+  // Using block 1 makes block 2 the least recently used block
+  cache.Store(1, cache.Take(1), 40);
+  std::vector<std::unique_ptr<int>> evicted =
+      cache.Store(3, std::unique_ptr<int>(new int(30)), 40);
+  BOOST_REQUIRE_EQUAL(evicted.size(), 1u);
+  BOOST_CHECK_EQUAL(*evicted[0], 20);
+  BOOST_CHECK(cache.Contains(1));
+  BOOST_CHECK(!cache.Contains(2));
+  BOOST_CHECK(cache.Contains(3));
+  BOOST_CHECK_EQUAL(cache.Size(), 80u);
+  BOOST_CHECK_EQUAL(cache.BlockCount(), 2u);
+
+  evicted = cache.SetMaxSize(50);
+  BOOST_REQUIRE_EQUAL(evicted.size(), 1u);
+  BOOST_CHECK_EQUAL(*evicted[0], 10);
+  BOOST_CHECK(cache.Contains(3));
+}
+
+BOOST_AUTO_TEST_CASE(too_large) {
+  DecodedBlockCache<int> cache(30);
+  std::vector<std::unique_ptr<int>> evicted =
+      cache.Store(1, std::unique_ptr<int>(new int(10)), 40);
+  BOOST_REQUIRE_EQUAL(evicted.size(), 1u);
+  BOOST_CHECK_EQUAL(*evicted[0], 10);
+  BOOST_CHECK(!cache.Contains(1));
+
+  DecodedBlockCache<int> disabled;
+  evicted = disabled.Store(1, std::unique_ptr<int>(new int(10)), 1);
+  BOOST_CHECK_EQUAL(evicted.size(), 1u);
+  BOOST_CHECK_EQUAL(disabled.BlockCount(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <random>
 #include <vector>
@@ -107,6 +108,28 @@ void TestLowerBound(Function lower_bound) {
   BOOST_REQUIRE(iter == small.end());
 }
 
+/**
+ * Dictionary with the quantiles of a Gaussian distribution, like the
+ * dictionaries of the Gaussian encoder.
+ */
+Dictionary MakeGaussianDictionary(size_t size, double stddev) {
+  Dictionary dict(size);
+  for (size_t i = 0; i != size; ++i) {
+    const double quantile = (i + 0.5) / size;
+    double low = -10.0;
+    double high = 10.0;
+    for (size_t iteration = 0; iteration != 64; ++iteration) {
+      const double mid = (low + high) * 0.5;
+      if (0.5 * std::erfc(-mid / std::sqrt(2.0)) < quantile)
+        low = mid;
+      else
+        high = mid;
+    }
+    dict.begin()[i] = low * stddev;
+  }
+  return dict;
+}
+
 // Prevent optimization
 volatile float sink;
 
@@ -135,6 +158,21 @@ double RunBenchmark(const Dictionary& dict,
   return seconds;
 }
 
+#ifdef DYSCO_AVX2_KERNELS
+DYSCO_TARGET_AVX2 void CheckLowerBoundLookupAvx2(const Dictionary& dict) {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  std::array<float, 8> values{nan,   -0.0f, 0.0f, -1.0f,
+                              1e-20f, 3.0f, 1e20f, -1e20f};
+  std::array<int, 8> indices;
+  _mm256_storeu_si256(
+      reinterpret_cast<__m256i*>(indices.data()),
+      dict.lower_bound_lookup_avx2(_mm256_loadu_ps(values.data())));
+  for (size_t i = 0; i != values.size(); ++i) {
+    BOOST_CHECK_EQUAL(indices[i], dict.symbol(dict.lower_bound(values[i])));
+  }
+}
+#endif
+
 } // namespace
 
 BOOST_AUTO_TEST_SUITE(dictionary)
@@ -192,6 +230,89 @@ BOOST_AUTO_TEST_CASE(lower_bound_slow) {
   });
 }
 
+BOOST_AUTO_TEST_CASE(lower_bound_near) {
+  TestLowerBound([](const Dictionary& d, float value) {
+    return d.lower_bound_near(value, 0);
+  });
+  TestLowerBound([](const Dictionary& d, float value) {
+    return d.lower_bound_near(value, d.size() / 2);
+  });
+  TestLowerBound([](const Dictionary& d, float value) {
+    return d.lower_bound_near(value, d.size());
+  });
+}
+
+BOOST_AUTO_TEST_CASE(lower_bound_lookup) {
+  for (size_t tableSize : {1, 2, 5, 16}) {
+    TestLowerBound([tableSize](const Dictionary& d, float value) {
+      Dictionary withTable(d);
+      withTable.create_lookup_table(tableSize);
+      return d.begin() + withTable.symbol(withTable.lower_bound_lookup(value));
+    });
+  }
+
+  Dictionary dict = MakeGaussianDictionary(1000, 1.0);
+  // Bounding element, as used in the encoding dictionary
+  dict.begin()[dict.size() - 1] = std::numeric_limits<float>::max();
+  // A distribution with heavy tails
+  Dictionary cauchy(1000);
+  for (size_t i = 0; i != cauchy.size(); ++i)
+    cauchy.begin()[i] = std::tan(M_PI * ((i + 0.5) / cauchy.size() - 0.5));
+  for (Dictionary* d : {&dict, &cauchy}) {
+    d->create_lookup_table(d->size() * 4);
+    BOOST_CHECK(d->has_lookup_table());
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist(0.0f, 2.0f);
+    for (size_t i = 0; i != 10000; ++i) {
+      const float value = dist(rng);
+      BOOST_CHECK(d->lower_bound_lookup(value) == d->lower_bound(value));
+    }
+    for (float value : *d) {
+      for (float v : {std::nextafter(value, -std::numeric_limits<float>::max()),
+                      value,
+                      std::nextafter(value, std::numeric_limits<float>::max())}) {
+        BOOST_CHECK(d->lower_bound_lookup(v) == d->lower_bound(v));
+      }
+    }
+  }
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  BOOST_CHECK(dict.lower_bound_lookup(nan) == dict.lower_bound(nan));
+
+#ifdef DYSCO_AVX2_KERNELS
+  if (HasAvx2()) CheckLowerBoundLookupAvx2(dict);
+#endif
+
+  dict.resize(10);
+  BOOST_CHECK(!dict.has_lookup_table());
+}
+
+BOOST_AUTO_TEST_CASE(lower_bound_lookup_benchmark,
+                     *boost::unit_test::disabled()) {
+  std::mt19937 rng(42);
+  std::normal_distribution<float> dist(0.0f, 1.0f);
+  static constexpr size_t kNQueries = 1 << 22;
+  std::vector<float> queries(kNQueries);
+  for (float& q : queries) q = dist(rng);
+
+  for (size_t bits = 4; bits <= 16; ++bits) {
+    // Same dictionary size and distribution as the Gaussian encoder uses
+    Dictionary dict =
+        MakeGaussianDictionary((size_t(1) << bits) - 1, std::sqrt(3.0));
+    std::cout << "---- " << bits << " bits ----\n";
+    RunBenchmark(dict, queries,
+      [](const Dictionary& d, float v) {
+        return d.lower_bound_branchless_two_minimum(v);
+      },
+      "branchless with assumption of 2 elements");
+    dict.create_lookup_table(4 * dict.size());
+    RunBenchmark(dict, queries,
+      [](const Dictionary& d, float v) {
+        return d.lower_bound_lookup(v);
+      },
+      "lookup table");
+  }
+}
+
 BOOST_AUTO_TEST_CASE(lower_bound_benchmark, *boost::unit_test::disabled()) {
   std::mt19937 rng(42);
   std::uniform_real_distribution<float> dist(0.0f, 1.0f);
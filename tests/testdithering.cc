@@ -1,5 +1,9 @@
+#include <chrono>
 #include <cmath>
+#include <iostream>
+#include <iterator>
 #include <random>
+#include <vector>
 
 #include "../stochasticencoder.h"
 
@@ -76,4 +80,158 @@ BOOST_AUTO_TEST_CASE(avg_deviation) {
   }
 }
 
+namespace {
+std::vector<float> MakeBatchValues(size_t n) {
+  std::mt19937 mt;
+  std::normal_distribution<float> distribution(0.0, 2.0);
+  std::vector<float> values(n);
+  for (float& v : values) v = distribution(mt);
+  // Include the values that are handled specially
+  const float special[] = {std::numeric_limits<float>::quiet_NaN(),
+                           std::numeric_limits<float>::infinity(),
+                           -std::numeric_limits<float>::infinity(),
+                           std::numeric_limits<float>::max(),
+                           std::numeric_limits<float>::lowest(),
+                           0.0f,
+                           -0.0f};
+  for (size_t i = 0; i != std::size(special); ++i) values[i * 13] = special[i];
+  return values;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(encode_batch) {
+  std::unique_ptr<StochasticEncoder<float>> encoder = MakeEncoder();
+  const std::vector<float> values = MakeBatchValues(1003);
+  std::vector<unsigned> symbols(values.size());
+  encoder->EncodeBatch(values.data(), values.size(), symbols.data());
+  for (size_t i = 0; i != values.size(); ++i)
+    BOOST_CHECK_EQUAL(symbols[i], encoder->Encode(values[i]));
+}
+
+BOOST_AUTO_TEST_CASE(encode_with_dithering_batch) {
+  std::unique_ptr<StochasticEncoder<float>> encoder = MakeEncoder();
+  const std::vector<float> values = MakeBatchValues(1003);
+  std::mt19937 mt;
+  std::uniform_int_distribution<unsigned> distribution =
+      encoder->GetDitherDistribution();
+  std::vector<unsigned> ditherValues(values.size());
+  for (unsigned& d : ditherValues) d = distribution(mt);
+  std::vector<unsigned> symbols(values.size());
+  encoder->EncodeWithDitheringBatch(values.data(), ditherValues.data(),
+                                    values.size(), symbols.data());
+  for (size_t i = 0; i != values.size(); ++i)
+    BOOST_CHECK_EQUAL(symbols[i],
+                      encoder->EncodeWithDithering(values[i], ditherValues[i]));
+}
+
+BOOST_AUTO_TEST_CASE(decode_complex_batch) {
+  std::unique_ptr<StochasticEncoder<float>> encoder = MakeEncoder();
+  const std::vector<float> values = MakeBatchValues(1003);
+  std::vector<unsigned> symbols(values.size());
+  encoder->EncodeBatch(values.data(), values.size(), symbols.data());
+  const size_t count = values.size() / 2;
+  std::vector<double> factors(count);
+  std::mt19937 mt;
+  std::uniform_real_distribution<double> distribution(0.01, 100.0);
+  for (double& f : factors) f = distribution(mt);
+  std::vector<std::complex<float>> decoded(count);
+  encoder->DecodeComplexBatch(symbols.data(), factors.data(), count,
+                              decoded.data());
+  for (size_t i = 0; i != count; ++i) {
+    const float real = double(encoder->Decode(symbols[i * 2])) * factors[i];
+    const float imag = double(encoder->Decode(symbols[i * 2 + 1])) * factors[i];
+    // Non-finite values decode to NaN, which is not equal to itself
+    if (std::isnan(real))
+      BOOST_CHECK(std::isnan(decoded[i].real()));
+    else
+      BOOST_CHECK_EQUAL(decoded[i].real(), real);
+    if (std::isnan(imag))
+      BOOST_CHECK(std::isnan(decoded[i].imag()));
+    else
+      BOOST_CHECK_EQUAL(decoded[i].imag(), imag);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(uniform_encoder) {
+  for (size_t quantCount : {4, 8, 256, 1024, 65536}) {
+    const StochasticEncoder<float> searchEncoder(quantCount, 1.0, false);
+    const StochasticEncoder<float> uniformEncoder =
+        StochasticEncoder<float>::UniformEncoder(quantCount, 1.0);
+    // Values around all boundaries and quantization levels, since those are
+    // where rounding differences would show
+    std::vector<float> values = MakeBatchValues(1000);
+    for (size_t symbol = 0; symbol != quantCount - 1; ++symbol) {
+      for (float v : {searchEncoder.RightBoundary(symbol),
+                      searchEncoder.Decode(symbol)}) {
+        values.push_back(v);
+        values.push_back(std::nextafter(v, -std::numeric_limits<float>::max()));
+        values.push_back(std::nextafter(v, std::numeric_limits<float>::max()));
+      }
+    }
+    std::mt19937 mt;
+    std::uniform_int_distribution<unsigned> distribution =
+        searchEncoder.GetDitherDistribution();
+    for (float v : values) {
+      BOOST_CHECK_EQUAL(uniformEncoder.Encode(v), searchEncoder.Encode(v));
+      const unsigned dither = distribution(mt);
+      BOOST_CHECK_EQUAL(uniformEncoder.EncodeWithDithering(v, dither),
+                        searchEncoder.EncodeWithDithering(v, dither));
+    }
+    std::vector<unsigned> symbols(values.size());
+    uniformEncoder.EncodeBatch(values.data(), values.size(), symbols.data());
+    for (size_t i = 0; i != values.size(); ++i)
+      BOOST_CHECK_EQUAL(symbols[i], searchEncoder.Encode(values[i]));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(encode_batch_benchmark, *boost::unit_test::disabled()) {
+  std::unique_ptr<StochasticEncoder<float>> encoder = MakeEncoder();
+  const std::vector<float> values = MakeBatchValues(1 << 22);
+  std::vector<unsigned> ditherValues(values.size());
+  std::mt19937 mt;
+  std::uniform_int_distribution<unsigned> distribution =
+      encoder->GetDitherDistribution();
+  for (unsigned& d : ditherValues) d = distribution(mt);
+  std::vector<unsigned> symbols(values.size());
+
+  auto run = [&](const std::string& name, auto function) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    function();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::high_resolution_clock::now() - start;
+    std::cout << name << ": " << (values.size() / elapsed.count() / 1e6)
+              << " M values/s\n";
+  };
+  run("scalar", [&]() {
+    for (size_t i = 0; i != values.size(); ++i)
+      symbols[i] = encoder->Encode(values[i]);
+  });
+  run("batch", [&]() {
+    encoder->EncodeBatch(values.data(), values.size(), symbols.data());
+  });
+  run("scalar with dithering", [&]() {
+    for (size_t i = 0; i != values.size(); ++i)
+      symbols[i] = encoder->EncodeWithDithering(values[i], ditherValues[i]);
+  });
+  run("batch with dithering", [&]() {
+    encoder->EncodeWithDitheringBatch(values.data(), ditherValues.data(),
+                                      values.size(), symbols.data());
+  });
+
+  const StochasticEncoder<float> searchEncoder(256, 1.0, false);
+  const StochasticEncoder<float> uniformEncoder =
+      StochasticEncoder<float>::UniformEncoder(256, 1.0);
+  run("uniform with search", [&]() {
+    for (size_t i = 0; i != values.size(); ++i)
+      symbols[i] = searchEncoder.Encode(values[i]);
+  });
+  run("uniform calculated", [&]() {
+    for (size_t i = 0; i != values.size(); ++i)
+      symbols[i] = uniformEncoder.Encode(values[i]);
+  });
+  run("uniform batch", [&]() {
+    uniformEncoder.EncodeBatch(values.data(), values.size(), symbols.data());
+  });
+}
+
 BOOST_AUTO_TEST_SUITE_END()
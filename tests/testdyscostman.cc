@@ -10,6 +10,7 @@
 #include <casacore/tables/Tables/ScaColDesc.h>
 
 #include "../dyscostman.h"
+#include "../dyscostmanerror.h"
 
 using namespace casacore;
 using namespace dyscostman;
@@ -27,7 +28,12 @@ casacore::Record GetDyscoSpec() {
 }
 
 struct TestTableFixture {
-  explicit TestTableFixture(size_t nAnt) {
+  /**
+   * @param writeColumn Write the data with a single putColumn() call instead
+   * of one call per row.
+   */
+  explicit TestTableFixture(size_t nAnt, bool writeColumn = false,
+                            const casacore::Record &spec = GetDyscoSpec()) {
     casacore::TableDesc tableDesc;
     IPosition shape(2, 1, 1);
     casacore::ArrayColumnDesc<casacore::Complex> columnDesc(
@@ -49,7 +55,7 @@ struct TestTableFixture {
     register_dyscostman();
     DataManagerCtor dyscoConstructor = DataManager::getCtor("DyscoStMan");
     std::unique_ptr<DataManager> dysco(
-        dyscoConstructor("DATA_dm", GetDyscoSpec()));
+        dyscoConstructor("DATA_dm", spec));
     setupNewTable.bindColumn("DATA", *dysco);
     casacore::Table newTable(setupNewTable);
 
@@ -80,10 +86,16 @@ struct TestTableFixture {
     }
 
     casacore::ArrayColumn<casacore::Complex> dataCol(newTable, "DATA");
-    for (size_t i = 0; i != nRow; ++i) {
-      casacore::Array<casacore::Complex> arr(shape);
-      *arr.cbegin() = i;
-      dataCol.put(i, arr);
+    if (writeColumn) {
+      casacore::Array<casacore::Complex> arr(IPosition(3, 1, 1, nRow));
+      for (size_t i = 0; i != nRow; ++i) arr(IPosition(3, 0, 0, i)) = i;
+      dataCol.putColumn(arr);
+    } else {
+      for (size_t i = 0; i != nRow; ++i) {
+        casacore::Array<casacore::Complex> arr(shape);
+        *arr.cbegin() = i;
+        dataCol.put(i, arr);
+      }
     }
   }
   ~TestTableFixture() { boost::filesystem::remove_all("TestTable"); }
@@ -94,6 +106,44 @@ BOOST_AUTO_TEST_CASE(spec) {
   Record spec = dysco.dataManagerSpec();
   BOOST_CHECK_EQUAL(spec.asInt("dataBitCount"), 8);
   BOOST_CHECK_EQUAL(spec.asInt("weightBitCount"), 12);
+  BOOST_CHECK_EQUAL(spec.asInt("encoderThreads"), 0);
+  BOOST_CHECK_EQUAL(spec.asInt("writeCacheBlocks"), 0);
+  BOOST_CHECK_EQUAL(spec.asInt("readAheadBlocks"), 0);
+  BOOST_CHECK_EQUAL(spec.asInt("decodedCacheSize"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(spec_threads) {
+  DyscoStMan dysco1(8, 12);
+  dysco1.SetEncoderThreadCount(3);
+  dysco1.SetWriteCacheBlockCount(5);
+  dysco1.SetReadAheadBlockCount(6);
+  dysco1.SetDecodedCacheSize(7);
+  Record spec1 = dysco1.dataManagerSpec();
+  BOOST_CHECK_EQUAL(spec1.asInt("encoderThreads"), 3);
+  BOOST_CHECK_EQUAL(spec1.asInt("writeCacheBlocks"), 5);
+  BOOST_CHECK_EQUAL(spec1.asInt("readAheadBlocks"), 6);
+  BOOST_CHECK_EQUAL(spec1.asInt("decodedCacheSize"), 7);
+
+  casacore::Record spec2 = GetDyscoSpec();
+  spec2.define("encoderThreads", 2);
+  spec2.define("writeCacheBlocks", 4);
+  spec2.define("readAheadBlocks", 3);
+  spec2.define("decodedCacheSize", 5);
+  DyscoStMan dysco2("threads", spec2);
+  BOOST_CHECK_EQUAL(dysco2.EncoderThreadCount(), 2u);
+  BOOST_CHECK_EQUAL(dysco2.WriteCacheBlockCount(), 4u);
+  BOOST_CHECK_EQUAL(dysco2.ReadAheadBlockCount(), 3u);
+  BOOST_CHECK_EQUAL(dysco2.DecodedCacheSize(), 5u);
+  std::unique_ptr<DataManager> dysco3(dysco2.clone());
+  Record spec3 = dysco3->dataManagerSpec();
+  BOOST_CHECK_EQUAL(spec3.asInt("encoderThreads"), 2);
+  BOOST_CHECK_EQUAL(spec3.asInt("writeCacheBlocks"), 4);
+  BOOST_CHECK_EQUAL(spec3.asInt("readAheadBlocks"), 3);
+  BOOST_CHECK_EQUAL(spec3.asInt("decodedCacheSize"), 5);
+
+  casacore::Record spec4 = GetDyscoSpec();
+  spec4.define("encoderThreads", -1);
+  BOOST_CHECK_THROW(DyscoStMan("invalid", spec4), DyscoStManError);
 }
 
 BOOST_AUTO_TEST_CASE(name) {
@@ -142,6 +192,137 @@ BOOST_AUTO_TEST_CASE(maketable) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(write_column) {
+  size_t nAnt = 4;
+  TestTableFixture fixture(nAnt, true);
+
+  casacore::Table table("TestTable");
+  casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+  for (size_t i = 0; i != table.nrow(); ++i) {
+    BOOST_CHECK_CLOSE_FRACTION((*dataCol(i).cbegin()).real(), float(i), 1e-4);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(read_column) {
+  size_t nAnt = 4;
+  TestTableFixture fixture(nAnt);
+
+  casacore::Table table("TestTable");
+  casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+  // Load a block as current block to read from both the current block and
+  // from the file
+  BOOST_CHECK_CLOSE_FRACTION((*dataCol(1).cbegin()).real(), 1.0, 1e-4);
+  casacore::Array<casacore::Complex> column = dataCol.getColumn();
+  BOOST_REQUIRE_EQUAL(size_t(column.shape()[2]), size_t(table.nrow()));
+  for (size_t i = 0; i != table.nrow(); ++i) {
+    BOOST_CHECK_CLOSE_FRACTION(column(IPosition(3, 0, 0, i)).real(), float(i),
+                               1e-4);
+  }
+
+  casacore::Array<casacore::Complex> range =
+      dataCol.getColumnRange(casacore::Slicer(IPosition(1, 3), IPosition(1, 6)));
+  BOOST_REQUIRE_EQUAL(size_t(range.shape()[2]), 6u);
+  for (size_t i = 0; i != 6; ++i) {
+    BOOST_CHECK_CLOSE_FRACTION(range(IPosition(3, 0, 0, i)).real(),
+                               float(i + 3), 1e-4);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(read_slice) {
+  size_t nAnt = 4;
+  TestTableFixture fixture(nAnt);
+
+  casacore::Table table("TestTable");
+  casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+  const casacore::Slicer slicer(IPosition(2, 0, 0), IPosition(2, 1, 1));
+  // The first slice is decoded from the file, the second one from the
+  // current block
+  BOOST_CHECK_CLOSE_FRACTION((*dataCol.getSlice(2, slicer).cbegin()).real(),
+                             2.0, 1e-4);
+  BOOST_CHECK_CLOSE_FRACTION((*dataCol(1).cbegin()).real(), 1.0, 1e-4);
+  BOOST_CHECK_CLOSE_FRACTION((*dataCol.getSlice(2, slicer).cbegin()).real(),
+                             2.0, 1e-4);
+
+  casacore::Array<casacore::Complex> column = dataCol.getColumn(slicer);
+  BOOST_REQUIRE_EQUAL(size_t(column.shape()[2]), size_t(table.nrow()));
+  for (size_t i = 0; i != table.nrow(); ++i) {
+    BOOST_CHECK_CLOSE_FRACTION(column(IPosition(3, 0, 0, i)).real(), float(i),
+                               1e-4);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(read_ahead) {
+  size_t nAnt = 4;
+  TestTableFixture fixture(nAnt);
+
+  casacore::Table table("TestTable");
+  DyscoStMan* dysco =
+      dynamic_cast<DyscoStMan*>(table.findDataManager("DATA", true));
+  BOOST_REQUIRE(dysco);
+  dysco->SetReadAheadBlockCount(2);
+  casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+  for (size_t i = 0; i != table.nrow(); ++i) {
+    BOOST_CHECK_CLOSE_FRACTION((*dataCol(i).cbegin()).real(), float(i), 1e-4);
+  }
+  // The first block is decoded when it is read, the second is read ahead
+  BOOST_CHECK_EQUAL(dysco->ReadAheadHits(), 1u);
+  casacore::Array<casacore::Complex> column = dataCol.getColumn();
+  for (size_t i = 0; i != table.nrow(); ++i) {
+    BOOST_CHECK_CLOSE_FRACTION(column(IPosition(3, 0, 0, i)).real(), float(i),
+                               1e-4);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(decoded_cache) {
+  size_t nAnt = 4;
+  TestTableFixture fixture(nAnt);
+
+  casacore::Table table("TestTable");
+  DyscoStMan* dysco =
+      dynamic_cast<DyscoStMan*>(table.findDataManager("DATA", true));
+  BOOST_REQUIRE(dysco);
+  dysco->SetDecodedCacheSize(1);
+  casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+  // Alternate between the rows of the two blocks
+  const size_t nBaselines = table.nrow() / 2;
+  for (size_t repeat = 0; repeat != 2; ++repeat) {
+    for (size_t i = 0; i != nBaselines; ++i) {
+      BOOST_CHECK_CLOSE_FRACTION((*dataCol(i).cbegin()).real(), float(i),
+                                 1e-4);
+      BOOST_CHECK_CLOSE_FRACTION((*dataCol(i + nBaselines).cbegin()).real(),
+                                 float(i + nBaselines), 1e-4);
+    }
+  }
+  // Every read after the first read of each block is served by the cache
+  BOOST_CHECK_GT(dysco->DecodedCacheHits(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(dither_generator) {
+  DyscoStMan dysco(8, 12);
+  BOOST_CHECK_EQUAL(dysco.dataManagerSpec().asString("ditherGenerator"),
+                    "Philox");
+
+  casacore::Record invalidSpec = GetDyscoSpec();
+  invalidSpec.define("ditherGenerator", "Unknown");
+  BOOST_CHECK_THROW(DyscoStMan("invalid", invalidSpec), DyscoStManError);
+
+  casacore::Record spec = GetDyscoSpec();
+  spec.define("ditherGenerator", "Xoshiro");
+  size_t nAnt = 4;
+  TestTableFixture fixture(nAnt, false, spec);
+
+  // The generator is read back from the header
+  casacore::Table table("TestTable");
+  DyscoStMan* tableDysco =
+      dynamic_cast<DyscoStMan*>(table.findDataManager("DATA", true));
+  BOOST_REQUIRE(tableDysco);
+  BOOST_CHECK(tableDysco->GetDitherGenerator() == DitherGenerator::kXoshiro);
+  casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+  for (size_t i = 0; i != table.nrow(); ++i) {
+    BOOST_CHECK_CLOSE_FRACTION((*dataCol(i).cbegin()).real(), float(i), 1e-4);
+  }
+}
+
 BOOST_AUTO_TEST_CASE(read_past_end, * boost::unit_test::disabled()) {
   /**
    * While reading past the end of a file might seem wrong in any case, it can
@@ -0,0 +1,123 @@
+#include "../philox.h"
+
+#include "../aftimeblockencoder.h"
+#include "../rftimeblockencoder.h"
+#include "../rowtimeblockencoder.h"
+#include "../stochasticencoder.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace dyscostman;
+
+BOOST_AUTO_TEST_SUITE(philox)
+
+BOOST_AUTO_TEST_CASE(known_answers) {
+  // Test vectors from the Random123 library
+  const uint32_t counters[3][4] = {
+      {0, 0, 0, 0},
+      {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+      {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}};
+  const uint32_t keys[3][2] = {
+      {0, 0}, {0xffffffff, 0xffffffff}, {0xa4093822, 0x299f31d0}};
+  const uint32_t expected[3][4] = {
+      {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8},
+      {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd},
+      {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}};
+  for (size_t i = 0; i != 3; ++i) {
+    uint32_t output[4];
+    Philox4x32::Generate(counters[i], keys[i], output);
+    for (size_t j = 0; j != 4; ++j)
+      BOOST_CHECK_EQUAL(output[j], expected[i][j]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(seek) {
+  Philox4x32 sequential(1234, 5);
+  std::vector<uint32_t> values(23);
+  for (uint32_t &v : values) v = sequential();
+  for (size_t position = 0; position != values.size(); ++position) {
+    Philox4x32 sought(1234, 5);
+    sought.Seek(position);
+    for (size_t i = position; i != values.size(); ++i)
+      BOOST_CHECK_EQUAL(sought(), values[i]);
+  }
+
+  Philox4x32 otherStream(1234, 6), otherKey(1235, 5);
+  BOOST_CHECK_NE(otherStream(), values[0]);
+  BOOST_CHECK_NE(otherKey(), values[0]);
+}
+
+BOOST_AUTO_TEST_CASE(fill) {
+  // The last start position makes the low word of the counter wrap
+  for (uint64_t start : {uint64_t(0), uint64_t(3), (uint64_t(1) << 34) - 37}) {
+    for (size_t count : {0, 1, 5, 31, 32, 33, 100}) {
+      Philox4x32 sequential(1234, 5), filled(1234, 5);
+      sequential.Seek(start);
+      filled.Seek(start);
+      std::vector<uint32_t> expected(count), values(count);
+      for (uint32_t &v : expected) v = sequential();
+      filled.Fill(values.data(), count);
+      BOOST_CHECK(values == expected);
+      BOOST_CHECK_EQUAL(filled.Position(), sequential.Position());
+      BOOST_CHECK_EQUAL(filled(), sequential());
+    }
+  }
+}
+
+namespace {
+template <typename Encoder>
+void TestReproducibleEncoding() {
+  const size_t nAnt = 6, nChan = 8, nPol = 2, nRow = nAnt * (nAnt + 1) / 2;
+  TimeBlockBuffer<std::complex<float>> buffer(nPol, nChan);
+  std::mt19937 mt;
+  std::normal_distribution<float> dist;
+  std::vector<std::complex<float>> data(nChan * nPol);
+  size_t blockRow = 0;
+  for (size_t a1 = 0; a1 != nAnt; ++a1) {
+    for (size_t a2 = a1; a2 != nAnt; ++a2) {
+      for (std::complex<float> &v : data) v = {dist(mt), dist(mt)};
+      buffer.SetData(blockRow, a1, a2, data.data());
+      ++blockRow;
+    }
+  }
+
+  StochasticEncoder<float> gausEncoder(256, 1.0, true);
+  Encoder encoderA(nPol, nChan), encoderB(nPol, nChan);
+  std::vector<float> metaA(encoderA.MetaDataCount(nRow, nPol, nChan, nAnt)),
+      metaB(metaA.size());
+  std::vector<unsigned> symbolsA(encoderA.SymbolCount(nRow)),
+      symbolsB(symbolsA.size()), symbolsC(symbolsA.size());
+
+  // Encoder B first encodes another block, as happens when a thread encodes
+  // several blocks
+  Philox4x32 otherRnd(42, 8);
+  encoderB.EncodeWithDithering(gausEncoder, buffer, metaB.data(),
+                               symbolsC.data(), nAnt, otherRnd);
+
+  Philox4x32 rndA(42, 7), rndB(42, 7);
+  encoderA.EncodeWithDithering(gausEncoder, buffer, metaA.data(),
+                               symbolsA.data(), nAnt, rndA);
+  encoderB.EncodeWithDithering(gausEncoder, buffer, metaB.data(),
+                               symbolsB.data(), nAnt, rndB);
+  BOOST_CHECK(metaA == metaB);
+  BOOST_CHECK(symbolsA == symbolsB);
+  BOOST_CHECK(symbolsA != symbolsC);
+}
+
+// The AF encoder has an additional constructor parameter
+struct FittingAFEncoder : public AFTimeBlockEncoder {
+  FittingAFEncoder(size_t nPol, size_t nChan)
+      : AFTimeBlockEncoder(nPol, nChan, true) {}
+};
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(reproducible_encoding) {
+  TestReproducibleEncoding<FittingAFEncoder>();
+  TestReproducibleEncoding<RFTimeBlockEncoder>();
+  TestReproducibleEncoding<RowTimeBlockEncoder>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,59 @@
+#include "../threadpool.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+using namespace dyscostman;
+
+BOOST_AUTO_TEST_SUITE(thread_pool)
+
+BOOST_AUTO_TEST_CASE(run_jobs) {
+  constexpr size_t kNJobs = 1000;
+  std::vector<std::atomic<size_t>> executed(kNJobs);
+  for (std::atomic<size_t> &e : executed) e = 0;
+  {
+    ThreadPool pool(4);
+    BOOST_CHECK_EQUAL(pool.NThreads(), 4u);
+    for (size_t i = 0; i != kNJobs; ++i)
+      pool.Submit([&executed, i]() { ++executed[i]; });
+    // The destructor finishes all jobs
+  }
+  for (size_t i = 0; i != kNJobs; ++i) BOOST_CHECK_EQUAL(executed[i], 1u);
+}
+
+BOOST_AUTO_TEST_CASE(submit_from_job) {
+  // Jobs that resubmit themselves, as is done by the encoding jobs
+  constexpr size_t kNChains = 8, kChainLength = 100;
+  std::mutex mutex;
+  std::condition_variable condition;
+  size_t nFinished = 0;
+  std::atomic<size_t> nExecuted(0);
+  ThreadPool pool(3);
+  std::function<void(size_t)> step = [&](size_t remaining) {
+    ++nExecuted;
+    if (remaining == 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++nFinished;
+      condition.notify_all();
+    } else {
+      pool.Submit([&step, remaining]() { step(remaining - 1); });
+    }
+  };
+  for (size_t i = 0; i != kNChains; ++i)
+    pool.Submit([&step]() { step(kChainLength - 1); });
+  std::unique_lock<std::mutex> lock(mutex);
+  while (nFinished != kNChains) condition.wait(lock);
+  BOOST_CHECK_EQUAL(nExecuted, kNChains * kChainLength);
+}
+
+BOOST_AUTO_TEST_CASE(instance) {
+  ThreadPool &pool = ThreadPool::Instance();
+  BOOST_CHECK_GE(pool.NThreads(), 1u);
+  BOOST_CHECK_EQUAL(&pool, &ThreadPool::Instance());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
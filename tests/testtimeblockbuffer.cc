@@ -0,0 +1,48 @@
+#include "../timeblockbuffer.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <complex>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(time_block_buffer)
+
+BOOST_AUTO_TEST_CASE(reuse_storage) {
+  const size_t nPol = 2, nChan = 3, nRows = 4;
+  TimeBlockBuffer<std::complex<float>> buffer(nPol, nChan);
+  buffer.Reserve(nRows);
+  BOOST_CHECK(buffer.Empty());
+
+  std::vector<std::complex<float>> data(nPol * nChan);
+  std::vector<const std::complex<float> *> storage;
+  for (size_t row = 0; row != nRows; ++row) {
+    for (size_t i = 0; i != data.size(); ++i) data[i] = float(row * 10 + i);
+    buffer.SetData(row, row, row + 1, data.data());
+    storage.emplace_back(buffer[row].visibilities);
+  }
+  BOOST_CHECK_EQUAL(buffer.NRows(), nRows);
+
+  buffer.ResetData();
+  BOOST_CHECK(buffer.Empty());
+  BOOST_CHECK_EQUAL(buffer.NRows(), 0u);
+
+  // Only the first two rows of the next block are set
+  for (size_t row = 0; row != 2; ++row) {
+    for (size_t i = 0; i != data.size(); ++i) data[i] = float(row * 100 + i);
+    buffer.SetData(row, row, row, data.data());
+  }
+  BOOST_CHECK_EQUAL(buffer.NRows(), 2u);
+  std::vector<std::complex<float>> result(nPol * nChan);
+  for (size_t row = 0; row != 2; ++row) {
+    buffer.GetData(row, result.data());
+    for (size_t i = 0; i != data.size(); ++i)
+      BOOST_CHECK_EQUAL(result[i], std::complex<float>(row * 100 + i));
+    BOOST_CHECK_EQUAL(buffer[row].antenna2, row);
+    // The storage of one of the removed rows is reused
+    BOOST_CHECK(std::find(storage.begin(), storage.end(),
+                          buffer[row].visibilities) != storage.end());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
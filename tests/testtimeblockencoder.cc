@@ -1,10 +1,15 @@
 #include "../aftimeblockencoder.h"
+#include "../bytepacker.h"
 #include "../dysconormalization.h"
 #include "../rftimeblockencoder.h"
 #include "../rowtimeblockencoder.h"
 #include "../stochasticencoder.h"
+#include "../threadpool.h"
 
+#include <algorithm>
+#include <functional>
 #include <random>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
@@ -49,6 +54,31 @@ TimeBlockBuffer<std::complex<float>> Decode(
   return out;
 }
 
+/**
+ * Fills a block with the baselines of nAnt antennas, including
+ * auto-correlations, with normally distributed values. The values of
+ * baseline (a1, a2) are multiplied by gainFn(a1, a2).
+ */
+TimeBlockBuffer<std::complex<float>> MakeRandomBlock(
+    size_t nAnt, size_t nChan, size_t nPol, std::mt19937& rng,
+    const std::function<double(size_t, size_t)>& gainFn =
+        [](size_t, size_t) { return 1.0; }) {
+  TimeBlockBuffer<std::complex<float>> buffer(nPol, nChan);
+  std::normal_distribution<float> dist;
+  std::vector<std::complex<float>> data(nChan * nPol);
+  size_t blockRow = 0;
+  for (size_t a1 = 0; a1 != nAnt; ++a1) {
+    for (size_t a2 = a1; a2 != nAnt; ++a2) {
+      const float gain = gainFn(a1, a2);
+      for (std::complex<float>& value : data)
+        value = std::complex<float>{dist(rng), dist(rng)} * gain;
+      buffer.SetData(blockRow, a1, a2, data.data());
+      ++blockRow;
+    }
+  }
+  return buffer;
+}
+
 void TestSimpleExample(Normalization blockNormalization) {
   const size_t nAnt = 4, nChan = 1, nPol = 2, nRow = (nAnt * (nAnt + 1) / 2);
 
@@ -232,8 +262,132 @@ TimeBlockBuffer<std::complex<float>> EncodeDecode(Normalization block_normalizat
              metaBuffer.data(), symbolBuffer.data());
 }
 
+void TestParallelEncoding(Normalization blockNormalization) {
+  // Large enough to split the block in several ranges along every axis
+  const size_t nAnt = 40, nChan = 256, nPol = 4, nRow = nAnt * (nAnt + 1) / 2;
+  std::mt19937 mt;
+  TimeBlockBuffer<std::complex<float>> buffer =
+      MakeRandomBlock(nAnt, nChan, nPol, mt);
+
+  StochasticEncoder<float> gausEncoder(256, 1.0, true);
+  std::unique_ptr<TimeBlockEncoder> sequentialEncoder =
+      CreateEncoder(blockNormalization, nPol, nChan);
+  std::unique_ptr<TimeBlockEncoder> parallelEncoder =
+      CreateEncoder(blockNormalization, nPol, nChan);
+  ThreadPool pool(4);
+  parallelEncoder->SetParallelFor(
+      [&pool](size_t nTasks, const std::function<void(size_t)> &task) {
+        pool.ParallelFor(nTasks, task);
+      });
+
+  const size_t nMeta =
+      sequentialEncoder->MetaDataCount(nRow, nPol, nChan, nAnt);
+  const size_t nSymbols = sequentialEncoder->SymbolCount(nRow);
+  std::vector<float> sequentialMeta(nMeta), parallelMeta(nMeta);
+  std::vector<unsigned> sequentialSymbols(nSymbols), parallelSymbols(nSymbols);
+  dyscostman::Philox4x32 sequentialRnd(3, 1), parallelRnd(3, 1);
+  sequentialEncoder->EncodeWithDithering(
+      gausEncoder, buffer, sequentialMeta.data(), sequentialSymbols.data(),
+      nAnt, sequentialRnd);
+  parallelEncoder->EncodeWithDithering(gausEncoder, buffer,
+                                       parallelMeta.data(),
+                                       parallelSymbols.data(), nAnt,
+                                       parallelRnd);
+  BOOST_CHECK(sequentialMeta == parallelMeta);
+  BOOST_CHECK(sequentialSymbols == parallelSymbols);
+  BOOST_CHECK_EQUAL(sequentialRnd(), parallelRnd());
+
+  sequentialEncoder->EncodeWithoutDithering(gausEncoder, buffer,
+                                            sequentialMeta.data(),
+                                            sequentialSymbols.data(), nAnt);
+  parallelEncoder->EncodeWithoutDithering(gausEncoder, buffer,
+                                          parallelMeta.data(),
+                                          parallelSymbols.data(), nAnt);
+  BOOST_CHECK(sequentialSymbols == parallelSymbols);
 }
 
+void TestDecodeSlice(Normalization blockNormalization) {
+  const size_t nAnt = 5, nChan = 16, nPol = 4, nRow = nAnt * (nAnt + 1) / 2;
+  std::mt19937 mt;
+  TimeBlockBuffer<std::complex<float>> buffer =
+      MakeRandomBlock(nAnt, nChan, nPol, mt);
+
+  StochasticEncoder<float> gausEncoder(256, 1.0, true);
+  std::unique_ptr<TimeBlockEncoder> encoder =
+      CreateEncoder(blockNormalization, nPol, nChan);
+  std::vector<float> metaBuffer(
+      encoder->MetaDataCount(nRow, nPol, nChan, nAnt));
+  std::vector<unsigned> symbolBuffer(encoder->SymbolCount(nRow));
+  encoder->EncodeWithoutDithering(gausEncoder, buffer, metaBuffer.data(),
+                                  symbolBuffer.data(), nAnt);
+  TimeBlockBuffer<std::complex<float>> decoded =
+      Decode(blockNormalization, gausEncoder, nAnt, nChan, nPol, nRow,
+             metaBuffer.data(), symbolBuffer.data());
+
+  std::unique_ptr<TimeBlockEncoder> decoder =
+      CreateEncoder(blockNormalization, nPol, nChan);
+  decoder->InitializeDecode(metaBuffer.data(), nRow, nAnt);
+  // Channels 3, 6, 9 and 12 of polarizations 1 and 3
+  const RowSlice slice{1, 2, 2, 3, 4, 3};
+  std::vector<std::complex<float>> sliceData(slice.Size());
+  size_t blockRow = 0;
+  for (size_t a1 = 0; a1 != nAnt; ++a1) {
+    for (size_t a2 = a1; a2 != nAnt; ++a2) {
+      decoder->DecodeRowSlice(gausEncoder, symbolBuffer.data(), blockRow, a1,
+                              a2, slice, sliceData.data());
+      const std::complex<float> *row = decoded.Row(blockRow);
+      for (size_t c = 0; c != slice.channelCount; ++c) {
+        for (size_t p = 0; p != slice.polarizationCount; ++p) {
+          const size_t ch = 3 + c * 3, pol = 1 + p * 2;
+          BOOST_CHECK_EQUAL(sliceData[c * slice.polarizationCount + p],
+                            row[ch * nPol + pol]);
+        }
+      }
+      ++blockRow;
+    }
+  }
+}
+
+void TestDecodePacked(Normalization blockNormalization, unsigned bitCount) {
+  const size_t nAnt = 5, nChan = 7, nPol = 2, nRow = nAnt * (nAnt + 1) / 2;
+  std::mt19937 mt;
+  TimeBlockBuffer<std::complex<float>> buffer =
+      MakeRandomBlock(nAnt, nChan, nPol, mt);
+
+  StochasticEncoder<float> gausEncoder(1 << bitCount, 1.0, true);
+  std::unique_ptr<TimeBlockEncoder> encoder =
+      CreateEncoder(blockNormalization, nPol, nChan);
+  std::vector<float> metaBuffer(
+      encoder->MetaDataCount(nRow, nPol, nChan, nAnt));
+  const size_t nSymbols = encoder->SymbolCount(nRow);
+  std::vector<unsigned> symbolBuffer(nSymbols);
+  encoder->EncodeWithDithering(gausEncoder, buffer, metaBuffer.data(),
+                               symbolBuffer.data(), nAnt, mt);
+  std::vector<unsigned char> packedBuffer(
+      BytePacker::bufferSize(nSymbols, bitCount));
+  BytePacker::pack(bitCount, packedBuffer.data(), symbolBuffer.data(),
+                   nSymbols);
+
+  std::unique_ptr<TimeBlockEncoder> decoder =
+      CreateEncoder(blockNormalization, nPol, nChan);
+  decoder->InitializeDecode(metaBuffer.data(), nRow, nAnt);
+  std::vector<std::complex<float>> unpackedRow(nChan * nPol),
+      packedRow(nChan * nPol);
+  size_t blockRow = 0;
+  for (size_t a1 = 0; a1 != nAnt; ++a1) {
+    for (size_t a2 = a1; a2 != nAnt; ++a2) {
+      decoder->DecodeRow(gausEncoder, symbolBuffer.data(), blockRow, a1, a2,
+                         unpackedRow.data());
+      decoder->DecodeRowPacked(gausEncoder, packedBuffer.data(), bitCount,
+                               blockRow, a1, a2, packedRow.data());
+      BOOST_CHECK(unpackedRow == packedRow);
+      ++blockRow;
+    }
+  }
+}
+
+}  // namespace
+
 BOOST_AUTO_TEST_CASE(row_normalization_per_row_accuracy) {
   TestSimpleExample(Normalization::kRow);
 }
@@ -363,4 +517,117 @@ BOOST_AUTO_TEST_CASE(rf_dynamic_range) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(af_antenna_rms) {
+  constexpr size_t nAnt = 20, nChan = 64, nPol = 1;
+  constexpr size_t nRow = nAnt * (nAnt + 1) / 2;
+
+  // Every antenna has a different gain, and the RMS of a baseline is the
+  // product of the gains of its antennas.
+  std::vector<double> gains(nAnt);
+  for (size_t a = 0; a != nAnt; ++a) gains[a] = 1.0 + 0.5 * a;
+  std::mt19937 rnd;
+  TimeBlockBuffer<std::complex<float>> buffer = MakeRandomBlock(
+      nAnt, nChan, nPol, rnd,
+      [&gains](size_t a1, size_t a2) { return gains[a1] * gains[a2]; });
+
+  StochasticEncoder<float> gausEncoder(256, 1.0, true);
+  AFTimeBlockEncoder encoder(nPol, nChan, false);
+  std::vector<float> metaBuffer(
+      encoder.MetaDataCount(nRow, nPol, nChan, nAnt));
+  std::vector<TimeBlockEncoder::symbol_t> symbolBuffer(
+      encoder.SymbolCount(nRow));
+  encoder.EncodeWithoutDithering(gausEncoder, buffer, metaBuffer.data(),
+                                 symbolBuffer.data(), nAnt);
+
+  BOOST_CHECK_GT(encoder.AntennaRMSIterationCount(), 0u);
+  BOOST_CHECK_LT(encoder.AntennaRMSIterationCount(), 20u);
+  const float* antennaRMS = metaBuffer.data() + nChan * nPol;
+  for (size_t a = 1; a != nAnt; ++a) {
+    BOOST_CHECK_CLOSE_FRACTION(antennaRMS[a] / antennaRMS[0],
+                               gains[a] / gains[0], 0.1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(af_fit_iterations) {
+  constexpr size_t nAnt = 12, nChan = 16, nPol = 2;
+  constexpr size_t nRow = nAnt * (nAnt + 1) / 2;
+
+  // Outliers in the baselines between the first half of the antennas limit
+  // the channel factors, so that the fit scales up the other antennas.
+  std::mt19937 rnd;
+  TimeBlockBuffer<std::complex<float>> buffer =
+      MakeRandomBlock(nAnt, nChan, nPol, rnd);
+  for (size_t r = 0; r != nRow; ++r) {
+    const size_t a1 = buffer.Antenna1(r), a2 = buffer.Antenna2(r);
+    if (a1 != a2 && a2 < nAnt / 2) {
+      for (size_t p = 0; p != nPol; ++p)
+        buffer.Row(r)[(r % nChan) * nPol + p] *= 30.0f;
+    }
+  }
+  // Auto-correlations are not part of the fit to the maximum, so they are
+  // made small enough to not be clipped. They are still scaled with the fit
+  // factors of their antenna.
+  for (size_t r = 0; r != nRow; ++r) {
+    if (buffer.Antenna1(r) == buffer.Antenna2(r)) {
+      for (size_t i = 0; i != nChan * nPol; ++i) buffer.Row(r)[i] *= 0.1f;
+    }
+  }
+
+  // Many quantization levels make the decoded values accurate
+  StochasticEncoder<float> gausEncoder(1 << 16, 1.0, true);
+  AFTimeBlockEncoder encoder(nPol, nChan, true);
+  std::vector<float> metaBuffer(
+      encoder.MetaDataCount(nRow, nPol, nChan, nAnt));
+  std::vector<TimeBlockEncoder::symbol_t> symbolBuffer(
+      encoder.SymbolCount(nRow));
+  encoder.EncodeWithoutDithering(gausEncoder, buffer, metaBuffer.data(),
+                                 symbolBuffer.data(), nAnt);
+  BOOST_CHECK_GE(encoder.FitIterationCount(), nPol);
+  BOOST_CHECK_LE(encoder.FitIterationCount(), nPol * (nChan + nAnt + 1));
+
+  const TimeBlockBuffer<std::complex<float>> out =
+      Decode(Normalization::kAF, gausEncoder, nAnt, nChan, nPol, nRow,
+             metaBuffer.data(), symbolBuffer.data());
+  std::vector<std::complex<float>> input(nChan * nPol), output(nChan * nPol);
+  for (size_t r = 0; r != nRow; ++r) {
+    buffer.GetData(r, input.data());
+    out.GetData(r, output.data());
+    if (buffer.Antenna1(r) == buffer.Antenna2(r)) {
+      // A wrong antenna factor changes the scale of the whole row
+      double inputPower = 0.0, outputPower = 0.0;
+      for (size_t i = 0; i != input.size(); ++i) {
+        inputPower += std::norm(input[i]);
+        outputPower += std::norm(output[i]);
+      }
+      BOOST_CHECK_CLOSE_FRACTION(outputPower, inputPower, 1e-3);
+    } else {
+      for (size_t i = 0; i != input.size(); ++i) {
+        // The outliers are in the coarse tail of the quantization
+        BOOST_CHECK_SMALL(std::abs(output[i] - input[i]),
+                          std::max(0.5f, 0.05f * std::abs(input[i])));
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_encoding) {
+  TestParallelEncoding(Normalization::kAF);
+  TestParallelEncoding(Normalization::kRF);
+  TestParallelEncoding(Normalization::kRow);
+}
+
+BOOST_AUTO_TEST_CASE(decode_slice) {
+  TestDecodeSlice(Normalization::kAF);
+  TestDecodeSlice(Normalization::kRF);
+  TestDecodeSlice(Normalization::kRow);
+}
+
+BOOST_AUTO_TEST_CASE(decode_packed) {
+  for (unsigned bitCount = 2; bitCount <= 16; ++bitCount) {
+    TestDecodePacked(Normalization::kAF, bitCount);
+    TestDecodePacked(Normalization::kRF, bitCount);
+    TestDecodePacked(Normalization::kRow, bitCount);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
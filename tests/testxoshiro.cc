@@ -0,0 +1,68 @@
+#include "../xoshiro.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+using namespace dyscostman;
+
+namespace {
+/** Reference implementation of a single xoshiro256+ generator */
+uint64_t NextXoshiro256Plus(uint64_t s[4]) {
+  const uint64_t result = s[0] + s[3];
+  const uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = (s[3] << 45) | (s[3] >> 19);
+  return result;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(xoshiro)
+
+BOOST_AUTO_TEST_CASE(reference) {
+  // Seed the four generators in the same way as the class does
+  uint64_t splitMixState = 1234;
+  uint64_t streamState = 5;
+  splitMixState ^= Xoshiro256x4::SplitMix64(streamState);
+  uint64_t states[4][4];
+  for (size_t word = 0; word != 4; ++word) {
+    for (size_t lane = 0; lane != 4; ++lane)
+      states[lane][word] = Xoshiro256x4::SplitMix64(splitMixState);
+  }
+
+  Xoshiro256x4 rnd(1234, 5);
+  for (size_t i = 0; i != 100; ++i) {
+    for (size_t lane = 0; lane != 4; ++lane) {
+      BOOST_CHECK_EQUAL(rnd(),
+                        uint32_t(NextXoshiro256Plus(states[lane]) >> 32));
+    }
+  }
+
+  Xoshiro256x4 otherStream(1234, 6), otherKey(1235, 5), same(1234, 5);
+  const uint32_t first = same();
+  BOOST_CHECK_NE(otherStream(), first);
+  BOOST_CHECK_NE(otherKey(), first);
+}
+
+BOOST_AUTO_TEST_CASE(fill) {
+  for (size_t skip : {0, 1, 3}) {
+    for (size_t count : {0, 1, 5, 31, 32, 33, 100}) {
+      Xoshiro256x4 sequential(1234, 5), filled(1234, 5);
+      for (size_t i = 0; i != skip; ++i) {
+        sequential();
+        filled();
+      }
+      std::vector<uint32_t> expected(count), values(count);
+      for (uint32_t &v : expected) v = sequential();
+      filled.Fill(values.data(), count);
+      BOOST_CHECK(values == expected);
+      BOOST_CHECK_EQUAL(filled(), sequential());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
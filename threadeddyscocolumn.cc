@@ -4,12 +4,14 @@
 #include "dyscostmanerror.h"
 
 #include "bytepacker.h"
-#include "threadgroup.h"
+#include "threadpool.h"
 
+#include <casacore/casa/Arrays/Vector.h>
 #include <casacore/ms/MeasurementSets/MeasurementSet.h>
 #include <casacore/tables/Tables/ScalarColumn.h>
 
 #include <algorithm>
+#include <iostream>
 #include <limits>
 
 namespace dyscostman {
@@ -22,10 +24,15 @@ ThreadedDyscoColumn<DataType>::ThreadedDyscoColumn(DyscoStMan *parent,
       _ant1Col(),
       _ant2Col(),
       _fieldCol(),
-      _packedBlockReadBuffer(),
-      _unpackedSymbolReadBuffer(),
-      _stopThreads(false),
+      _nActiveReadAheadJobs(0),
+      _readAheadHits(0),
+      _isEncodingStarted(false),
+      _maxActiveJobs(0),
+      _nActiveJobs(0),
+      _nUnassignedBlocks(0),
       _currentBlock(std::numeric_limits<size_t>::max()),
+      _readStateBlock(std::numeric_limits<size_t>::max()),
+      _nDecodedRows(0),
       _isCurrentBlockChanged(false),
       _blockSize(0),
       _antennaCount(0),
@@ -36,37 +43,62 @@ ThreadedDyscoColumn<DataType>::ThreadedDyscoColumn(DyscoStMan *parent,
 // called to empty the cache.
 template <typename DataType>
 void ThreadedDyscoColumn<DataType>::shutdown() {
+  stopReadAhead();
   if (_isCurrentBlockChanged) storeBlock();
 
-  stopThreads();
+  stopEncoding();
+  ThrowIfEncodingFailed();
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::shutdownInDestructor() {
+  try {
+    shutdown();
+  } catch (std::exception &e) {
+    std::cerr << "Error while writing DyscoStMan data: " << e.what() << '\n';
+  }
 }
 
 template <typename DataType>
 ThreadedDyscoColumn<DataType>::~ThreadedDyscoColumn() {
-  shutdown();
+  shutdownInDestructor();
 }
 
 template <typename DataType>
-void ThreadedDyscoColumn<DataType>::stopThreads() {
-  std::unique_lock<std::mutex> lock(_mutex);
+void ThreadedDyscoColumn<DataType>::ThrowIfEncodingFailed() {
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    error = std::move(_encodingError);
+    _encodingError = nullptr;
+  }
+  if (error) std::rethrow_exception(error);
+}
 
-  if (_threadGroup.empty()) {
-    if (!_cache.empty())
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::stopEncoding() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (!_isEncodingStarted) {
+    if (!_cache.Empty())
       throw DyscoStManError(
           "DyscoStMan is flushed before at least two timeblocks were stored. "
           "DyscoStMan can not handle this situation.");
   } else {
-    // Don't stop threads before cache is empty
-    while (!_cache.empty()) _cacheChangedCondition.wait(lock);
-
-    // Signal threads to stop
-    _stopThreads = true;
-    _cacheChangedCondition.notify_all();
-
-    // Wait for threads to end
-    lock.unlock();
-    _threadGroup.join_all();
+    // Every queued block has a job assigned while any job is active, so
+    // all blocks are written once the last job has finished.
+    while (_nActiveJobs != 0) _jobsFinishedCondition.wait(lock);
+    _isEncodingStarted = false;
+    _freeEncoderStates.clear();
   }
+  _freeBuffers.clear();
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::stopReadAhead() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (_nActiveReadAheadJobs != 0) _readAheadCondition.wait(lock);
+  _readAheadBlocks.clear();
+  _freeDecoderStates.clear();
 }
 
 template <typename DataType>
@@ -76,31 +108,282 @@ void ThreadedDyscoColumn<DataType>::setShapeColumn(
 }
 
 template <typename DataType>
-void ThreadedDyscoColumn<DataType>::loadBlock(size_t blockIndex) {
-  if (blockIndex < nBlocksInFile()) {
-    readCompressedData(blockIndex, _packedBlockReadBuffer.data(), _blockSize);
-    const size_t nPolarizations = _shape[0], nChannels = _shape[1],
-                 nRows = nRowsInBlock(),
-                 nMetaFloats = metaDataFloatCount(nRows, nPolarizations,
-                                                  nChannels, _antennaCount);
-    unsigned char *symbolStart =
-        _packedBlockReadBuffer.data() + nMetaFloats * sizeof(float);
-    BytePacker::unpack(_bitsPerSymbol, _unpackedSymbolReadBuffer.data(),
-                       symbolStart,
-                       symbolCount(nRows, nPolarizations, nChannels));
-    float *metaData = reinterpret_cast<float *>(_packedBlockReadBuffer.data());
-    initializeDecode(_timeBlockBuffer.get(), metaData, nRows, _antennaCount);
-    uint64_t startRow = getRowIndex(blockIndex);
-    _timeBlockBuffer->resize(nRows);
-    for (size_t blockRow = 0; blockRow != nRows; ++blockRow) {
-      int a1 = (*_ant1Col)(startRow + blockRow),
-          a2 = (*_ant2Col)(startRow + blockRow);
-      decode(_timeBlockBuffer.get(), _unpackedSymbolReadBuffer.data(), blockRow,
-             a1, a2);
+void ThreadedDyscoColumn<DataType>::readBlock(size_t blockIndex,
+                                              JobState &state) {
+  readCompressedData(blockIndex, state.packedSymbolBuffer.data(), _blockSize);
+  const size_t nRows = nRowsInBlock();
+  float *metaData = reinterpret_cast<float *>(state.packedSymbolBuffer.data());
+  initializeDecode(state.userData.get(), metaData, nRows, _antennaCount);
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::readBlockForDecoding(size_t blockIndex) {
+  if (blockIndex == _readStateBlock) return;
+  readBlock(blockIndex, _readState);
+  _readStateBlock = blockIndex;
+}
+
+template <typename DataType>
+unsigned char *ThreadedDyscoColumn<DataType>::packedSymbols(JobState &state) {
+  const size_t nPolarizations = _shape[0], nChannels = _shape[1],
+               nMetaFloats = metaDataFloatCount(nRowsInBlock(), nPolarizations,
+                                                nChannels, _antennaCount);
+  return state.packedSymbolBuffer.data() + nMetaFloats * sizeof(float);
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::unpackSlice(JobState &state,
+                                                size_t blockRow, size_t nRows,
+                                                const RowSlice &slice) {
+  const size_t nPolarizations = _shape[0], nChannels = _shape[1],
+               symbolsPerRow = symbolCount(1, nPolarizations, nChannels),
+               symbolsPerChannel = symbolsPerRow / nChannels;
+  unsigned char *symbolStart = packedSymbols(state);
+  // With a channel stride, the symbols of each channel are unpacked
+  // separately; otherwise the channel range is unpacked at once
+  const size_t rangeCount =
+      slice.channelStride == 1 ? 1 : slice.channelCount;
+  const size_t rangeLength =
+      slice.channelStride == 1 ? slice.channelCount : 1;
+  for (size_t row = blockRow; row != blockRow + nRows; ++row) {
+    for (size_t range = 0; range != rangeCount; ++range) {
+      const size_t channel =
+          slice.channelStart + range * slice.channelStride;
+      BytePacker::unpackRange(
+          _bitsPerSymbol, state.unpackedSymbolBuffer.data(), symbolStart,
+          row * symbolsPerRow + channel * symbolsPerChannel,
+          rangeLength * symbolsPerChannel);
     }
   }
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::loadBlock(size_t blockIndex,
+                                              bool decodeLazily) {
   _currentBlock = blockIndex;
   _isCurrentBlockChanged = false;
+  _decodedRows.clear();
+  if (blockIndex < nBlocksInFile()) {
+    readBlockForDecoding(blockIndex);
+    const size_t nRows = nRowsInBlock();
+    _timeBlockBuffer->ResizeUninitialized(nRows);
+    _decodedRows.assign(nRows, false);
+    _nDecodedRows = 0;
+    if (!decodeLazily) decodeRows(0, nRows);
+  }
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::decodeRows(size_t blockRow,
+                                               size_t nRows) {
+  if (_decodedRows.empty()) return;
+  // The packed data of another block might have been read in the mean time
+  readBlockForDecoding(_currentBlock);
+  const unsigned char *symbols = packedSymbols(_readState);
+  const uint64_t blockStartRow = getRowIndex(_currentBlock);
+  const size_t endRow = blockRow + nRows;
+  size_t row = blockRow;
+  while (row != endRow) {
+    if (_decodedRows[row]) {
+      ++row;
+    } else {
+      // Decode the rows up to the next decoded row at once
+      size_t rangeEnd = row + 1;
+      while (rangeEnd != endRow && !_decodedRows[rangeEnd]) ++rangeEnd;
+      const size_t n = rangeEnd - row;
+      const casacore::Slicer rowRange{
+          casacore::IPosition(1, blockStartRow + row),
+          casacore::IPosition(1, n)};
+      const casacore::Vector<int> ant1 = _ant1Col->getColumnRange(rowRange),
+                                  ant2 = _ant2Col->getColumnRange(rowRange);
+      for (size_t i = 0; i != n; ++i) {
+        const int a1 = ant1.data()[i], a2 = ant2.data()[i];
+        _timeBlockBuffer->SetAntennas(row + i, a1, a2);
+        decode(_readState.userData.get(), symbols, row + i, a1, a2,
+               _timeBlockBuffer->Row(row + i));
+        _decodedRows[row + i] = true;
+      }
+      _nDecodedRows += n;
+      row = rangeEnd;
+    }
+  }
+  if (_nDecodedRows == _decodedRows.size()) _decodedRows.clear();
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::loadBlockForReading(size_t blockIndex) {
+  if (_isCurrentBlockChanged)
+    storeBlock();
+  else
+    cacheCurrentBlock();
+  std::unique_ptr<TimeBlockBuffer<data_t>> buffer =
+      _decodedBlocks.Take(blockIndex);
+  if (!buffer) {
+    buffer = takeReadAheadBlock(blockIndex);
+    if (buffer) ++_readAheadHits;
+  }
+  if (buffer) {
+    recycleBuffer(std::move(_timeBlockBuffer));
+    _timeBlockBuffer = std::move(buffer);
+    _currentBlock = blockIndex;
+    _isCurrentBlockChanged = false;
+    _decodedRows.clear();
+  } else {
+    loadBlock(blockIndex, true);
+  }
+  scheduleReadAhead(blockIndex);
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::cacheCurrentBlock() {
+  const size_t maxSize = size_t(storageManager().DecodedCacheSize()) << 20;
+  if (maxSize != _decodedBlocks.MaxSize()) {
+    for (std::unique_ptr<TimeBlockBuffer<data_t>> &evicted :
+         _decodedBlocks.SetMaxSize(maxSize))
+      recycleBuffer(std::move(evicted));
+  }
+  // A block that is not (fully) stored in the file is not decoded
+  if (maxSize == 0 || _currentBlock >= nBlocksInFile() ||
+      _timeBlockBuffer->NRows() != nRowsInBlock())
+    return;
+  // Cached blocks are complete, so that they can be used without the packed
+  // data
+  decodeRows(0, nRowsInBlock());
+  const size_t size = _timeBlockBuffer->NRows() *
+                      _timeBlockBuffer->ValuesPerRow() * sizeof(data_t);
+  for (std::unique_ptr<TimeBlockBuffer<data_t>> &evicted :
+       _decodedBlocks.Store(_currentBlock, std::move(_timeBlockBuffer), size))
+    recycleBuffer(std::move(evicted));
+  _timeBlockBuffer = takeFreeBuffer();
+  _currentBlock = std::numeric_limits<size_t>::max();
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::scheduleReadAhead(size_t blockIndex) {
+  const size_t blockCount = storageManager().ReadAheadBlockCount();
+  if (blockCount == 0) return;
+  const size_t endBlock =
+      std::min<size_t>(nBlocksInFile(), blockIndex + 1 + blockCount);
+  {
+    // Decoded blocks outside the read-ahead range are not expected to be read
+    // soon
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto iter = _readAheadBlocks.begin();
+    while (iter != _readAheadBlocks.end()) {
+      if (iter->second.isFinished &&
+          (iter->first <= blockIndex || iter->first >= endBlock)) {
+        iter->second.buffer->ResetData();
+        _freeBuffers.emplace_back(std::move(iter->second.buffer));
+        iter = _readAheadBlocks.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  }
+  const size_t nRows = nRowsInBlock();
+  for (size_t block = blockIndex + 1; block < endBlock; ++block) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_readAheadBlocks.count(block) != 0) continue;
+    }
+    // Blocks in the write cache are read once they are written
+    if (_cache.Contains(block) || _decodedBlocks.Contains(block)) continue;
+
+    // The antennas are read here, because the table may only be accessed from
+    // this thread.
+    std::unique_ptr<TimeBlockBuffer<data_t>> buffer = takeFreeBuffer();
+    const casacore::Slicer rowRange{casacore::IPosition(1, getRowIndex(block)),
+                                    casacore::IPosition(1, nRows)};
+    const casacore::Vector<int> ant1 = _ant1Col->getColumnRange(rowRange),
+                                ant2 = _ant2Col->getColumnRange(rowRange);
+    buffer->resize(nRows);
+    for (size_t blockRow = 0; blockRow != nRows; ++blockRow)
+      buffer->SetAntennas(blockRow, ant1.data()[blockRow],
+                          ant2.data()[blockRow]);
+
+    TimeBlockBuffer<data_t> *bufferPtr = buffer.get();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _readAheadBlocks.emplace(block, ReadAheadBlock{std::move(buffer), false});
+    ++_nActiveReadAheadJobs;
+    ThreadPool::Instance().Submit(
+        [this, block, bufferPtr]() { runReadAheadJob(block, bufferPtr); });
+  }
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::runReadAheadJob(
+    size_t blockIndex, TimeBlockBuffer<data_t> *buffer) {
+  std::unique_ptr<JobState> state;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_freeDecoderStates.empty()) {
+      // Rows are decoded from the packed symbols, so no unpacked symbol
+      // buffer is needed
+      state.reset(new JobState());
+      state->packedSymbolBuffer.resize(_blockSize);
+      state->userData = initializeDecodeThread();
+    } else {
+      state = std::move(_freeDecoderStates.back());
+      _freeDecoderStates.pop_back();
+    }
+  }
+
+  std::exception_ptr error;
+  try {
+    readBlock(blockIndex, *state);
+    const unsigned char *symbols = packedSymbols(*state);
+    for (size_t blockRow = 0; blockRow != buffer->NRows(); ++blockRow) {
+      decode(state->userData.get(), symbols, blockRow,
+             buffer->Antenna1(blockRow), buffer->Antenna2(blockRow),
+             buffer->Row(blockRow));
+    }
+  } catch (std::exception &) {
+    // The error is rethrown when the block is taken by the reader, as it may
+    // not be reported elsewhere, e.g. when it was a deferred write error.
+    error = std::current_exception();
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _freeDecoderStates.emplace_back(std::move(state));
+  ReadAheadBlock &block = _readAheadBlocks.find(blockIndex)->second;
+  block.isFinished = true;
+  block.error = error;
+  --_nActiveReadAheadJobs;
+  // Notify while holding the lock, as the column may be destructed as soon
+  // as the waiting thread continues.
+  _readAheadCondition.notify_all();
+}
+
+template <typename DataType>
+std::unique_ptr<TimeBlockBuffer<DataType>>
+ThreadedDyscoColumn<DataType>::takeReadAheadBlock(size_t blockIndex) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  auto iter = _readAheadBlocks.find(blockIndex);
+  while (iter != _readAheadBlocks.end() && !iter->second.isFinished) {
+    _readAheadCondition.wait(lock);
+    iter = _readAheadBlocks.find(blockIndex);
+  }
+  if (iter == _readAheadBlocks.end()) return nullptr;
+  std::unique_ptr<TimeBlockBuffer<data_t>> buffer =
+      std::move(iter->second.buffer);
+  const std::exception_ptr error = iter->second.error;
+  _readAheadBlocks.erase(iter);
+  if (error) {
+    buffer->ResetData();
+    _freeBuffers.emplace_back(std::move(buffer));
+    std::rethrow_exception(error);
+  }
+  return buffer;
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::recycleBuffer(
+    std::unique_ptr<TimeBlockBuffer<data_t>> buffer) {
+  if (buffer) {
+    buffer->ResetData();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _freeBuffers.emplace_back(std::move(buffer));
+  }
 }
 
 template <typename DataType>
@@ -120,58 +403,111 @@ void ThreadedDyscoColumn<DataType>::getValues(
       // Make sure array storage is contiguous.
       casacore::Bool deleteIt;
       DataType* dataPtr = dataArr->getStorage (deleteIt);
-      std::unique_lock<std::mutex> lock(_mutex);
       // Wait until the block to be read is not in the write cache
-      typename cache_t::const_iterator cacheItemPtr = _cache.find(blockIndex);
-      while (cacheItemPtr != _cache.end()) {
-        _cacheChangedCondition.wait(lock);
-        cacheItemPtr = _cache.find(blockIndex);
-      }
-      lock.unlock();
+      _cache.WaitWhileQueued(blockIndex);
 
-      if (_currentBlock != blockIndex) {
-        if (_isCurrentBlockChanged) storeBlock();
-        loadBlock(blockIndex);
-      }
+      if (_currentBlock != blockIndex) loadBlockForReading(blockIndex);
 
-      // The time block encoder is now initialized and contains the unpacked
-      // block.
-      _timeBlockBuffer->GetData(getRowWithinBlock(rowNr), dataPtr);
+      const size_t blockRow = getRowWithinBlock(rowNr);
+      decodeRows(blockRow, 1);
+      _timeBlockBuffer->GetData(blockRow, dataPtr);
       dataArr->putStorage (dataPtr, deleteIt);
     }
   }
 }
 
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::getRows(uint64_t startRow, uint64_t nRows,
+                                            data_t *data) {
+  const size_t valuesPerRow = _shape[0] * _shape[1];
+  if (!areOffsetsInitialized()) {
+    // Trying to read before first block was written -- return zero
+    std::fill_n(data, nRows * valuesPerRow, data_t());
+    return;
+  }
+  while (nRows != 0) {
+    const size_t blockIndex = getBlockIndex(startRow);
+    const size_t blockRow = getRowWithinBlock(startRow);
+    const uint64_t n = rowsInSameBlock(startRow, nRows);
+    if (blockIndex >= nBlocksInFile()) {
+      // Trying to read rows that were not stored yet -- return zero
+      std::fill_n(data, n * valuesPerRow, data_t());
+    } else {
+      // Wait until the block to be read is not in the write cache
+      _cache.WaitWhileQueued(blockIndex);
+      // With read-ahead or a decoded block cache, the block is likely decoded
+      // already, and it should be kept for later reads
+      if (blockIndex != _currentBlock &&
+          (storageManager().ReadAheadBlockCount() != 0 ||
+           storageManager().DecodedCacheSize() != 0))
+        loadBlockForReading(blockIndex);
+      if (blockIndex == _currentBlock) {
+        decodeRows(blockRow, n);
+        std::copy_n(_timeBlockBuffer->Row(blockRow), n * valuesPerRow, data);
+      } else {
+        readBlockForDecoding(blockIndex);
+        const unsigned char *symbols = packedSymbols(_readState);
+        const casacore::Slicer rowRange{casacore::IPosition(1, startRow),
+                                        casacore::IPosition(1, n)};
+        const casacore::Vector<int> ant1 = _ant1Col->getColumnRange(rowRange),
+                                    ant2 = _ant2Col->getColumnRange(rowRange);
+        for (size_t i = 0; i != n; ++i) {
+          decode(_readState.userData.get(), symbols, blockRow + i,
+                 ant1.data()[i], ant2.data()[i], data + i * valuesPerRow);
+        }
+      }
+    }
+    startRow += n;
+    nRows -= n;
+    data += n * valuesPerRow;
+  }
+}
+
 template <typename DataType>
 void ThreadedDyscoColumn<DataType>::storeBlock() {
   // Put the data of the current block into the cache so that the parallell
-  // threads can write them
-  std::unique_lock<std::mutex> lock(_mutex);
-  CacheItem *item = new CacheItem(std::move(_timeBlockBuffer));
-  // Wait until there is space available AND the row to be written is not in the
-  // cache
-  typename cache_t::iterator cacheItemPtr = _cache.find(_currentBlock);
-  while (_cache.size() >= maxCacheSize() || cacheItemPtr != _cache.end()) {
-    _cacheChangedCondition.wait(lock);
-    cacheItemPtr = _cache.find(_currentBlock);
-  }
-  _cache.insert(typename cache_t::value_type(_currentBlock, item));
-  _cacheChangedCondition.notify_all();
-  lock.unlock();
+  // threads can write them. Wait until the block to be written is not in the
+  // cache; Push() subsequently waits until there is space available.
+  _cache.WaitWhileQueued(_currentBlock);
+  // The block in the file will change, so its unpacked symbols and its
+  // decoded copies are outdated
+  if (_readStateBlock == _currentBlock)
+    _readStateBlock = std::numeric_limits<size_t>::max();
+  recycleBuffer(takeReadAheadBlock(_currentBlock));
+  recycleBuffer(_decodedBlocks.Erase(_currentBlock));
+  const bool isQueued =
+      _cache.Push(_currentBlock, std::move(_timeBlockBuffer));
+  _timeBlockBuffer = takeFreeBuffer();
+  // The column does not stop its cache, so this indicates a bug
+  if (!isQueued)
+    throw DyscoStManError("Block could not be queued: write cache is stopped");
+  scheduleEncoding();
 
   _isCurrentBlockChanged = false;
+}
+
+template <typename DataType>
+std::unique_ptr<TimeBlockBuffer<DataType>>
+ThreadedDyscoColumn<DataType>::takeFreeBuffer() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_freeBuffers.empty()) {
+      std::unique_ptr<TimeBlockBuffer<data_t>> buffer =
+          std::move(_freeBuffers.back());
+      _freeBuffers.pop_back();
+      return buffer;
+    }
+  }
   const size_t nPolarizations = _shape[0], nChannels = _shape[1];
-  _timeBlockBuffer.reset(
+  std::unique_ptr<TimeBlockBuffer<data_t>> buffer(
       new TimeBlockBuffer<data_t>(nPolarizations, nChannels));
-  //_timeBlockBuffer->SetNAntennae(_antennaCount);
+  if (areOffsetsInitialized()) buffer->Reserve(nRowsInBlock());
+  return buffer;
 }
 
 template <typename DataType>
-void ThreadedDyscoColumn<DataType>::putValues(
-    casacore::uInt rowNr, const casacore::Array<DataType> *dataArr) {
-  // Make sure array storage is contiguous.
-  casacore::Bool deleteIt;
-  const DataType* dataPtr = dataArr->getStorage (deleteIt);
+size_t ThreadedDyscoColumn<DataType>::prepareRowForWriting(uint64_t rowNr) {
+  ThrowIfEncodingFailed();
   if (!areOffsetsInitialized()) {
     // If the manager did not initialize its offsets yet, then it is determined
     // from the first "time block" (a block with the same time, field and spw)
@@ -198,10 +534,8 @@ void ThreadedDyscoColumn<DataType>::putValues(
     }
   }
 
-  const int ant1 = (*_ant1Col)(rowNr), ant2 = (*_ant2Col)(rowNr);
   if (areOffsetsInitialized()) {
-    const size_t blockIndex = getBlockIndex(rowNr),
-                 blockRow = getRowWithinBlock(rowNr);
+    const size_t blockIndex = getBlockIndex(rowNr);
 
     // Is this the first row of a new block?
     if (blockIndex != _currentBlock) {
@@ -209,26 +543,260 @@ void ThreadedDyscoColumn<DataType>::putValues(
 
       // Load new block
       loadBlock(blockIndex);
+    } else {
+      // The block might have been loaded for reading; all rows are encoded
+      // when it is stored
+      decodeRows(0, nRowsInBlock());
     }
-    _timeBlockBuffer->SetData(blockRow, ant1, ant2, dataPtr);
+    return getRowWithinBlock(rowNr);
   } else {
-    _timeBlockBuffer->SetData(rowNr, ant1, ant2, dataPtr);
+    return rowNr;
   }
+}
+
+template <typename DataType>
+uint64_t ThreadedDyscoColumn<DataType>::rowsInSameBlock(
+    uint64_t rowNr, uint64_t maxRows) const {
+  if (!areOffsetsInitialized()) return 1;
+  return std::min<uint64_t>(maxRows, nRowsInBlock() - getRowWithinBlock(rowNr));
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::putValues(
+    casacore::uInt rowNr, const casacore::Array<DataType> *dataArr) {
+  // Make sure array storage is contiguous.
+  casacore::Bool deleteIt;
+  const DataType* dataPtr = dataArr->getStorage (deleteIt);
+  const size_t blockRow = prepareRowForWriting(rowNr);
+  const int ant1 = (*_ant1Col)(rowNr), ant2 = (*_ant2Col)(rowNr);
+  _timeBlockBuffer->SetData(blockRow, ant1, ant2, dataPtr);
   _isCurrentBlockChanged = true;
   dataArr->freeStorage (dataPtr, deleteIt);
 }
 
+template <typename DataType>
+DataType *ThreadedDyscoColumn<DataType>::getSliceRows(uint64_t startRow,
+                                                      uint64_t nRows,
+                                                      const RowSlice &slice,
+                                                      data_t *data) {
+  const size_t nPolarizations = _shape[0], sliceSize = slice.Size();
+  if (!areOffsetsInitialized()) {
+    // Trying to read before first block was written -- return zero
+    return std::fill_n(data, nRows * sliceSize, data_t());
+  }
+  while (nRows != 0) {
+    const size_t blockIndex = getBlockIndex(startRow);
+    const size_t blockRow = getRowWithinBlock(startRow);
+    const uint64_t n = rowsInSameBlock(startRow, nRows);
+    if (blockIndex >= nBlocksInFile()) {
+      // Trying to read rows that were not stored yet -- return zero
+      data = std::fill_n(data, n * sliceSize, data_t());
+    } else {
+      _cache.WaitWhileQueued(blockIndex);
+      if (blockIndex != _currentBlock &&
+          (storageManager().ReadAheadBlockCount() != 0 ||
+           storageManager().DecodedCacheSize() != 0))
+        loadBlockForReading(blockIndex);
+      const bool isCurrent = blockIndex == _currentBlock;
+      bool isRead = false;
+      casacore::Vector<int> ant1, ant2;
+      for (size_t i = 0; i != n; ++i) {
+        const size_t row = blockRow + i;
+        if (isCurrent && isRowDecoded(row)) {
+          const data_t *rowData = _timeBlockBuffer->Row(row);
+          for (size_t c = 0; c != slice.channelCount; ++c) {
+            const size_t ch = slice.channelStart + c * slice.channelStride;
+            for (size_t p = 0; p != slice.polarizationCount; ++p) {
+              *data = rowData[ch * nPolarizations + slice.polarizationStart +
+                              p * slice.polarizationStride];
+              ++data;
+            }
+          }
+        } else {
+          if (!isRead) {
+            readBlockForDecoding(blockIndex);
+            const casacore::Slicer rowRange{casacore::IPosition(1, startRow),
+                                            casacore::IPosition(1, n)};
+            ant1 = _ant1Col->getColumnRange(rowRange);
+            ant2 = _ant2Col->getColumnRange(rowRange);
+            isRead = true;
+          }
+          unpackSlice(_readState, row, 1, slice);
+          decodeSlice(_readState.userData.get(),
+                      _readState.unpackedSymbolBuffer.data(), row,
+                      ant1.data()[i], ant2.data()[i], slice, data);
+          data += sliceSize;
+        }
+      }
+    }
+    startRow += n;
+    nRows -= n;
+  }
+  return data;
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::putRows(uint64_t startRow, uint64_t nRows,
+                                            const data_t *data) {
+  const size_t nPolarizations = _shape[0], nChannels = _shape[1];
+  while (nRows != 0) {
+    const size_t blockRow = prepareRowForWriting(startRow);
+    const uint64_t n = rowsInSameBlock(startRow, nRows);
+    const casacore::Slicer rowRange{casacore::IPosition(1, startRow),
+                                    casacore::IPosition(1, n)};
+    const casacore::Vector<int> ant1 = _ant1Col->getColumnRange(rowRange),
+                                ant2 = _ant2Col->getColumnRange(rowRange);
+    _timeBlockBuffer->SetRows(blockRow, n, ant1.data(), ant2.data(), data);
+    _isCurrentBlockChanged = true;
+    startRow += n;
+    nRows -= n;
+    data += n * nPolarizations * nChannels;
+  }
+}
+
+template <typename DataType>
+const DataType *ThreadedDyscoColumn<DataType>::putSliceRows(
+    uint64_t startRow, uint64_t nRows, const casacore::Slicer &slicer,
+    const data_t *data) {
+  const size_t nPolarizations = _shape[0];
+  const casacore::IPosition start = slicer.start(), end = slicer.end(),
+                            stride = slicer.stride();
+  while (nRows != 0) {
+    const size_t blockRow = prepareRowForWriting(startRow);
+    const uint64_t n = rowsInSameBlock(startRow, nRows);
+    const casacore::Slicer rowRange{casacore::IPosition(1, startRow),
+                                    casacore::IPosition(1, n)};
+    const casacore::Vector<int> ant1 = _ant1Col->getColumnRange(rowRange),
+                                ant2 = _ant2Col->getColumnRange(rowRange);
+    for (size_t i = 0; i != n; ++i) {
+      // Values outside the slice of a row that was not written before are
+      // zero
+      const size_t row = blockRow + i;
+      if (_timeBlockBuffer->NRows() <= row) _timeBlockBuffer->resize(row + 1);
+      _timeBlockBuffer->SetAntennas(row, ant1.data()[i], ant2.data()[i]);
+      data_t *rowData = _timeBlockBuffer->Row(row);
+      for (long ch = start[1]; ch <= end[1]; ch += stride[1]) {
+        for (long p = start[0]; p <= end[0]; p += stride[0]) {
+          rowData[ch * nPolarizations + p] = *data;
+          ++data;
+        }
+      }
+    }
+    _isCurrentBlockChanged = true;
+    startRow += n;
+    nRows -= n;
+  }
+  return data;
+}
+
+namespace {
+// Calls function(startRow, nRows) for every range of consecutive rows
+template <typename Function>
+void forEachRowRange(const casacore::RefRows &rowNrs, Function function) {
+  casacore::RefRowsSliceIter iter(rowNrs);
+  while (!iter.pastEnd()) {
+    const uint64_t start = iter.sliceStart(), end = iter.sliceEnd(),
+                   increment = iter.sliceIncr();
+    if (increment == 1) {
+      function(start, end + 1 - start);
+    } else {
+      for (uint64_t row = start; row <= end; row += increment) function(row, 1);
+    }
+    ++iter;
+  }
+}
+}  // namespace
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::getColumnValues(
+    const casacore::RefRows *rowNrs, casacore::Array<DataType> *dataArr) {
+  const size_t nPolarizations = _shape[0], nChannels = _shape[1];
+  // Make sure array storage is contiguous.
+  casacore::Bool deleteIt;
+  DataType *dataPtr = dataArr->getStorage(deleteIt);
+  DataType *position = dataPtr;
+  auto getRange = [&](uint64_t startRow, uint64_t nRows) {
+    getRows(startRow, nRows, position);
+    position += nRows * nPolarizations * nChannels;
+  };
+  if (rowNrs)
+    forEachRowRange(*rowNrs, getRange);
+  else
+    getRange(0, dataArr->nelements() / (nPolarizations * nChannels));
+  dataArr->putStorage(dataPtr, deleteIt);
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::getSliceValues(
+    const casacore::RefRows *rowNrs, const casacore::Slicer &slicer,
+    casacore::Array<DataType> *dataArr) {
+  const casacore::IPosition start = slicer.start(), length = slicer.length(),
+                            stride = slicer.stride();
+  const RowSlice slice{size_t(start[0]),  size_t(length[0]),
+                       size_t(stride[0]), size_t(start[1]),
+                       size_t(length[1]), size_t(stride[1])};
+  casacore::Bool deleteIt;
+  DataType *dataPtr = dataArr->getStorage(deleteIt);
+  DataType *position = dataPtr;
+  auto getRange = [&](uint64_t startRow, uint64_t nRows) {
+    position = getSliceRows(startRow, nRows, slice, position);
+  };
+  if (rowNrs)
+    forEachRowRange(*rowNrs, getRange);
+  else
+    getRange(0, dataArr->nelements() / slice.Size());
+  dataArr->putStorage(dataPtr, deleteIt);
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::putColumnValues(
+    const casacore::RefRows *rowNrs, const casacore::Array<DataType> *dataArr) {
+  const size_t nPolarizations = _shape[0], nChannels = _shape[1];
+  casacore::Bool deleteIt;
+  const DataType *dataPtr = dataArr->getStorage(deleteIt);
+  const DataType *position = dataPtr;
+  auto putRange = [&](uint64_t startRow, uint64_t nRows) {
+    putRows(startRow, nRows, position);
+    position += nRows * nPolarizations * nChannels;
+  };
+  if (rowNrs)
+    forEachRowRange(*rowNrs, putRange);
+  else
+    putRange(0, dataArr->nelements() / (nPolarizations * nChannels));
+  dataArr->freeStorage(dataPtr, deleteIt);
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::putSliceValues(
+    const casacore::RefRows *rowNrs, const casacore::Slicer &slicer,
+    const casacore::Array<DataType> *dataArr) {
+  casacore::Bool deleteIt;
+  const DataType *dataPtr = dataArr->getStorage(deleteIt);
+  const DataType *position = dataPtr;
+  auto putRange = [&](uint64_t startRow, uint64_t nRows) {
+    position = putSliceRows(startRow, nRows, slicer, position);
+  };
+  if (rowNrs)
+    forEachRowRange(*rowNrs, putRange);
+  else
+    putRange(0, dataArr->nelements() / slicer.length().product());
+  dataArr->freeStorage(dataPtr, deleteIt);
+}
+
 template <typename DataType>
 void ThreadedDyscoColumn<DataType>::Prepare(DyscoDistribution, Normalization,
                                             double /*studentsTNu*/,
                                             double /*distributionTruncation*/) {
-  stopThreads();
+  stopReadAhead();
+  stopEncoding();
+  _decodedBlocks.Clear();
   casacore::Table &table = storageManager().table();
   _ant1Col.reset(new casacore::ScalarColumn<int>(table, "ANTENNA1"));
   _ant2Col.reset(new casacore::ScalarColumn<int>(table, "ANTENNA2"));
   _fieldCol.reset(new casacore::ScalarColumn<int>(table, "FIELD_ID"));
   _dataDescIdCol.reset(new casacore::ScalarColumn<int>(table, "DATA_DESC_ID"));
   _timeCol.reset(new casacore::ScalarColumn<double>(table, "TIME"));
+  _cache.Reset(maxCacheSize());
 
   size_t nPolarizations = _shape[0], nChannels = _shape[1];
   _timeBlockBuffer.reset(
@@ -237,40 +805,63 @@ void ThreadedDyscoColumn<DataType>::Prepare(DyscoDistribution, Normalization,
     // TODO _timeBlockEncoder->SetNAntennae(_antennaCount);
   }
   _currentBlock = std::numeric_limits<size_t>::max();
+  _readStateBlock = std::numeric_limits<size_t>::max();
+  _decodedRows.clear();
 }
 
 template <typename DataType>
-size_t ThreadedDyscoColumn<DataType>::defaultThreadCount() const {
-  // Don't spawn more than 8 threads; it causes problems in NDPPP
-  return std::min(8l, sysconf(_SC_NPROCESSORS_ONLN));
+size_t ThreadedDyscoColumn<DataType>::encoderThreadCount() const {
+  const size_t threadCount = storageManager().EncoderThreadCount();
+  if (threadCount != 0) return threadCount;
+  // Don't use more than 8 threads by default; it causes problems in NDPPP
+  return std::min<size_t>(8, ThreadPool::Instance().NThreads());
 }
 
 template <typename DataType>
 void ThreadedDyscoColumn<DataType>::InitializeAfterNRowsPerBlockIsKnown() {
-  stopThreads();
+  stopReadAhead();
+  stopEncoding();
+  _decodedBlocks.Clear();
   if (_bitsPerSymbol == 0)
     throw DyscoStManError(
         "bitsPerSymbol not initialized in ThreadedDyscoColumn");
 
   _antennaCount = nAntennae();
   _blockSize = CalculateBlockSize(nRowsInBlock(), _antennaCount);
-  _packedBlockReadBuffer.resize(_blockSize);
   const size_t nPolarizations = _shape[0], nChannels = _shape[1];
-  _unpackedSymbolReadBuffer.resize(
+  _readState.packedSymbolBuffer.resize(_blockSize);
+  _readState.unpackedSymbolBuffer.resize(
       symbolCount(nRowsInBlock(), nPolarizations, nChannels));
+  _readState.userData = initializeDecodeThread();
+  _readStateBlock = std::numeric_limits<size_t>::max();
+  _decodedRows.clear();
   // TODO _timeBlockEncoder->SetNAntennae(_antennaCount);
 
-  // start the threads
-  size_t threadCount = defaultThreadCount();
-  EncodingThreadFunctor functor;
-  functor.parent = this;
-  _stopThreads = false;
-  for (size_t i = 0; i != threadCount; ++i) _threadGroup.create_thread(functor);
+  _cache.Reset(maxCacheSize());
+  std::lock_guard<std::mutex> lock(_mutex);
+  _maxActiveJobs = encoderThreadCount();
+  _nUnassignedBlocks = 0;
+  _isEncodingStarted = true;
+}
+
+template <typename DataType>
+void ThreadedDyscoColumn<DataType>::scheduleEncoding() {
+  // Every pushed block either gets a new job, or is picked up by an active
+  // job once it finishes its current block. Since the number of jobs equals the
+  // number of pushed blocks, jobs never wait in Acquire().
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_isEncodingStarted && _nActiveJobs < _maxActiveJobs) {
+    ++_nActiveJobs;
+    ThreadPool::Instance().Submit([this]() { runEncodingJob(); });
+  } else {
+    ++_nUnassignedBlocks;
+  }
 }
 
 template <typename DataType>
 void ThreadedDyscoColumn<DataType>::encodeAndWrite(
-    size_t blockIndex, const CacheItem &item, unsigned char *packedSymbolBuffer,
+    size_t blockIndex, TimeBlockBuffer<data_t> &buffer,
+    unsigned char *packedSymbolBuffer,
     unsigned int *unpackedSymbolBuffer, ThreadDataBase *threadUserData) {
   const size_t nPolarizations = _shape[0], nChannels = _shape[1];
   const size_t metaDataSize =
@@ -282,8 +873,8 @@ void ThreadedDyscoColumn<DataType>::encodeAndWrite(
   float *metaBuffer = reinterpret_cast<float *>(packedSymbolBuffer);
   unsigned char *binaryBuffer = packedSymbolBuffer + metaDataSize;
 
-  encode(threadUserData, item.encoder.get(), metaBuffer, unpackedSymbolBuffer,
-         _antennaCount);
+  encode(threadUserData, &buffer, metaBuffer, unpackedSymbolBuffer,
+         _antennaCount, blockIndex);
 
   BytePacker::pack(_bitsPerSymbol, binaryBuffer, unpackedSymbolBuffer,
                    nSymbols);
@@ -293,55 +884,68 @@ void ThreadedDyscoColumn<DataType>::encodeAndWrite(
                       metaDataSize + binarySize);
 }
 
-// Continuously write items from the cache into the measurement
-// set untill asked to quit.
+// Encodes and writes one block from the cache. Only a single block is handled
+// per job, so that the blocks of other columns that share the pool are handled
+// in between.
 template <typename DataType>
-void ThreadedDyscoColumn<DataType>::EncodingThreadFunctor::operator()() {
-  const size_t nPolarizations = parent->_shape[0],
-               nChannels = parent->_shape[1];
-  const size_t nSymbols =
-      parent->symbolCount(parent->nRowsInBlock(), nPolarizations, nChannels);
-
-  std::unique_lock<std::mutex> lock(parent->_mutex);
-  aocommon::UVector<unsigned char> packedSymbolBuffer(parent->_blockSize);
-  aocommon::UVector<unsigned> unpackedSymbolBuffer(nSymbols);
-  cache_t &cache = parent->_cache;
-
-  std::unique_ptr<ThreadDataBase> threadUserData =
-      parent->initializeEncodeThread();
-
-  while (!parent->_stopThreads) {
-    typename cache_t::iterator i;
-    bool isItemAvailable = parent->isWriteItemAvailable(i);
-    while (!isItemAvailable && !parent->_stopThreads) {
-      parent->_cacheChangedCondition.wait(lock);
-      isItemAvailable = parent->isWriteItemAvailable(i);
+void ThreadedDyscoColumn<DataType>::runEncodingJob() {
+  // The job runs on a pool thread, which must not throw. Errors are stored and
+  // rethrown on the thread that uses the column.
+  std::exception_ptr error;
+  std::unique_ptr<JobState> state;
+  try {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_freeEncoderStates.empty()) {
+      const size_t nPolarizations = _shape[0], nChannels = _shape[1];
+      state.reset(new JobState());
+      state->packedSymbolBuffer.resize(_blockSize);
+      state->unpackedSymbolBuffer.resize(
+          symbolCount(nRowsInBlock(), nPolarizations, nChannels));
+      // Initialization might use shared state of the column, such as its
+      // random number generator.
+      state->userData = initializeEncodeThread();
+    } else {
+      state = std::move(_freeEncoderStates.back());
+      _freeEncoderStates.pop_back();
     }
+  } catch (...) {
+    error = std::current_exception();
+    state.reset();
+  }
 
-    if (isItemAvailable) {
-      size_t blockIndex = i->first;
-      CacheItem &item = *i->second;
-      item.isBeingWritten = true;
-
-      lock.unlock();
-      parent->encodeAndWrite(blockIndex, item, &packedSymbolBuffer[0],
-                             &unpackedSymbolBuffer[0], threadUserData.get());
-
-      lock.lock();
-      delete &item;
-      cache.erase(i);
-      parent->_cacheChangedCondition.notify_all();
+  // Acquire() only returns nullptr when the cache is stopped, in which case
+  // the job ends without processing a block.
+  typename cache_t::Slot *slot = _cache.Acquire();
+  std::unique_ptr<TimeBlockBuffer<data_t>> buffer;
+  if (slot) {
+    if (state) {
+      try {
+        encodeAndWrite(slot->blockIndex, *slot->item,
+                       state->packedSymbolBuffer.data(),
+                       state->unpackedSymbolBuffer.data(),
+                       state->userData.get());
+      } catch (...) {
+        error = std::current_exception();
+      }
     }
+    buffer = std::move(slot->item);
+    _cache.Release(slot);
+    buffer->ResetData();
   }
-}
 
-// This function should only be called with a locked mutex
-template <typename DataType>
-bool ThreadedDyscoColumn<DataType>::isWriteItemAvailable(
-    typename cache_t::iterator &i) {
-  i = _cache.begin();
-  while (i != _cache.end() && i->second->isBeingWritten) ++i;
-  return (i != _cache.end());
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (error && !_encodingError) _encodingError = error;
+  if (state) _freeEncoderStates.emplace_back(std::move(state));
+  if (buffer) _freeBuffers.emplace_back(std::move(buffer));
+  if (slot && _nUnassignedBlocks != 0) {
+    --_nUnassignedBlocks;
+    ThreadPool::Instance().Submit([this]() { runEncodingJob(); });
+  } else {
+    --_nActiveJobs;
+    // Notify while holding the lock, as the column may be destructed as soon
+    // as the waiting thread continues.
+    if (_nActiveJobs == 0) _jobsFinishedCondition.notify_all();
+  }
 }
 
 template <typename DataType>
@@ -4,19 +4,25 @@
 #include <casacore/tables/DataMan/DataManError.h>
 
 #include <casacore/casa/Arrays/IPosition.h>
+#include <casacore/casa/Arrays/Slicer.h>
+#include <casacore/tables/DataMan/RefRows.h>
 #include <casacore/tables/Tables/ScalarColumn.h>
 
 #include <condition_variable>
 #include <cstdint>
+#include <exception>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <random>
+#include <vector>
 
+#include "blockqueue.h"
+#include "decodedblockcache.h"
 #include "dyscostmancol.h"
+#include "rowslice.h"
 #include "serializable.h"
 #include "stochasticencoder.h"
-#include "threadgroup.h"
 #include "timeblockbuffer.h"
 
 namespace dyscostman {
@@ -75,10 +81,78 @@ class ThreadedDyscoColumn : public DyscoStManColumn {
     return DyscoStManColumn::getArrayfloatV(rowNr, dataPtr);
   }
 
+  /**
+   * Read the values of all rows. Rows are decoded directly into the array,
+   * without copying them through the buffer of the current block.
+   * @param dataPtr The array of values, with the row as last dimension.
+   */
+  virtual void getArrayColumnComplexV(
+      casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::getArrayColumnComplexV(dataPtr);
+  }
+  virtual void getArrayColumnfloatV(casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::getArrayColumnfloatV(dataPtr);
+  }
+
+  /**
+   * Read the values of a set of rows. Like getArrayColumn..V(), the rows are
+   * decoded directly into the array.
+   */
+  virtual void getArrayColumnCellsComplexV(
+      const casacore::RefRows &rowNrs,
+      casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::getArrayColumnCellsComplexV(rowNrs, dataPtr);
+  }
+  virtual void getArrayColumnCellsfloatV(
+      const casacore::RefRows &rowNrs,
+      casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::getArrayColumnCellsfloatV(rowNrs, dataPtr);
+  }
+
+  /**
+   * Read part of the values of a row. Only the symbols of the selected values
+   * are unpacked and decoded, unless the row is decoded already.
+   */
+  virtual void getSliceComplexV(
+      casacore::uInt rowNr, const casacore::Slicer &slicer,
+      casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::getSliceComplexV(rowNr, slicer, dataPtr);
+  }
+  virtual void getSlicefloatV(casacore::uInt rowNr,
+                              const casacore::Slicer &slicer,
+                              casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::getSlicefloatV(rowNr, slicer, dataPtr);
+  }
+
+  /** Read part of the values of all rows. */
+  virtual void getColumnSliceComplexV(
+      const casacore::Slicer &slicer,
+      casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::getColumnSliceComplexV(slicer, dataPtr);
+  }
+  virtual void getColumnSlicefloatV(const casacore::Slicer &slicer,
+                                    casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::getColumnSlicefloatV(slicer, dataPtr);
+  }
+
+  /** Read part of the values of a set of rows. */
+  virtual void getColumnSliceCellsComplexV(
+      const casacore::RefRows &rowNrs, const casacore::Slicer &slicer,
+      casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::getColumnSliceCellsComplexV(rowNrs, slicer,
+                                                         dataPtr);
+  }
+  virtual void getColumnSliceCellsfloatV(
+      const casacore::RefRows &rowNrs, const casacore::Slicer &slicer,
+      casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::getColumnSliceCellsfloatV(rowNrs, slicer,
+                                                       dataPtr);
+  }
+
   /**
    * Write values into a particular row. This will add the values into the cache
-   * and returns immediately afterwards. A pool of threads will encode the items
-   * in the cache and write them to disk.
+   * and returns immediately afterwards. The shared thread pool will encode the
+   * items in the cache and write them to disk.
    * @param rowNr The row number to write the values to.
    * @param dataPtr The data pointer, which should be a contiguous array.
    */
@@ -96,6 +170,76 @@ class ThreadedDyscoColumn : public DyscoStManColumn {
     return DyscoStManColumn::putArrayfloatV(rowNr, dataPtr);
   }
 
+  /**
+   * Write the values of all rows. Rows that belong to the same block are
+   * copied into the block with a single copy.
+   * @param dataPtr The values, with the row as last dimension.
+   */
+  virtual void putArrayColumnComplexV(
+      const casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::putArrayColumnComplexV(dataPtr);
+  }
+  virtual void putArrayColumnfloatV(
+      const casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::putArrayColumnfloatV(dataPtr);
+  }
+
+  /**
+   * Write the values of a set of rows. Like putArrayColumn..V(), ranges of
+   * rows within a block are copied at once.
+   */
+  virtual void putArrayColumnCellsComplexV(
+      const casacore::RefRows &rowNrs,
+      const casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::putArrayColumnCellsComplexV(rowNrs, dataPtr);
+  }
+  virtual void putArrayColumnCellsfloatV(
+      const casacore::RefRows &rowNrs,
+      const casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::putArrayColumnCellsfloatV(rowNrs, dataPtr);
+  }
+
+  /**
+   * Write part of the values of a row. The other values of the row keep their
+   * value.
+   */
+  virtual void putSliceComplexV(
+      casacore::uInt rowNr, const casacore::Slicer &slicer,
+      const casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::putSliceComplexV(rowNr, slicer, dataPtr);
+  }
+  virtual void putSlicefloatV(casacore::uInt rowNr,
+                              const casacore::Slicer &slicer,
+                              const casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::putSlicefloatV(rowNr, slicer, dataPtr);
+  }
+
+  /** Write part of the values of all rows. */
+  virtual void putColumnSliceComplexV(
+      const casacore::Slicer &slicer,
+      const casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::putColumnSliceComplexV(slicer, dataPtr);
+  }
+  virtual void putColumnSlicefloatV(
+      const casacore::Slicer &slicer,
+      const casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::putColumnSlicefloatV(slicer, dataPtr);
+  }
+
+  /** Write part of the values of a set of rows. */
+  virtual void putColumnSliceCellsComplexV(
+      const casacore::RefRows &rowNrs, const casacore::Slicer &slicer,
+      const casacore::Array<casacore::Complex> *dataPtr) override {
+    return DyscoStManColumn::putColumnSliceCellsComplexV(rowNrs, slicer,
+                                                         dataPtr);
+  }
+  virtual void putColumnSliceCellsfloatV(
+      const casacore::RefRows &rowNrs, const casacore::Slicer &slicer,
+      const casacore::Array<float> *dataPtr) override {
+    return DyscoStManColumn::putColumnSliceCellsfloatV(rowNrs, slicer,
+                                                       dataPtr);
+  }
+
   virtual void Prepare(DyscoDistribution distribution,
                        Normalization normalization, double studentsTNu,
                        double distributionTruncation) override;
@@ -105,6 +249,14 @@ class ThreadedDyscoColumn : public DyscoStManColumn {
    */
   virtual void InitializeAfterNRowsPerBlockIsKnown() override;
 
+  /**
+   * Rethrow the first error of the encoding jobs, if any. Blocks are encoded
+   * and written on the threads of the pool, which can not report errors
+   * themselves. The error is also rethrown by the next put or by shutdown(),
+   * and is rethrown only once.
+   */
+  virtual void ThrowIfEncodingFailed() override;
+
   /**
    * Set the bits per symbol. Should only be called by DyscoStMan.
    * @param bitsPerSymbol New number of bits per symbol.
@@ -113,6 +265,18 @@ class ThreadedDyscoColumn : public DyscoStManColumn {
     _bitsPerSymbol = bitsPerSymbol;
   }
 
+  virtual size_t DecodedCacheHits() const override {
+    return _decodedBlocks.Hits();
+  }
+
+  /**
+   * Number of times that a block to be read was not in the cache of decoded
+   * blocks, and was taken from the read-ahead blocks or decoded instead.
+   */
+  size_t DecodedCacheMisses() const { return _decodedBlocks.Misses(); }
+
+  virtual size_t ReadAheadHits() const override { return _readAheadHits; }
+
   virtual size_t CalculateBlockSize(size_t nRowsInBlock,
                                     size_t nAntennae) const final override;
 
@@ -130,18 +294,51 @@ class ThreadedDyscoColumn : public DyscoStManColumn {
 
   typedef typename TimeBlockBuffer<data_t>::symbol_t symbol_t;
 
-  virtual void initializeDecode(TimeBlockBuffer<data_t> *buffer,
+  /**
+   * Create the state for decoding blocks. Blocks may be decoded by several
+   * threads at the same time, each using its own state.
+   */
+  virtual std::unique_ptr<ThreadDataBase> initializeDecodeThread() = 0;
+
+  virtual void initializeDecode(ThreadDataBase *threadData,
                                 const float *metaBuffer, size_t nRow,
                                 size_t nAntennae) = 0;
 
-  virtual void decode(TimeBlockBuffer<data_t> *buffer, const symbol_t *data,
-                      size_t blockRow, size_t a1, size_t a2) = 0;
+  /**
+   * Decode one row of the block that was last passed to initializeDecode()
+   * with the same thread data. The symbols are decoded directly from the
+   * packed data, without unpacking them into a symbol buffer.
+   * @param packedSymbols The packed symbols of the block, which use
+   * getBitsPerSymbol() bits per symbol.
+   * @param destination Receives the values of the row, ordered by channel and
+   * then by polarization.
+   */
+  virtual void decode(ThreadDataBase *threadData,
+                      const unsigned char *packedSymbols, size_t blockRow,
+                      size_t a1, size_t a2, data_t *destination) = 0;
+
+  /**
+   * Like decode(), but decodes only the selected values of the row from
+   * unpacked symbols. Only the symbols of the selected channels need to be
+   * unpacked.
+   * @param destination Receives the slice.Size() selected values.
+   */
+  virtual void decodeSlice(ThreadDataBase *threadData, const symbol_t *data,
+                           size_t blockRow, size_t a1, size_t a2,
+                           const RowSlice &slice, data_t *destination) = 0;
 
   virtual std::unique_ptr<ThreadDataBase> initializeEncodeThread() = 0;
 
+  /**
+   * Encode one block. This is called from the thread pool, possibly for
+   * several blocks at the same time.
+   * @param blockIndex Index of the block in the file, which can be used to
+   * make the result independent of the order in which blocks are encoded.
+   */
   virtual void encode(ThreadDataBase *threadData,
                       TimeBlockBuffer<data_t> *buffer, float *metaBuffer,
-                      symbol_t *symbolBuffer, size_t nAntennae) = 0;
+                      symbol_t *symbolBuffer, size_t nAntennae,
+                      size_t blockIndex) = 0;
 
   virtual size_t metaDataFloatCount(size_t nRow, size_t nPolarizations,
                                     size_t nChannels,
@@ -152,24 +349,34 @@ class ThreadedDyscoColumn : public DyscoStManColumn {
 
   virtual void shutdown() override final;
 
-  virtual size_t defaultThreadCount() const;
+  /**
+   * Call shutdown() from a destructor. Errors can not be thrown at that point,
+   * so they are written to std::cerr.
+   */
+  void shutdownInDestructor();
+
+  /**
+   * Maximum number of blocks of this column that are encoded concurrently by
+   * the shared thread pool. This is the value configured in the storage
+   * manager, or the number of threads in the pool (at most 8) if that is not
+   * set.
+   */
+  virtual size_t encoderThreadCount() const;
 
   size_t getBitsPerSymbol() const { return _bitsPerSymbol; }
 
   const casacore::IPosition &shape() const { return _shape; }
 
  private:
-  struct CacheItem {
-    CacheItem(std::unique_ptr<TimeBlockBuffer<data_t>> &&encoder_)
-        : encoder(std::move(encoder_)), isBeingWritten(false) {}
-
-    std::unique_ptr<TimeBlockBuffer<data_t>> encoder;
-    bool isBeingWritten;
-  };
-
-  struct EncodingThreadFunctor {
-    void operator()();
-    ThreadedDyscoColumn *parent;
+  /**
+   * Buffers and user data used by an encoding or decoding job. These are
+   * reused by subsequent jobs of this column, so there are at most as many of
+   * them as there are concurrent jobs.
+   */
+  struct JobState {
+    std::unique_ptr<ThreadDataBase> userData;
+    aocommon::UVector<unsigned char> packedSymbolBuffer;
+    aocommon::UVector<unsigned> unpackedSymbolBuffer;
   };
   struct Header : public Serializable {
     uint32_t blockSize;
@@ -188,21 +395,161 @@ class ThreadedDyscoColumn : public DyscoStManColumn {
     }
   };
 
-  typedef std::map<size_t, CacheItem *> cache_t;
+  /**
+   * A block that is decoded ahead of being read. The buffer is written by a
+   * read-ahead job until the block is finished. When reading or decoding the
+   * block failed, the error is kept so that it can be thrown to the reader.
+   */
+  struct ReadAheadBlock {
+    std::unique_ptr<TimeBlockBuffer<data_t>> buffer;
+    bool isFinished;
+    std::exception_ptr error;
+  };
+
+  typedef BlockQueue<TimeBlockBuffer<data_t>> cache_t;
 
   void getValues(casacore::uInt rowNr, casacore::Array<data_t> *dataPtr);
+  void getColumnValues(const casacore::RefRows *rowNrs,
+                       casacore::Array<data_t> *dataPtr);
+  void getSliceValues(const casacore::RefRows *rowNrs,
+                      const casacore::Slicer &slicer,
+                      casacore::Array<data_t> *dataPtr);
   void putValues(casacore::uInt rowNr, const casacore::Array<data_t> *dataPtr);
+  void putColumnValues(const casacore::RefRows *rowNrs,
+                       const casacore::Array<data_t> *dataPtr);
+  void putSliceValues(const casacore::RefRows *rowNrs,
+                      const casacore::Slicer &slicer,
+                      const casacore::Array<data_t> *dataPtr);
+
+  /**
+   * Make sure that the block that contains the row is loaded, and determine the
+   * rows per block when the row starts the second block of a new file.
+   * @returns Index of the row in _timeBlockBuffer.
+   */
+  size_t prepareRowForWriting(uint64_t rowNr);
 
-  void stopThreads();
-  void encodeAndWrite(size_t blockIndex, const CacheItem &item,
+  /**
+   * Read consecutive rows. Rows of the current block are copied from
+   * _timeBlockBuffer, other rows are decoded directly into the destination.
+   * @param data Receives the values of the rows, with the rows stored
+   * consecutively.
+   */
+  void getRows(uint64_t startRow, uint64_t nRows, data_t *data);
+
+  /**
+   * Read the sliced part of consecutive rows. Rows that are not decoded yet
+   * are only partially decoded.
+   * @param data Receives the values of the slices, with the rows stored
+   * consecutively.
+   * @returns Pointer past the values that were read.
+   */
+  data_t *getSliceRows(uint64_t startRow, uint64_t nRows,
+                       const RowSlice &slice, data_t *data);
+
+  /**
+   * Write consecutive rows.
+   * @param data Values of the rows, with the rows stored consecutively.
+   */
+  void putRows(uint64_t startRow, uint64_t nRows, const data_t *data);
+
+  /**
+   * Write the sliced part of consecutive rows.
+   * @param data Values of the slices, with the rows stored consecutively.
+   * @returns Pointer past the values that were written.
+   */
+  const data_t *putSliceRows(uint64_t startRow, uint64_t nRows,
+                             const casacore::Slicer &slicer,
+                             const data_t *data);
+
+  /**
+   * Number of consecutive rows, starting at the given row, that are in the same
+   * block, limited to maxRows. Before the rows per block are known, this
+   * is one.
+   */
+  uint64_t rowsInSameBlock(uint64_t rowNr, uint64_t maxRows) const;
+
+  void stopEncoding();
+  void scheduleEncoding();
+  void runEncodingJob();
+  void encodeAndWrite(size_t blockIndex, TimeBlockBuffer<data_t> &buffer,
                       unsigned char *packedSymbolBuffer,
                       unsigned int *unpackedSymbolBuffer,
                       ThreadDataBase *threadUserData);
-  bool isWriteItemAvailable(typename cache_t::iterator &i);
-  void loadBlock(size_t blockIndex);
+  /**
+   * Make the block the current block.
+   * @param decodeLazily When set, the rows are only decoded when they are
+   * requested with decodeRows().
+   */
+  void loadBlock(size_t blockIndex, bool decodeLazily = false);
+
+  /**
+   * Make sure that the given rows of the current block are decoded. Only the
+   * packed symbols of rows that are not yet decoded are unpacked.
+   */
+  void decodeRows(size_t blockRow, size_t nRows);
+
+  /**
+   * Make the block the current block for reading. The block is taken from the
+   * decoded block cache or the read-ahead blocks when available, and the
+   * blocks after it are scheduled for read-ahead.
+   */
+  void loadBlockForReading(size_t blockIndex);
+
+  /**
+   * Move the current block into the decoded block cache, when it holds a
+   * block that is decoded from the file.
+   */
+  void cacheCurrentBlock();
+
+  /**
+   * Read the packed data of a block, and initialize the decoder of the state
+   * for it.
+   */
+  void readBlock(size_t blockIndex, JobState &state);
+
+  /**
+   * Like readBlock() for _readState, but does nothing when the block is
+   * already read.
+   */
+  void readBlockForDecoding(size_t blockIndex);
+
+  /** Start of the packed symbols of the block in the state. */
+  unsigned char *packedSymbols(JobState &state);
+
+  /**
+   * Unpack the symbols of the selected channels of consecutive rows of the
+   * block in the state.
+   */
+  void unpackSlice(JobState &state, size_t blockRow, size_t nRows,
+                   const RowSlice &slice);
+
+  bool isRowDecoded(size_t blockRow) const {
+    return _decodedRows.empty() || _decodedRows[blockRow];
+  }
+
+  /**
+   * Start decoding the blocks that follow the given block in the background,
+   * up to the read-ahead block count of the storage manager.
+   */
+  void scheduleReadAhead(size_t blockIndex);
+  void runReadAheadJob(size_t blockIndex, TimeBlockBuffer<data_t> *buffer);
+
+  /**
+   * Remove a block from the read-ahead blocks, after waiting until it is
+   * decoded.
+   * When the read-ahead job failed, its error is rethrown.
+   * @returns The decoded block, or nullptr when the block was not scheduled.
+   */
+  std::unique_ptr<TimeBlockBuffer<data_t>> takeReadAheadBlock(
+      size_t blockIndex);
+  void stopReadAhead();
+  void recycleBuffer(std::unique_ptr<TimeBlockBuffer<data_t>> buffer);
   void storeBlock();
+  std::unique_ptr<TimeBlockBuffer<data_t>> takeFreeBuffer();
   size_t maxCacheSize() const {
-    return ThreadedDyscoColumn::defaultThreadCount() * 12 / 10 + 1;
+    const size_t blockCount = storageManager().WriteCacheBlockCount();
+    if (blockCount != 0) return blockCount;
+    return ThreadedDyscoColumn::encoderThreadCount() * 12 / 10 + 1;
   }
 
   unsigned _bitsPerSymbol;
@@ -212,14 +559,46 @@ class ThreadedDyscoColumn : public DyscoStManColumn {
   std::unique_ptr<casacore::ScalarColumn<double>> _timeCol;
   double _lastWrittenTime;
   int _lastWrittenField, _lastWrittenDataDescId;
-  aocommon::UVector<unsigned char> _packedBlockReadBuffer;
-  aocommon::UVector<unsigned int> _unpackedSymbolReadBuffer;
+  /** Buffers and decoder used for reading blocks on the calling thread. */
+  JobState _readState;
   cache_t _cache;
-  bool _stopThreads;
+  /**
+   * Protects the job counters, the job states, the free buffers and the
+   * read-ahead blocks, and serializes initializeEncodeThread() and
+   * initializeDecodeThread().
+   */
   std::mutex _mutex;
-  threadgroup _threadGroup;
-  std::condition_variable _cacheChangedCondition;
+  std::condition_variable _jobsFinishedCondition;
+  std::vector<std::unique_ptr<JobState>> _freeEncoderStates;
+  /** Signalled when a read-ahead job finishes. */
+  std::condition_variable _readAheadCondition;
+  std::map<size_t, ReadAheadBlock> _readAheadBlocks;
+  std::vector<std::unique_ptr<JobState>> _freeDecoderStates;
+  size_t _nActiveReadAheadJobs;
+  /** Number of read blocks that were taken from _readAheadBlocks. */
+  size_t _readAheadHits;
+  /** Recently read blocks, other than the current block. */
+  DecodedBlockCache<TimeBlockBuffer<data_t>> _decodedBlocks;
+  /**
+   * Buffers of blocks that have been written, which are reused for new blocks
+   * to avoid allocating memory for every block.
+   */
+  std::vector<std::unique_ptr<TimeBlockBuffer<data_t>>> _freeBuffers;
+  bool _isEncodingStarted;
+  /** First error of an encoding job, until it is rethrown. */
+  std::exception_ptr _encodingError;
+  size_t _maxActiveJobs;
+  size_t _nActiveJobs;
+  size_t _nUnassignedBlocks;
   size_t _currentBlock;
+  /** Block of which the packed data is in _readState. */
+  size_t _readStateBlock;
+  /**
+   * Which rows of the current block are decoded. Empty when all rows are
+   * decoded.
+   */
+  std::vector<bool> _decodedRows;
+  size_t _nDecodedRows;
   bool _isCurrentBlockChanged;
   size_t _blockSize;
   size_t _antennaCount;
@@ -247,6 +626,126 @@ inline void ThreadedDyscoColumn<float>::putArrayfloatV(
     casacore::uInt rowNr, const casacore::Array<float> *dataPtr) {
   putValues(rowNr, dataPtr);
 }
+template <>
+inline void ThreadedDyscoColumn<std::complex<float>>::getArrayColumnComplexV(
+    casacore::Array<casacore::Complex> *dataPtr) {
+  getColumnValues(nullptr, dataPtr);
+}
+template <>
+inline void
+ThreadedDyscoColumn<std::complex<float>>::getArrayColumnCellsComplexV(
+    const casacore::RefRows &rowNrs,
+    casacore::Array<casacore::Complex> *dataPtr) {
+  getColumnValues(&rowNrs, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::getArrayColumnfloatV(
+    casacore::Array<float> *dataPtr) {
+  getColumnValues(nullptr, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::getArrayColumnCellsfloatV(
+    const casacore::RefRows &rowNrs, casacore::Array<float> *dataPtr) {
+  getColumnValues(&rowNrs, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<std::complex<float>>::getSliceComplexV(
+    casacore::uInt rowNr, const casacore::Slicer &slicer,
+    casacore::Array<casacore::Complex> *dataPtr) {
+  const casacore::RefRows rowNrs(rowNr, rowNr);
+  getSliceValues(&rowNrs, slicer, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<std::complex<float>>::getColumnSliceComplexV(
+    const casacore::Slicer &slicer,
+    casacore::Array<casacore::Complex> *dataPtr) {
+  getSliceValues(nullptr, slicer, dataPtr);
+}
+template <>
+inline void
+ThreadedDyscoColumn<std::complex<float>>::getColumnSliceCellsComplexV(
+    const casacore::RefRows &rowNrs, const casacore::Slicer &slicer,
+    casacore::Array<casacore::Complex> *dataPtr) {
+  getSliceValues(&rowNrs, slicer, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::getSlicefloatV(
+    casacore::uInt rowNr, const casacore::Slicer &slicer,
+    casacore::Array<float> *dataPtr) {
+  const casacore::RefRows rowNrs(rowNr, rowNr);
+  getSliceValues(&rowNrs, slicer, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::getColumnSlicefloatV(
+    const casacore::Slicer &slicer, casacore::Array<float> *dataPtr) {
+  getSliceValues(nullptr, slicer, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::getColumnSliceCellsfloatV(
+    const casacore::RefRows &rowNrs, const casacore::Slicer &slicer,
+    casacore::Array<float> *dataPtr) {
+  getSliceValues(&rowNrs, slicer, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<std::complex<float>>::putArrayColumnComplexV(
+    const casacore::Array<casacore::Complex> *dataPtr) {
+  putColumnValues(nullptr, dataPtr);
+}
+template <>
+inline void
+ThreadedDyscoColumn<std::complex<float>>::putArrayColumnCellsComplexV(
+    const casacore::RefRows &rowNrs,
+    const casacore::Array<casacore::Complex> *dataPtr) {
+  putColumnValues(&rowNrs, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<std::complex<float>>::putSliceComplexV(
+    casacore::uInt rowNr, const casacore::Slicer &slicer,
+    const casacore::Array<casacore::Complex> *dataPtr) {
+  const casacore::RefRows rowNrs(rowNr, rowNr);
+  putSliceValues(&rowNrs, slicer, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<std::complex<float>>::putColumnSliceComplexV(
+    const casacore::Slicer &slicer,
+    const casacore::Array<casacore::Complex> *dataPtr) {
+  putSliceValues(nullptr, slicer, dataPtr);
+}
+template <>
+inline void
+ThreadedDyscoColumn<std::complex<float>>::putColumnSliceCellsComplexV(
+    const casacore::RefRows &rowNrs, const casacore::Slicer &slicer,
+    const casacore::Array<casacore::Complex> *dataPtr) {
+  putSliceValues(&rowNrs, slicer, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::putArrayColumnfloatV(
+    const casacore::Array<float> *dataPtr) {
+  putColumnValues(nullptr, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::putArrayColumnCellsfloatV(
+    const casacore::RefRows &rowNrs, const casacore::Array<float> *dataPtr) {
+  putColumnValues(&rowNrs, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::putSlicefloatV(
+    casacore::uInt rowNr, const casacore::Slicer &slicer,
+    const casacore::Array<float> *dataPtr) {
+  const casacore::RefRows rowNrs(rowNr, rowNr);
+  putSliceValues(&rowNrs, slicer, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::putColumnSlicefloatV(
+    const casacore::Slicer &slicer, const casacore::Array<float> *dataPtr) {
+  putSliceValues(nullptr, slicer, dataPtr);
+}
+template <>
+inline void ThreadedDyscoColumn<float>::putColumnSliceCellsfloatV(
+    const casacore::RefRows &rowNrs, const casacore::Slicer &slicer,
+    const casacore::Array<float> *dataPtr) {
+  putSliceValues(&rowNrs, slicer, dataPtr);
+}
 
 extern template class ThreadedDyscoColumn<std::complex<float>>;
 extern template class ThreadedDyscoColumn<float>;
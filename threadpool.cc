@@ -0,0 +1,119 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+#include <unistd.h>
+
+namespace dyscostman {
+
+namespace {
+// The pool and worker index of the worker that runs on this thread, if any
+thread_local const ThreadPool *currentPool = nullptr;
+thread_local size_t currentWorkerIndex = 0;
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : _nextQueue(0), _nPendingJobs(0), _isStopped(false) {
+  threadCount = std::max<size_t>(threadCount, 1);
+  for (size_t i = 0; i != threadCount; ++i)
+    _queues.emplace_back(new WorkerQueue());
+  for (size_t i = 0; i != threadCount; ++i)
+    _threads.create_thread([this, i]() { run(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _isStopped = true;
+  }
+  _condition.notify_all();
+  _threads.join_all();
+}
+
+ThreadPool &ThreadPool::Instance() {
+  static ThreadPool pool(std::max(1l, sysconf(_SC_NPROCESSORS_ONLN)));
+  return pool;
+}
+
+void ThreadPool::Submit(std::function<void()> job) {
+  const size_t queueIndex =
+      (currentPool == this)
+          ? currentWorkerIndex
+          : _nextQueue.fetch_add(1, std::memory_order_relaxed) % NThreads();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_nPendingJobs;
+  }
+  {
+    WorkerQueue &queue = *_queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.emplace_back(std::move(job));
+  }
+  _condition.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t nTasks,
+                              const std::function<void(size_t)> &task) {
+  if (nTasks == 0) return;
+  struct State {
+    std::atomic<size_t> nextTask{0};
+    size_t nFinished = 0;
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+  // Helper jobs may start after this function has returned, in which case
+  // they find no more tasks and don't touch the task function.
+  std::shared_ptr<State> state = std::make_shared<State>();
+  auto runTasks = [state, nTasks, &task]() {
+    size_t nRun = 0;
+    size_t index;
+    while ((index = state->nextTask.fetch_add(1)) < nTasks) {
+      task(index);
+      ++nRun;
+    }
+    if (nRun != 0) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->nFinished += nRun;
+      if (state->nFinished == nTasks) state->condition.notify_all();
+    }
+  };
+  const size_t nHelpers = std::min(nTasks, NThreads()) - 1;
+  for (size_t i = 0; i != nHelpers; ++i) Submit(runTasks);
+  runTasks();
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (state->nFinished != nTasks) state->condition.wait(lock);
+}
+
+bool ThreadPool::tryPop(size_t queueIndex, std::function<void()> &job) {
+  WorkerQueue &queue = *_queues[queueIndex];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.jobs.empty()) return false;
+  job = std::move(queue.jobs.front());
+  queue.jobs.pop_front();
+  return true;
+}
+
+void ThreadPool::run(size_t workerIndex) {
+  currentPool = this;
+  currentWorkerIndex = workerIndex;
+  const size_t nQueues = NThreads();
+  std::function<void()> job;
+  while (true) {
+    // Take a job from the own queue first, otherwise steal one
+    bool hasJob = false;
+    for (size_t i = 0; i != nQueues && !hasJob; ++i)
+      hasJob = tryPop((workerIndex + i) % nQueues, job);
+
+    if (hasJob) {
+      _nPendingJobs.fetch_sub(1, std::memory_order_relaxed);
+      job();
+      job = nullptr;
+    } else {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (_nPendingJobs == 0 && !_isStopped) _condition.wait(lock);
+      if (_nPendingJobs == 0 && _isStopped) return;
+    }
+  }
+}
+
+}  // namespace dyscostman
@@ -0,0 +1,85 @@
+#ifndef DYSCO_THREAD_POOL_H
+#define DYSCO_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "threadgroup.h"
+
+namespace dyscostman {
+
+/**
+ * Pool of worker threads that execute submitted jobs. All columns of all
+ * DyscoStMan instances in a process share the pool returned by Instance(), so
+ * that the total number of encoding threads is bounded by the number of cores,
+ * independently of how many columns and tables are opened.
+ *
+ * Every worker has its own job queue. A job submitted from a worker thread is
+ * added to the queue of that worker, other jobs are distributed round-robin
+ * over the queues. A worker without jobs steals from the queues of the other
+ * workers. Queues are processed first-in first-out, so jobs of different
+ * submitters are interleaved fairly.
+ */
+class ThreadPool {
+ public:
+  /**
+   * Create a pool with the given number of threads.
+   */
+  explicit ThreadPool(size_t threadCount);
+
+  /**
+   * Finish all jobs and join the worker threads.
+   */
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * The process-wide pool, which has one thread per available core. It is
+   * created on first use.
+   */
+  static ThreadPool &Instance();
+
+  size_t NThreads() const { return _queues.size(); }
+
+  /**
+   * Add a job to the pool. The job is executed asynchronously by one of the
+   * workers. Jobs should not throw.
+   */
+  void Submit(std::function<void()> job);
+
+  /**
+   * Call task(i) for every i in [0, nTasks) and wait until all calls have
+   * finished. The calling thread executes tasks as well, and other workers
+   * help when they are idle. It is therefore safe to call this function from a
+   * job that runs in the pool.
+   */
+  void ParallelFor(size_t nTasks, const std::function<void(size_t)> &task);
+
+ private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> jobs;
+  };
+
+  void run(size_t workerIndex);
+  bool tryPop(size_t queueIndex, std::function<void()> &job);
+
+  std::vector<std::unique_ptr<WorkerQueue>> _queues;
+  std::atomic<size_t> _nextQueue;
+  std::atomic<size_t> _nPendingJobs;
+  bool _isStopped;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  threadgroup _threads;
+};
+
+}  // namespace dyscostman
+
+#endif
@@ -3,78 +3,185 @@
 
 #include "uvector.h"
 
+#include <algorithm>
 #include <complex>
+#include <cstring>
 #include <vector>
 
+/**
+ * Holds the data of one time block. The visibilities of all rows are stored in
+ * a single contiguous array with dimensions rows x channels x polarizations,
+ * and the antenna indices are stored in separate arrays. Rows can be accessed
+ * as a view with operator[] or by iterating over the buffer.
+ */
 template <typename data_t>
 class TimeBlockBuffer {
  public:
   typedef unsigned symbol_t;
 
-  TimeBlockBuffer(size_t nPol, size_t nChannels)
-      : _nPol(nPol), _nChannels(nChannels) {}
-
-  bool Empty() const { return _data.empty(); }
+  /**
+   * View on a single row of the buffer. The visibilities of a row are ordered
+   * by channel and then by polarization.
+   */
+  template <typename T>
+  struct RowView {
+    size_t antenna1, antenna2;
+    T *visibilities;
 
-  void resize(size_t nRows) { _data.resize(nRows); }
+    operator RowView<const T>() const {
+      return RowView<const T>{antenna1, antenna2, visibilities};
+    }
+  };
+  typedef RowView<data_t> DataRow;
+  typedef RowView<const data_t> ConstDataRow;
+
+  template <typename Buffer, typename Row>
+  class RowIterator {
+   public:
+    RowIterator(Buffer &buffer, size_t rowIndex)
+        : _buffer(&buffer), _rowIndex(rowIndex) {}
+    Row operator*() const { return (*_buffer)[_rowIndex]; }
+    RowIterator &operator++() {
+      ++_rowIndex;
+      return *this;
+    }
+    bool operator!=(const RowIterator &rhs) const {
+      return _rowIndex != rhs._rowIndex;
+    }
 
-  struct DataRow {
-    size_t antenna1, antenna2;
-    std::vector<data_t> visibilities;
+   private:
+    Buffer *_buffer;
+    size_t _rowIndex;
   };
+  typedef RowIterator<TimeBlockBuffer, DataRow> iterator;
+  typedef RowIterator<const TimeBlockBuffer, ConstDataRow> const_iterator;
+
+  TimeBlockBuffer() : _nPol(0), _nChannels(0), _nRows(0) {}
+
+  TimeBlockBuffer(size_t nPol, size_t nChannels)
+      : _nPol(nPol), _nChannels(nChannels), _nRows(0) {}
+
+  bool Empty() const { return _nRows == 0; }
+
+  /**
+   * Change the number of rows. Rows that are added are set to zero.
+   */
+  void resize(size_t nRows) {
+    const size_t oldNRows = _nRows;
+    setNRows(nRows);
+    if (nRows > oldNRows) {
+      std::fill(Row(oldNRows), Row(nRows), data_t());
+      std::fill(_antenna1.begin() + oldNRows, _antenna1.end(), 0);
+      std::fill(_antenna2.begin() + oldNRows, _antenna2.end(), 0);
+    }
+  }
+
+  /**
+   * Change the number of rows without initializing the rows that are added,
+   * for when these are written later.
+   */
+  void ResizeUninitialized(size_t nRows) { setNRows(nRows); }
+
+  /**
+   * Allocate storage for the given number of rows, such that setting the data
+   * of that many rows does not allocate memory.
+   */
+  void Reserve(size_t nRows) {
+    _visibilities.reserve(nRows * ValuesPerRow());
+    _antenna1.reserve(nRows);
+    _antenna2.reserve(nRows);
+  }
 
-  DataRow &operator[](size_t rowIndex) { return _data[rowIndex]; }
+  DataRow operator[](size_t rowIndex) {
+    return DataRow{_antenna1[rowIndex], _antenna2[rowIndex], Row(rowIndex)};
+  }
+  ConstDataRow operator[](size_t rowIndex) const {
+    return ConstDataRow{_antenna1[rowIndex], _antenna2[rowIndex],
+                        Row(rowIndex)};
+  }
 
-  void ResetData() { _data.clear(); }
+  iterator begin() { return iterator(*this, 0); }
+  iterator end() { return iterator(*this, _nRows); }
+  const_iterator begin() const { return const_iterator(*this, 0); }
+  const_iterator end() const { return const_iterator(*this, _nRows); }
+
+  /**
+   * Remove all rows. The storage is kept, so that the buffer can be reused for
+   * a next block without allocating memory.
+   */
+  void ResetData() { setNRows(0); }
 
   void SetData(size_t blockRow, size_t antenna1, size_t antenna2,
                const data_t *data) {
-    if (_data.size() <= blockRow) _data.resize(blockRow + 1);
-    DataRow &newRow = _data[blockRow];
-    newRow.antenna1 = antenna1;
-    newRow.antenna2 = antenna2;
-    newRow.visibilities.resize(_nPol * _nChannels);
-    for (size_t i = 0; i != _nPol * _nChannels; ++i)
-      newRow.visibilities[i] = data[i];
+    if (_nRows <= blockRow) {
+      // Rows that are skipped are set to zero
+      resize(blockRow);
+      setNRows(blockRow + 1);
+    }
+    SetAntennas(blockRow, antenna1, antenna2);
+    std::copy_n(data, ValuesPerRow(), Row(blockRow));
+  }
+
+  /**
+   * Set the data of consecutive rows with a single copy.
+   * @param data Values of the rows, with the rows stored consecutively.
+   */
+  template <typename AntennaType>
+  void SetRows(size_t blockRow, size_t nRows, const AntennaType *antenna1,
+               const AntennaType *antenna2, const data_t *data) {
+    // Rows that are skipped are set to zero
+    if (_nRows < blockRow) resize(blockRow);
+    if (_nRows < blockRow + nRows) setNRows(blockRow + nRows);
+    std::copy_n(antenna1, nRows, _antenna1.begin() + blockRow);
+    std::copy_n(antenna2, nRows, _antenna2.begin() + blockRow);
+    std::copy_n(data, nRows * ValuesPerRow(), Row(blockRow));
+  }
+
+  void SetAntennas(size_t blockRow, size_t antenna1, size_t antenna2) {
+    _antenna1[blockRow] = antenna1;
+    _antenna2[blockRow] = antenna2;
   }
 
   void GetData(size_t blockRow, data_t *destination) const {
-    const data_t *srcPtr = _data[blockRow].visibilities.data();
-    memcpy(destination, srcPtr,
-           sizeof(data_t) * _data[blockRow].visibilities.size());
+    memcpy(destination, Row(blockRow), sizeof(data_t) * ValuesPerRow());
   }
 
-  size_t NRows() const { return _data.size(); }
+  /** Visibilities of one row, ordered by channel and then by polarization. */
+  data_t *Row(size_t blockRow) {
+    return _visibilities.data() + blockRow * ValuesPerRow();
+  }
+  const data_t *Row(size_t blockRow) const {
+    return _visibilities.data() + blockRow * ValuesPerRow();
+  }
+
+  size_t Antenna1(size_t blockRow) const { return _antenna1[blockRow]; }
+  size_t Antenna2(size_t blockRow) const { return _antenna2[blockRow]; }
+
+  size_t NRows() const { return _nRows; }
+  size_t NPolarizations() const { return _nPol; }
+  size_t NChannels() const { return _nChannels; }
+  size_t ValuesPerRow() const { return _nPol * _nChannels; }
 
   size_t MaxAntennaIndex() const {
     size_t maxAntennaIndex = 0;
-    for (const DataRow &row : _data) {
+    for (size_t i = 0; i != _nRows; ++i) {
       maxAntennaIndex =
-          std::max(maxAntennaIndex, std::max(row.antenna1, row.antenna2));
+          std::max(maxAntennaIndex, std::max(_antenna1[i], _antenna2[i]));
     }
     return maxAntennaIndex;
   }
 
-  const std::vector<DataRow> &GetVector() const { return _data; }
-  std::vector<DataRow> &GetVector() { return _data; }
-
-  template <typename other_t>
-  void ConvertVector(
-      std::vector<typename TimeBlockBuffer<other_t>::DataRow> &vector) const {
-    vector.resize(_data.size());
-    for (size_t i = 0; i != _data.size(); ++i) {
-      const DataRow &rowIn = _data[i];
-      typename TimeBlockBuffer<other_t>::DataRow &rowOut = vector[i];
-      rowOut.antenna1 = rowIn.antenna1;
-      rowOut.antenna2 = rowIn.antenna2;
-      rowOut.visibilities.assign(rowIn.visibilities.begin(),
-                                 rowIn.visibilities.end());
-    }
+ private:
+  void setNRows(size_t nRows) {
+    _visibilities.resize(nRows * ValuesPerRow());
+    _antenna1.resize(nRows);
+    _antenna2.resize(nRows);
+    _nRows = nRows;
   }
 
- private:
-  size_t _nPol, _nChannels;
-  std::vector<DataRow> _data;
+  size_t _nPol, _nChannels, _nRows;
+  aocommon::UVector<data_t> _visibilities;
+  aocommon::UVector<size_t> _antenna1, _antenna2;
 };
 
 template class TimeBlockBuffer<std::complex<float>>;
@@ -1,12 +1,18 @@
 #ifndef DYSCO_TIME_BLOCK_ENCODER_H
 #define DYSCO_TIME_BLOCK_ENCODER_H
 
+#include "philox.h"
+#include "rowslice.h"
 #include "stochasticencoder.h"
 #include "timeblockbuffer.h"
 #include "uvector.h"
+#include "xoshiro.h"
 
+#include <algorithm>
 #include <complex>
+#include <functional>
 #include <random>
+#include <type_traits>
 #include <vector>
 
 class RMSMeasurement {
@@ -35,8 +41,6 @@ class TimeBlockEncoder {
  public:
   typedef TimeBlockBuffer<std::complex<float>> FBuffer;
   typedef typename TimeBlockBuffer<std::complex<float>>::DataRow FBufferRow;
-  typedef TimeBlockBuffer<std::complex<double>> DBuffer;
-  typedef typename TimeBlockBuffer<std::complex<double>>::DataRow DBufferRow;
 
   typedef unsigned symbol_t;
 
@@ -47,6 +51,25 @@ class TimeBlockEncoder {
       float *metaBuffer, symbol_t *symbolBuffer, size_t antennaCount,
       std::mt19937 &rnd) = 0;
 
+  /**
+   * Encode with dithering, using a counter-based generator. This is used to
+   * make the result independent of the order in which blocks are encoded.
+   */
+  virtual void EncodeWithDithering(
+      const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
+      float *metaBuffer, symbol_t *symbolBuffer, size_t antennaCount,
+      dyscostman::Philox4x32 &rnd) = 0;
+
+  /**
+   * Encode with dithering, using a generator that produces the dither values
+   * faster than the counter-based generator. The block is quantized
+   * sequentially, because this generator can not seek.
+   */
+  virtual void EncodeWithDithering(
+      const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
+      float *metaBuffer, symbol_t *symbolBuffer, size_t antennaCount,
+      dyscostman::Xoshiro256x4 &rnd) = 0;
+
   virtual void EncodeWithoutDithering(
       const dyscostman::StochasticEncoder<float> &gausEncoder, FBuffer &buffer,
       float *metaBuffer, symbol_t *symbolBuffer, size_t antennaCount) = 0;
@@ -54,9 +77,49 @@ class TimeBlockEncoder {
   virtual void InitializeDecode(const float *metaBuffer, size_t nRow,
                                 size_t nAntennae) = 0;
 
-  virtual void Decode(const dyscostman::StochasticEncoder<float> &gausEncoder,
-                      FBuffer &buffer, const symbol_t *symbolBuffer,
-                      size_t blockRow, size_t antenna1, size_t antenna2) = 0;
+  /**
+   * Decode one row into the buffer and set the antennas of the row.
+   */
+  void Decode(const dyscostman::StochasticEncoder<float> &gausEncoder,
+              FBuffer &buffer, const symbol_t *symbolBuffer, size_t blockRow,
+              size_t antenna1, size_t antenna2) {
+    buffer.SetAntennas(blockRow, antenna1, antenna2);
+    DecodeRow(gausEncoder, symbolBuffer, blockRow, antenna1, antenna2,
+              buffer.Row(blockRow));
+  }
+
+  /**
+   * Decode the visibilities of one row.
+   * @param destination Receives the values of the row, ordered by channel and
+   * then by polarization.
+   */
+  virtual void DecodeRow(
+      const dyscostman::StochasticEncoder<float> &gausEncoder,
+      const symbol_t *symbolBuffer, size_t blockRow, size_t antenna1,
+      size_t antenna2, std::complex<float> *destination) = 0;
+
+  /**
+   * Decode the visibilities of one row directly from the packed symbols. This
+   * gives the same result as unpacking the symbols and calling DecodeRow(),
+   * without the intermediate symbol buffer.
+   * @param packedSymbols The packed symbols of the block.
+   * @param bitCount Number of bits per packed symbol.
+   */
+  virtual void DecodeRowPacked(
+      const dyscostman::StochasticEncoder<float> &gausEncoder,
+      const unsigned char *packedSymbols, unsigned bitCount, size_t blockRow,
+      size_t antenna1, size_t antenna2, std::complex<float> *destination) = 0;
+
+  /**
+   * Decode the selected visibilities of one row. Only the symbols of the
+   * selected visibilities are read from the symbol buffer.
+   * @param destination Receives the slice.Size() selected values.
+   */
+  virtual void DecodeRowSlice(
+      const dyscostman::StochasticEncoder<float> &gausEncoder,
+      const symbol_t *symbolBuffer, size_t blockRow, size_t antenna1,
+      size_t antenna2, const RowSlice &slice,
+      std::complex<float> *destination) = 0;
 
   virtual size_t SymbolCount(size_t nRow, size_t nPol,
                              size_t nChannels) const = 0;
@@ -68,8 +131,168 @@ class TimeBlockEncoder {
   virtual size_t MetaDataCount(size_t nRow, size_t nPol, size_t nChannels,
                                size_t nAntennae) const = 0;
 
+  /**
+   * Function that calls task(i) for i in [0, nTasks) and returns when all
+   * tasks have finished. The tasks may run in parallel.
+   */
+  typedef std::function<void(size_t nTasks,
+                             const std::function<void(size_t)> &task)>
+      ParallelFor;
+
+  /**
+   * Set the function that is used to normalize and quantize parts of a block
+   * in parallel. Without such a function, a block is encoded by the calling
+   * thread. The result does not depend on whether parallelization is used.
+   */
+  void SetParallelFor(ParallelFor parallelFor) {
+    _parallelFor = std::move(parallelFor);
+  }
+
  protected:
   TimeBlockEncoder() = default;
+
+  /**
+   * Call task(begin, end) for consecutive ranges that together cover [0, n).
+   * The ranges are processed in parallel when a ParallelFor function is set and
+   * there is enough work.
+   * @param costPerItem Approximate number of values that is processed per item,
+   * used to decide on the number of ranges.
+   */
+  void forEachRange(size_t n, size_t costPerItem,
+                    const std::function<void(size_t, size_t)> &task) const {
+    const size_t nRanges =
+        _parallelFor ? std::min(n, n * costPerItem / kMinValuesPerRange) : 1;
+    if (nRanges <= 1) {
+      task(0, n);
+    } else {
+      _parallelFor(nRanges, [&](size_t rangeIndex) {
+        task(n * rangeIndex / nRanges, n * (rangeIndex + 1) / nRanges);
+      });
+    }
+  }
+
+  /**
+   * Prepare the normalization factors for the given block: one factor per row
+   * and polarization and one factor per value of a row, all set to one.
+   */
+  void initializeEncodeFactors(const FBuffer &data) {
+    _encodeRowFactors.assign(data.NRows() * data.NPolarizations(), 1.0);
+    _encodeVisFactors.assign(data.ValuesPerRow(), 1.0);
+  }
+
+  /**
+   * Quantize the data, normalized with the normalization factors, into the
+   * symbol buffer. With dithering, the data can only be split over multiple
+   * threads when the random generator supports seeking, which ensures that the
+   * result is identical to processing it sequentially.
+   */
+  template <bool UseDithering, typename RandomGenerator>
+  void quantize(const dyscostman::StochasticEncoder<float> &gausEncoder,
+                const FBuffer &data, symbol_t *symbolBuffer,
+                RandomGenerator *rnd) const {
+    const size_t symbolsPerRow = data.ValuesPerRow() * 2;
+    if constexpr (!UseDithering) {
+      forEachRange(data.NRows(), symbolsPerRow, [&](size_t begin, size_t end) {
+        quantizeRows<false>(gausEncoder, data, begin, end,
+                            symbolBuffer + begin * symbolsPerRow, rnd);
+      });
+    } else if constexpr (std::is_same<RandomGenerator,
+                                      dyscostman::Philox4x32>::value) {
+      // The dither distribution takes one value from the generator per
+      // symbol, so every range can seek to its own part of the stream.
+      const uint64_t start = rnd->Position();
+      forEachRange(data.NRows(), symbolsPerRow, [&](size_t begin, size_t end) {
+        dyscostman::Philox4x32 rangeRnd(*rnd);
+        rangeRnd.Seek(start + begin * symbolsPerRow);
+        quantizeRows<true>(gausEncoder, data, begin, end,
+                           symbolBuffer + begin * symbolsPerRow, &rangeRnd);
+      });
+      rnd->Seek(start + data.NRows() * symbolsPerRow);
+    } else {
+      quantizeRows<true>(gausEncoder, data, 0, data.NRows(), symbolBuffer, rnd);
+    }
+  }
+
+  /**
+   * Normalization factors of the block that is being encoded. Value i of row r
+   * is normalized by multiplying it with
+   * _encodeRowFactors[r * nPol + i % nPol] and then with _encodeVisFactors[i].
+   * The normalization is applied while quantizing, so that the block does not
+   * have to be copied. The factors are members so that their storage is reused
+   * by subsequent blocks.
+   */
+  aocommon::UVector<double> _encodeRowFactors, _encodeVisFactors;
+
+ private:
+  template <bool UseDithering, typename RandomGenerator>
+  void quantizeRows(const dyscostman::StochasticEncoder<float> &gausEncoder,
+                    const FBuffer &data, size_t rowBegin, size_t rowEnd,
+                    symbol_t *symbolBuffer, RandomGenerator *rnd) const {
+    // The rows are stored contiguously, so the range can be processed as one
+    // array of real and imaginary values, in the order of the symbols. These
+    // are normalized in chunks to be encoded as a batch.
+    const float *values = reinterpret_cast<const float *>(data.Row(rowBegin));
+    const size_t nPol = data.NPolarizations();
+    const size_t visPerRow = data.ValuesPerRow();
+    const size_t nValues = (rowEnd - rowBegin) * visPerRow * 2;
+    const double *rowFactors = _encodeRowFactors.data() + rowBegin * nPol;
+    float chunkValues[kChunkSize];
+    unsigned ditherValues[kChunkSize];
+    size_t visIndex = 0;
+    for (size_t chunkStart = 0; chunkStart < nValues;
+         chunkStart += kChunkSize) {
+      // The chunk size is even, so chunks hold whole complex values
+      const size_t n = std::min(kChunkSize, nValues - chunkStart);
+      const float *chunkInput = values + chunkStart;
+      for (size_t i = 0; i != n; i += 2) {
+        const double rowFactor = rowFactors[visIndex % nPol];
+        const double visFactor = _encodeVisFactors[visIndex];
+        chunkValues[i] = double(chunkInput[i]) * rowFactor * visFactor;
+        chunkValues[i + 1] = double(chunkInput[i + 1]) * rowFactor * visFactor;
+        if (++visIndex == visPerRow) {
+          visIndex = 0;
+          rowFactors += nPol;
+        }
+      }
+      if (UseDithering) {
+        generateDither(*rnd, ditherValues, n);
+        gausEncoder.EncodeWithDitheringBatch(chunkValues, ditherValues, n,
+                                             symbolBuffer + chunkStart);
+      } else {
+        gausEncoder.EncodeBatch(chunkValues, n, symbolBuffer + chunkStart);
+      }
+    }
+  }
+
+  /**
+   * Draw values from the dither distribution. The Philox and xoshiro
+   * generators fill the buffer in bulk, after which the values are reduced
+   * to the range of StochasticEncoder::GetDitherDistribution() by dropping
+   * their lowest bit. This gives uniform values in the same range as the
+   * distribution. Whether they are also the values that the distribution
+   * would give for the same generator output depends on the standard
+   * library, so the two are not interchangeable.
+   */
+  template <typename RandomGenerator>
+  static void generateDither(RandomGenerator &rnd, unsigned *ditherValues,
+                             size_t n) {
+    if constexpr (std::is_same<RandomGenerator, std::mt19937>::value) {
+      std::uniform_int_distribution<unsigned> ditherDist =
+          dyscostman::StochasticEncoder<float>::GetDitherDistribution();
+      for (size_t i = 0; i != n; ++i) ditherValues[i] = ditherDist(rnd);
+    } else {
+      rnd.Fill(ditherValues, n);
+      for (size_t i = 0; i != n; ++i) ditherValues[i] >>= 1;
+    }
+  }
+
+  /** Number of values that quantizeRows() converts and encodes at once. */
+  static constexpr size_t kChunkSize = 512;
+
+  /** Minimum number of values that is worth processing in a separate task. */
+  static constexpr size_t kMinValuesPerRange = 1 << 16;
+
+  ParallelFor _parallelFor;
 };
 
 #endif
@@ -4,6 +4,8 @@
 #include <cmath>
 #include <cstring>
 
+#include "bytepacker.h"
+#include "rowslice.h"
 #include "timeblockbuffer.h"
 
 class WeightBlockEncoder {
@@ -25,22 +27,56 @@ class WeightBlockEncoder {
 
   void Decode(TimeBlockBuffer<float> &buffer, const unsigned int *symbolBuffer,
               size_t blockRow) const {
+    Decode(symbolBuffer, blockRow, buffer.Row(blockRow));
+  }
+
+  /**
+   * Decode the weights of one row.
+   * @param rowPtr Receives the values of the row, ordered by channel and then
+   * by polarization.
+   */
+  void Decode(const unsigned int *symbolBuffer, size_t blockRow,
+              float *rowPtr) const {
+    const unsigned int *rowBuffer = &symbolBuffer[blockRow * _nChannels];
+    auto readSymbol = [&rowBuffer]() { return *rowBuffer++; };
+    decodeRow(readSymbol, rowPtr);
+  }
+
+  /**
+   * Decode the weights of one row directly from the packed symbols, without
+   * unpacking them first.
+   * @param bitCount Number of bits per packed symbol.
+   */
+  void Decode(const unsigned char *packedSymbols, unsigned bitCount,
+              size_t blockRow, float *rowPtr) const {
+    dyscostman::BytePacker::readSymbols(
+        bitCount, packedSymbols, blockRow * _nChannels,
+        [&](auto readSymbol) { decodeRow(readSymbol, rowPtr); });
+  }
+
+  /**
+   * Decode the selected weights of one row. Only the symbols of the selected
+   * channels are read from the symbol buffer.
+   * @param destination Receives the slice.Size() selected values.
+   */
+  void Decode(const unsigned int *symbolBuffer, size_t blockRow,
+              const RowSlice &slice, float *destination) const {
     double scaleValue = _decodeMaxValue / (double(_quantCount - 1));
-    TimeBlockBuffer<float>::DataRow &row = buffer[blockRow];
     const unsigned int *rowBuffer = &symbolBuffer[blockRow * _nChannels];
-    for (size_t ch = 0; ch != _nChannels; ++ch) {
-      float value = *rowBuffer * scaleValue;
-      row.visibilities.resize(_nChannels * _nPolarizations);
-      float *chPtr = &row.visibilities[ch * _nPolarizations];
-      for (size_t p = 0; p != _nPolarizations; ++p) chPtr[p] = value;
-      ++rowBuffer;
+    for (size_t c = 0; c != slice.channelCount; ++c) {
+      const size_t ch = slice.channelStart + c * slice.channelStride;
+      float value = rowBuffer[ch] * scaleValue;
+      for (size_t p = 0; p != slice.polarizationCount; ++p) {
+        *destination = value;
+        ++destination;
+      }
     }
   }
 
-  void Encode(TimeBlockBuffer<float> &buffer, float *metaBuffer,
+  void Encode(const TimeBlockBuffer<float> &buffer, float *metaBuffer,
               unsigned int *symbolBuffer) const {
     float maxValue = 0.0;
-    for (const TimeBlockBuffer<float>::DataRow &row : buffer.GetVector()) {
+    for (TimeBlockBuffer<float>::ConstDataRow row : buffer) {
       for (size_t ch = 0; ch != _nChannels; ++ch) {
         const float *visPtr = &row.visibilities[ch * _nPolarizations];
         float weight = *visPtr;
@@ -54,7 +90,7 @@ class WeightBlockEncoder {
 
     double scaleValue = double(_quantCount - 1) / maxValue;
 
-    for (const TimeBlockBuffer<float>::DataRow &row : buffer.GetVector()) {
+    for (TimeBlockBuffer<float>::ConstDataRow row : buffer) {
       for (size_t ch = 0; ch != _nChannels; ++ch) {
         const float *visPtr = &row.visibilities[ch * _nPolarizations];
         float weight = *visPtr;
@@ -68,6 +104,16 @@ class WeightBlockEncoder {
   }
 
  private:
+  template <typename SymbolReader>
+  void decodeRow(SymbolReader &readSymbol, float *rowPtr) const {
+    double scaleValue = _decodeMaxValue / (double(_quantCount - 1));
+    for (size_t ch = 0; ch != _nChannels; ++ch) {
+      float value = readSymbol() * scaleValue;
+      float *chPtr = &rowPtr[ch * _nPolarizations];
+      for (size_t p = 0; p != _nPolarizations; ++p) chPtr[p] = value;
+    }
+  }
+
   const size_t _nPolarizations;
   const size_t _nChannels;
   const size_t _quantCount;
@@ -0,0 +1,149 @@
+#ifndef DYSCO_XOSHIRO_H
+#define DYSCO_XOSHIRO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "cpufeatures.h"
+
+namespace dyscostman {
+
+/**
+ * Four interleaved xoshiro256+ generators (Blackman and Vigna, 2018,
+ * "Scrambled linear pseudorandom number generators"). The generators are
+ * advanced together, which takes a few AVX2 instructions, and every step
+ * returns the upper 32 bits of the four outputs in order of the generators.
+ * The lower bits of xoshiro256+ are of lower quality and are not used.
+ *
+ * Like Philox4x32, every combination of a key and a stream gives an
+ * independent stream. Unlike Philox4x32, it is not possible to seek in the
+ * stream, so a block that is dithered with this generator is quantized
+ * sequentially.
+ *
+ * The class satisfies the UniformRandomBitGenerator requirements, so it can be
+ * used with the standard random distributions.
+ */
+class Xoshiro256x4 {
+ public:
+  typedef uint32_t result_type;
+
+  /**
+   * Construct the generator for a given stream. The states are initialized
+   * with SplitMix64, as recommended by the authors of xoshiro.
+   * @param key The key, e.g. a random seed.
+   * @param stream Index of the stream.
+   */
+  Xoshiro256x4(uint64_t key, uint64_t stream) : _outputIndex(4) {
+    uint64_t splitMixState = key;
+    uint64_t streamState = stream;
+    splitMixState ^= SplitMix64(streamState);
+    for (size_t word = 0; word != 4; ++word) {
+      for (size_t lane = 0; lane != 4; ++lane)
+        _state[word][lane] = SplitMix64(splitMixState);
+    }
+  }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() {
+    if (_outputIndex == 4) {
+      step(_output);
+      _outputIndex = 0;
+    }
+    return _output[_outputIndex++];
+  }
+
+  /**
+   * Fill a buffer with the next values of the stream. The values are the same
+   * as those returned by calling operator() for every element.
+   */
+  void Fill(result_type *values, size_t count) {
+    for (; count != 0 && _outputIndex != 4; --count)
+      *values++ = _output[_outputIndex++];
+    size_t stepCount = count / 4;
+#ifdef DYSCO_AVX2_KERNELS
+    if (HasAvx2()) {
+      fillAvx2(values, stepCount);
+      values += stepCount * 4;
+      stepCount = 0;
+    }
+#endif
+    for (; stepCount != 0; --stepCount) {
+      step(values);
+      values += 4;
+    }
+    for (count %= 4; count != 0; --count) *values++ = operator()();
+  }
+
+  /**
+   * Return the next value of a SplitMix64 generator and advance its state.
+   */
+  static uint64_t SplitMix64(uint64_t &state) {
+    state += 0x9E3779B97F4A7C15;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+  }
+
+ private:
+  void step(result_type output[4]) {
+    for (size_t lane = 0; lane != 4; ++lane) {
+      uint64_t &s0 = _state[0][lane], &s1 = _state[1][lane],
+               &s2 = _state[2][lane], &s3 = _state[3][lane];
+      output[lane] = result_type((s0 + s3) >> 32);
+      const uint64_t t = s1 << 17;
+      s2 ^= s0;
+      s3 ^= s1;
+      s1 ^= s2;
+      s0 ^= s3;
+      s2 ^= t;
+      s3 = (s3 << 45) | (s3 >> 19);
+    }
+  }
+
+#ifdef DYSCO_AVX2_KERNELS
+  /**
+   * Take @p stepCount steps of the generators with AVX2 and store the
+   * outputs. Requires HasAvx2().
+   */
+  DYSCO_TARGET_AVX2 void fillAvx2(result_type *values, size_t stepCount) {
+    __m256i s[4];
+    for (size_t word = 0; word != 4; ++word)
+      s[word] =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(_state[word]));
+    // Selects the upper halves of the 64-bit lanes
+    const __m256i upperHalves = _mm256_set_epi32(0, 0, 0, 0, 7, 5, 3, 1);
+    for (; stepCount != 0; --stepCount) {
+      const __m256i result = _mm256_add_epi64(s[0], s[3]);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(values),
+                       _mm256_castsi256_si128(
+                           _mm256_permutevar8x32_epi32(result, upperHalves)));
+      values += 4;
+      const __m256i t = _mm256_slli_epi64(s[1], 17);
+      s[2] = _mm256_xor_si256(s[2], s[0]);
+      s[3] = _mm256_xor_si256(s[3], s[1]);
+      s[1] = _mm256_xor_si256(s[1], s[2]);
+      s[0] = _mm256_xor_si256(s[0], s[3]);
+      s[2] = _mm256_xor_si256(s[2], t);
+      s[3] = _mm256_or_si256(_mm256_slli_epi64(s[3], 45),
+                             _mm256_srli_epi64(s[3], 19));
+    }
+    for (size_t word = 0; word != 4; ++word)
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(_state[word]), s[word]);
+  }
+#endif
+
+  /** The states, with the four words of generator i in _state[0..3][i]. */
+  uint64_t _state[4][4];
+  uint32_t _output[4];
+  unsigned _outputIndex;
+};
+
+}  // namespace dyscostman
+
+#endif